@@ -0,0 +1,59 @@
+/*** 
+ * @Author: Xu.WANG
+ * @Date: 2021-02-25 15:02:11
+ * @LastEditTime: 2021-02-25 17:40:26
+ * @LastEditors: Xu.WANG
+ * @Description: content addressed cache for mesh SDFs and sampled particles
+ * @FilePath: \KiriCore\include\kiri_core\geo\geo_cache.h
+ */
+
+#ifndef _KIRI_GEO_CACHE_H_
+#define _KIRI_GEO_CACHE_H_
+#pragma once
+#include <kiri_pch.h>
+
+// FNV-1a, the key of a cache entry is the hash of everything the entry is computed from
+class KiriGeoHash
+{
+public:
+    KiriGeoHash &Add(const void *Data, size_t Bytes);
+
+    template <class T>
+    KiriGeoHash &Add(const T &Value) { return Add(&Value, sizeof(T)); }
+
+    // appends the raw bytes of a file, returns false if it can't be read
+    bool AddFile(const String &FilePath);
+
+    UInt64 value() const { return mHash; }
+
+private:
+    UInt64 mHash = 14695981039346656037ull;
+};
+
+// every entry is one file <cache folder>/<key>.<ext>: a fixed 64 byte header followed by the raw float data,
+// so the payload is aligned and the file can be mapped as it is
+class KiriGeoCache
+{
+public:
+    static void SetEnabled(bool Enable) { bEnabled() = Enable; }
+    static bool IsEnabled() { return bEnabled(); }
+
+    static String CacheFolder();
+
+    static bool LoadSDF(UInt64 Key, Array3F &SDF, Vector3F &AABBMin, Vector3F &AABBMax);
+    static void SaveSDF(UInt64 Key, const Array3F &SDF, const Vector3F &AABBMin, const Vector3F &AABBMax);
+
+    static bool LoadParticles(UInt64 Key, Array1Vec4F &Particles);
+    static void SaveParticles(UInt64 Key, const Array1Vec4F &Particles);
+
+private:
+    static bool &bEnabled()
+    {
+        static bool enabled = true;
+        return enabled;
+    }
+
+    static String EntryPath(UInt64 Key, const String &Ext);
+};
+
+#endif
@@ -29,6 +29,12 @@ namespace KIRI
                Array3F &phi, Array3UI &closest_tri, const Vector3F &origin, float dx,
                Int di, Int dj, Int dk);
 
+    // same result as sweep, the grid is split into bricks which are swept serially inside,
+    // bricks on the same diagonal plane don't depend on each other and run in parallel
+    void sweep_blocked(const Vec_Vec3F &tri, const Vec_Vec3F &x,
+                       Array3F &phi, Array3UI &closest_tri, const Vector3F &origin, float dx,
+                       Int di, Int dj, Int dk, Int brickSize = 8);
+
     // robust test of (x0,y0) in the triangle (x1,y1)-(x2,y2)-(x3,y3)
     // if true is returned, the barycentric coordinates are set in a,b,c.
     bool point_in_triangle_2d(float x0, float y0,
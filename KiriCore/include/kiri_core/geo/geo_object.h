@@ -30,6 +30,9 @@ public:
 
     Vector3F transform(const Vector3F &ppos) const;
 
+    // signedDistance returns distances multiplied by this
+    float uniformScale() const { return mUniformScale; }
+
 protected:
     bool mTransformed = false;
     float mUniformScale = 0.3f;
@@ -52,11 +55,16 @@ public:
     float &sdfStep() { return mStep; }
     void computeSDF();
 
+    // hash of the obj file and the SDF parameters, 0 if the file can't be read
+    UInt64 cacheKey() const { return mCacheKey; }
+
 protected:
     void computeSDFMesh(const Vec_Vec3F &faces, const Vec_Vec3F &vertices, const Vector3F &origin, float CellSize,
                         float ni, float nj, float nk, Array3F &SDF, Int exactBand = 1);
+    UInt64 computeCacheKey() const;
 
     bool mSDFGenerated = false;
+    UInt64 mCacheKey = 0;
     String mTriMeshFile = String("");
     float mStep = 1.f / 256.f;
     float mBoxScale;
@@ -16,8 +16,9 @@ class KiriGeoParticleGenerator
 {
 public:
     KiriGeoParticleGenerator() = default;
-    KiriGeoParticleGenerator(String Name, float ParticleRadius, float SamplingRatio, float JitterRatio, Vector3F Offset = Vector3F(0.f), float BoxScale = 1.f)
-        : mParticleRadius(ParticleRadius), mSamplingRatio(SamplingRatio), mJitterRatio(JitterRatio)
+    // Seed = 0 draws a random seed, any other value makes the jitter and the particle order reproducible
+    KiriGeoParticleGenerator(String Name, float ParticleRadius, float SamplingRatio, float JitterRatio, Vector3F Offset = Vector3F(0.f), float BoxScale = 1.f, UInt Seed = 0)
+        : mParticleRadius(ParticleRadius), mSamplingRatio(SamplingRatio), mJitterRatio(JitterRatio), mSeed(Seed)
     {
         obj = std::make_shared<KiriTriMeshObject>(Name, ParticleRadius, Offset, BoxScale);
         generateParticles();
@@ -31,6 +32,7 @@ private:
     float mParticleRadius;
     float mSamplingRatio;
     float mJitterRatio;
+    UInt mSeed;
 
     KiriTriMeshObjectPtr obj;
 };
@@ -0,0 +1,63 @@
+/***
+ * @Author: Xu.WANG
+ * @Date: 2021-02-23 11:08:36
+ * @LastEditTime: 2021-02-23 16:20:41
+ * @LastEditors: Xu.WANG
+ * @Description: counter based random numbers, the value only depends on (seed, key, counter)
+ * @FilePath: \Kiri\KiriCore\include\kiri_core\geo\geo_random.h
+ */
+
+#ifndef _KIRI_GEO_RANDOM_H_
+#define _KIRI_GEO_RANDOM_H_
+#pragma once
+#include <kiri_pch.h>
+#include <random>
+
+namespace KIRI
+{
+    class KiriCounterRandom
+    {
+    public:
+        explicit KiriCounterRandom(uint64_t seed) : mSeed(seed) {}
+
+        // uniform in [0, 1)
+        inline float uniform(uint64_t key, uint64_t counter) const
+        {
+            return static_cast<float>(hash(key, counter) >> 40) * (1.f / 16777216.f);
+        }
+
+        // uniform in [lo, hi)
+        inline float uniform(uint64_t key, uint64_t counter, float lo, float hi) const
+        {
+            return lo + (hi - lo) * uniform(key, counter);
+        }
+
+        // non reproducible seed for the default, non deterministic use
+        static uint64_t randomSeed()
+        {
+            std::random_device rd;
+            return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+        }
+
+    private:
+        uint64_t mSeed;
+
+        static inline uint64_t mix(uint64_t x)
+        {
+            // splitmix64 finalizer
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ull;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebull;
+            x ^= x >> 31;
+            return x;
+        }
+
+        inline uint64_t hash(uint64_t key, uint64_t counter) const
+        {
+            return mix(mix(mSeed ^ mix(key)) + counter * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+} // namespace KIRI
+#endif
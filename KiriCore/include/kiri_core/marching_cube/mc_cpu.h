@@ -1,7 +1,7 @@
 /*** 
  * @Author: Xu.WANG
  * @Date: 2020-12-30 20:31:00
- * @LastEditTime: 2021-02-20 19:46:23
+ * @LastEditTime: 2021-02-24 14:51:08
  * @LastEditors: Xu.WANG
  * @Description: 
  * @FilePath: \KiriCore\include\kiri_core\marching_cube\mc_cpu.h
@@ -10,12 +10,101 @@
 #ifndef _KIRI_MARCHING_CUBE_CPU_H_
 #define _KIRI_MARCHING_CUBE_CPU_H_
 #pragma once
-#include <kiri_pch.h>
+#include <kiri_core/geo/geo_grid.h>
+#include <kiri_core/metaball/metaball.h>
+
+// Surface reconstruction from particles.
+// The grid is split into blocks of BlockSize^3 cells, only blocks touched by particles are splatted and
+// only blocks whose field crosses the iso value are kept and polygonized, so memory follows the surface.
+// Every crossed grid edge belongs to exactly one block, which creates its vertex, the other blocks look it up.
+
+// neighbor grid with the layout of the CUDA grid searcher: the particles are sorted by cell and
+// cell (x, y, z) holds [cellStart[h], cellStart[h + 1]) with h = (x * gridSize[1] + y) * gridSize[2] + z
+struct KiriMCCellGrid
+{
+    Vector3F lowestPoint;
+    float cellSize;
+    Int gridSize[3];
+    Vec_UInt cellStart;
+};
 
 class KiriMarchingCubeCPU
 {
 public:
     KiriMarchingCubeCPU();
+    KiriMarchingCubeCPU(float KernelRadius, float CellSize, float IsoValue = 0.5f, UInt BlockSize = 8);
+
+    // Yu & Turk anisotropic kernels: every particle gets an ellipsoid from the covariance of its neighbors,
+    // the ellipsoid keeps the volume of the spherical kernel so the iso value means the same in both modes
+    void SetAnisotropic(bool Enable, float MaxStretch = 4.f, UInt MinNeighbors = 25, float Smoothing = 0.9f);
+
+    void Reconstruct(const Array1Vec3F &Positions);
+
+    // reuses the solver's cell structure for the anisotropy neighbors, SortedPositions must follow its order
+    void Reconstruct(const Array1Vec3F &SortedPositions, const KiriMCCellGrid &Grid);
+
+    // metaball preview surface at the equipotential value, needs a cutoff so every ball only touches a few blocks
+    void Reconstruct(const KiriMetaBall &MetaBall);
+
+    const Array1Vec3F &vertices() const noexcept { return mVertices; }
+    const Array1Vec3F &normals() const noexcept { return mNormals; }
+    const Array1<UInt> &indices() const noexcept { return mIndices; }
+
+    UInt numOfSurfaceBlocks() const noexcept { return mNumOfSurfaceBlocks; }
+
+private:
+    struct SurfaceBlock
+    {
+        Int origin[3];
+
+        // node values including a one node apron for the gradients
+        Vec_Float field;
+
+        // local vertex index of the x/y/z edge starting at every cell corner, -1 if not crossed
+        Vec_Int edgeVertex;
+
+        Vec_Vec3F vertices;
+        Vec_Vec3F normals;
+        Vec_UInt triangles;
+    };
+
+    float mKernelRadius;
+    float mCellSize;
+    float mIsoValue;
+    Int mBlockSize;
+
+    bool bAnisotropic = false;
+    float mMaxStretch = 4.f;
+    UInt mMinNeighbors = 25;
+    float mSmoothing = 0.9f;
+
+    // splatted kernels: center, bounding radius and the transform into the unit sphere (anisotropic only)
+    Array1Vec3F mCenters;
+    Vec_Float mExtents;
+    Vector<Matrix3x3F> mTransforms;
+
+    // set while a metaball field is splatted instead of the particle kernels
+    const KiriMetaBall *mMetaBall = nullptr;
+
+    KiriGeoGrid mGrid;
+    Int mNumOfCells[3];
+    Int mNumOfBlocks[3];
+    UInt mNumOfSurfaceBlocks = 0;
+
+    Array1Vec3F mVertices;
+    Array1Vec3F mNormals;
+    Array1<UInt> mIndices;
+
+    void Polygonize();
+    void ComputeAnisotropy(const Array1Vec3F &SortedPositions, const KiriMCCellGrid &Grid);
+    void BinParticles(Vec_UInt &BlockStart, Vec_UInt &BlockParticles);
+    bool SplatBlock(const UInt *Particles, UInt Num, SurfaceBlock &Block);
+    void PolygonizeVertices(SurfaceBlock &Block);
+    void PolygonizeTriangles(SurfaceBlock &Block, const Vector<SurfaceBlock> &Blocks, const Vec_Int &SurfaceIdx, const Vec_UInt &VertexOffset);
+
+    void NodeRange(const Vector3F &Position, float Radius, Int Lo[3], Int Hi[3]) const;
+    UInt BlockIndex(Int Bx, Int By, Int Bz) const { return (static_cast<UInt>(Bz) * mNumOfBlocks[1] + By) * mNumOfBlocks[0] + Bx; }
+    Int FieldIndex(Int X, Int Y, Int Z) const;
 };
 
 typedef SharedPtr<KiriMarchingCubeCPU> KiriMarchingCubeCPUPtr;
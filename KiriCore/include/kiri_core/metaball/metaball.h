@@ -1,7 +1,7 @@
 /*** 
  * @Author: Xu.WANG
  * @Date: 2020-12-30 19:35:37
- * @LastEditTime: 2021-02-20 19:46:32
+ * @LastEditTime: 2021-02-25 11:20:43
  * @LastEditors: Xu.WANG
  * @Description: 
  * @FilePath: \KiriCore\include\kiri_core\metaball\metaball.h
@@ -11,6 +11,8 @@
 #define _KIRI_META_BALL_H_
 #pragma once
 #include <kiri_pch.h>
+#include <atomic>
+#include <mutex>
 
 struct MetaBallData
 {
@@ -20,6 +22,20 @@ struct MetaBallData
     MetaBallData(const Vector3F &Center, const float Radius) : center(Center), radius(Radius) {}
 };
 
+// structure of arrays copy of some metaballs, evaluated with one branch free loop per query point
+struct MetaBallBatch
+{
+    Vec_Float cx, cy, cz;
+    Vec_Float r2;
+
+    // squared cutoff distance and the value at the cutoff which is subtracted to keep the field continuous
+    Vec_Float cutoff2;
+    Vec_Float shift;
+
+    size_t size() const { return cx.size(); }
+    void clear();
+};
+
 class KiriMetaBall
 {
 public:
@@ -27,13 +43,51 @@ public:
     KiriMetaBall(float EquipotentialValue) : mEquipotentialValue(EquipotentialValue){};
 
     void PushMetaBall(Vector3F Center, float Radius);
+
+    // drops the contributions beyond CutoffRatio * radius, so the balls can be binned into a grid,
+    // 0 keeps the exact field with infinite support
+    void SetCutoffRatio(float CutoffRatio);
+
     float Sampling(Vector3F Position);
 
+    // evaluates many points at once, the points are grouped by grid cell and every cell gathers its balls once
+    void Sampling(const Array1Vec3F &Positions, Array1<float> &Values);
+
+    size_t size() const { return mMetaBallArray.size(); }
+    const MetaBallData &metaBall(size_t Idx) const { return mMetaBallArray[Idx]; }
+    float equipotentialValue() const { return mEquipotentialValue; }
+    float cutoffRatio() const { return mCutoffRatio; }
+    float cutoffRadius(size_t Idx) const { return mCutoffRatio * mMetaBallArray[Idx].radius; }
+
+    // copies the given balls into Batch
+    void Gather(const UInt *Indices, size_t Num, MetaBallBatch &Batch) const;
+
+    // field value at Position without the equipotential value
+    static float Evaluate(const MetaBallBatch &Batch, const Vector3F &Position);
+
 private:
     float MetaBallStandardFunc(Vector3F Position, Vector3F Center, float Radius);
+    void BuildGrid();
+
+    // the first sampling after a change builds the grid, concurrent samplings wait for it.
+    // pushing balls while sampling is not supported
+    void EnsureGrid();
 
     float mEquipotentialValue;
+    float mCutoffRatio = 0.f;
     Array1<MetaBallData> mMetaBallArray;
+
+    // balls binned into cells of the largest cutoff radius
+    std::atomic<bool> mGridDirty{true};
+    std::mutex mGridMutex;
+    Vector3F mGridOrigin;
+    float mGridCellSize = 1.f;
+    Int mGridSize[3] = {0, 0, 0};
+    Vec_UInt mCellStart;
+    Vec_UInt mCellBalls;
+    MetaBallBatch mAllBalls;
+
+    Int CellCoord(float X, Int Axis) const;
 };
 
 typedef SharedPtr<KiriMetaBall> KiriMetaBallPtr;
@@ -53,11 +53,7 @@ public:
     inline Vector3F BBoxMin() const { return mBBoxMin; }
     inline Vector3F BBoxMax() const { return mBBoxMax; }
 
-    void GetEdges(Array1<std::pair<Int, Int>> &Edges) const;
     bool AkinciMeshSampling(const float &Radius, Array1Vec4F &Samples);
-    bool AkinciEdgeSampling(const Vector3F &Point1, const Vector3F &Point2, const float &Radius, Array1Vec3F &Samples);
-    bool AkinciTriangleSampling(const Vector3F &Point1, const Vector3F &Point2, const Vector3F &Point3, const float &Radius, Array1Vec3F &Samples);
-    bool LineLineIntersect(const Vector3F &p1, const Vector3F &p2, const Vector3F &p3, const Vector3F &p4, Vector3F &pa, Vector3F &pb, float &mua, float &mub);
 
 private:
     void ProcessNode(aiNode *, const aiScene *);
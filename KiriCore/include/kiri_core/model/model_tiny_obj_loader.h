@@ -19,6 +19,9 @@ public:
     KiriModelTinyObjLoader() { clearData(); }
     KiriModelTinyObjLoader(const String &name, const String &folder, const String &ext);
 
+    // path of the obj file the constructor loads
+    static String getFilePath(const String &name, const String &folder, const String &ext);
+
     bool Load(const String &filePath);
     void scaleToBox(float BoxScale);
 
@@ -11,6 +11,26 @@
 #include <kiri_pch.h>
 #include <kiri_core/pbd/pbf_system_data.h>
 
+enum PBFSolverType
+{
+    // all constraints from the same positions, the corrections are added afterwards
+    JacobiSolver = 0,
+    // constraints are projected one after another, cells of one color in parallel
+    ColoredGaussSeidelSolver = 1
+};
+
+// telemetry of the last constraint projection, errors are relative to the rest density.
+// when the iteration limit is reached the errors are the ones measured before the last correction,
+// a gauss seidel sweep measures every constraint right before it is projected
+struct KiriPBFSolverStats
+{
+    size_t iterations = 0;
+    float initialAvgDensityError = 0.0f;
+    float avgDensityError = 0.0f;
+    float maxDensityError = 0.0f;
+    bool converged = false;
+};
+
 class KiriPBFSystem
 {
 public:
@@ -19,8 +39,20 @@ public:
 
     // -----------------Getter Method-----------------
     KiriPBFSystemDataPtr pbfSystemData() const;
+    const KiriPBFSolverStats &solverStats() const;
     // -----------------Getter Method-----------------
 
+    // -----------------Setter Method-----------------
+    void SetSolverType(PBFSolverType type);
+    void SetIterations(size_t minIter, size_t maxIter);
+
+    // the projection stops once the average density error is below the tolerance
+    void SetDensityErrorTolerance(float tolerance);
+
+    // part of the last step's multipliers applied before the first iteration, 0 disables warm starting
+    void SetWarmStartScale(float scale);
+    // -----------------Setter Method-----------------
+
     // -----------------Init Environment -----------------
     void addBoxFluidAndBoxBoundary(Array1<BoundingBox3F> fluid, BoundingBox3F boundary, bool bcc = false);
     // -----------------Init Environment -----------------
@@ -29,14 +61,40 @@ public:
     void Update();
     // -----------------PBF Method -----------------
 
+    // -----------------Benchmark -----------------
+    struct BenchmarkResult
+    {
+        PBFSolverType type;
+        size_t steps;
+        size_t iterations;
+        float avgDensityError;
+        float milliseconds;
+    };
+
+    // runs the same tank once per solver type with the given iteration settings and compares
+    // the iterations needed and the remaining density error
+    static Vector<BenchmarkResult> BenchmarkSolvers(
+        const Array1<BoundingBox3F> &fluids,
+        const BoundingBox3F &boundary,
+        size_t steps,
+        size_t maxIter,
+        float tolerance);
+    // -----------------Benchmark -----------------
+
 private:
     // -----------------Coefficient-----------------
     float _coefViscosity = 0.02f;
     Vector3F _gravity = Vector3F(0.0f, (float)kiri_math::kGravity, 0.0f);
     float _timeStep = 0.005f;
+    size_t _minIter = 1;
     size_t _maxIter = 5;
+    float _densityErrorTolerance = 0.005f;
+    float _warmStartScale = 0.5f;
+    PBFSolverType _solverType = JacobiSolver;
     // -----------------Coefficient-----------------
 
+    KiriPBFSolverStats _solverStats;
+
     PointGenerator3Ptr _pointsGen;
     KiriPBFSystemDataPtr _pbfSystemData;
 
@@ -53,42 +111,6 @@ private:
     void computeXSPHViscosity();
 
     void computeVorticityConfinement();
-
-    // calculate particle's fluid density using SPH method.
-    bool computeFluidDensity(
-        const size_t &particleIndex,
-        const size_t &numFluidParticle,
-        const ConstArrayAccessor1<Vector3F> &position,
-        const ConstArrayAccessor1<float> &mass,
-        const std::vector<size_t> &neighors,
-        const float &SphKernelRadius,
-        const float &fluidDensity,
-        float &density_err,
-        float &density);
-
-    // calculate particle's lagrange multiplier.
-    bool computeLagrangeMultiplier(
-        const size_t &particleIndex,
-        const size_t &numFluidParticle,
-        const ConstArrayAccessor1<Vector3F> &position,
-        const ConstArrayAccessor1<float> &mass,
-        const std::vector<size_t> &neighors,
-        const float &density,
-        const float &SphKernelRadius,
-        const float &fluidDensity,
-        float &lambda);
-
-    // perform a density constraint.
-    bool solveDensityConstraint(
-        const size_t &particleIndex,
-        const size_t &numFluidParticle,
-        const ConstArrayAccessor1<Vector3F> &position,
-        const ConstArrayAccessor1<float> &mass,
-        const std::vector<size_t> &neighors,
-        const ConstArrayAccessor1<float> &lamba,
-        const float &SphKernelRadius,
-        const float &fluidDensity,
-        Vector3F &deltaPos);
 };
 
 typedef SharedPtr<KiriPBFSystem> KiriPBFSystemPtr;
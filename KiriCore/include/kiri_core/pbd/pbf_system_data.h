@@ -9,6 +9,55 @@
 #define _KIRI_PBF_SYSTEM_DATA_H_
 
 #include <kiri_pch.h>
+#include <new>
+
+// cache line aligned storage, the SoA arrays of the constraint solver are streamed by tight loops
+template <class T, size_t Alignment = 64>
+struct KiriAlignedAllocator
+{
+    typedef T value_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef KiriAlignedAllocator<U, Alignment> other;
+    };
+
+    KiriAlignedAllocator() noexcept {}
+    template <class U>
+    KiriAlignedAllocator(const KiriAlignedAllocator<U, Alignment> &) noexcept {}
+
+    T *allocate(size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T *ptr, size_t) noexcept { ::operator delete(ptr, std::align_val_t(Alignment)); }
+
+    template <class U>
+    bool operator==(const KiriAlignedAllocator<U, Alignment> &) const noexcept { return true; }
+    template <class U>
+    bool operator!=(const KiriAlignedAllocator<U, Alignment> &) const noexcept { return false; }
+};
+
+typedef std::vector<float, KiriAlignedAllocator<float>> AlignedFloatArray;
+
+// working set of the constraint projection, positions of all particles and one gradient per CSR entry
+struct KiriPBFSolverData
+{
+    AlignedFloatArray posX, posY, posZ;
+
+    // mass_j / rho_0 * gradW(p_i - p_j), evaluated once per pair and iteration
+    AlignedFloatArray gradX, gradY, gradZ;
+
+    // relative density error of the fluid particles
+    AlignedFloatArray densityError;
+
+    // multipliers applied during the last step, they warm start the next one
+    AlignedFloatArray warmLambdas;
+
+    // non empty cells grouped by color (x % 3, y % 3, z % 3) for the gauss seidel solver
+    Vec_UInt colorStart;
+    Vec_UInt colorCells;
+
+    void resize(size_t numOfParticles, size_t numOfPairs);
+};
 
 class KiriPBFSystemData
 {
@@ -68,6 +117,9 @@ public:
     ConstArrayAccessor1<Vector3F> deltaPositions() const;
     ArrayAccessor1<Vector3F> deltaPositions();
 
+    ConstArrayAccessor1<Vector3F> vorticities() const;
+    ArrayAccessor1<Vector3F> vorticities();
+
     float particleRadius() const;
     float SphKernelRadius() const;
     // -----------------Getter Method-----------------
@@ -81,16 +133,37 @@ public:
     // -----------------Setter Method-----------------
 
     // -----------------Neighbor Searcher Method-----------------
-    const PointNeighborSearcher3Ptr &neighborSearcher() const;
-
-    void SetNeighborSearcher(
-        const PointNeighborSearcher3Ptr &newNeighborSearcher);
-
-    const std::vector<std::vector<size_t>> &neighborLists() const;
-    void buildNeighborSearcher(double maxSearchRadius, ConstArrayAccessor1<Vector3F> list);
-    void buildNeighborLists(double maxSearchRadius, ConstArrayAccessor1<Vector3F> list);
+    // neighbors of a particle are one contiguous range of the CSR index array
+    struct NeighborRange
+    {
+        const UInt *first;
+        const UInt *last;
+
+        const UInt *begin() const { return first; }
+        const UInt *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+    };
+
+    // cell ranges of the last searcher build, x is the fastest axis
+    const Vec_UInt &cellStart() const;
+    const Vec_UInt &cellParticles() const;
+    const Int *gridSize() const;
+
+    NeighborRange neighbors(size_t idx) const;
+    const Vec_UInt &neighborStart() const;
+    const Vec_UInt &neighborIndices() const;
+
+    // cell sorted uniform grid with cell size maxSearchRadius over the bounding box of list
+    void buildNeighborSearcher(float maxSearchRadius, ConstArrayAccessor1<Vector3F> list);
+
+    // counts in parallel, then fills the CSR arrays in parallel, the arrays keep their capacity between builds
+    void buildNeighborLists(float maxSearchRadius, ConstArrayAccessor1<Vector3F> list);
     // -----------------Neighbor Searcher Method-----------------
 
+    // -----------------Solver Data-----------------
+    KiriPBFSolverData &solverData();
+    // -----------------Solver Data-----------------
+
     // -----------------Data init-----------------
     float calcFluidMass() const;
     float calcBoundaryMass() const;
@@ -107,6 +180,7 @@ private:
     size_t _lambdaIdx;
     size_t _densityIdx;
     size_t _deltaPositionIdx;
+    size_t _vorticityIdx;
 
     size_t _massIdx;
     size_t _invMassIdx;
@@ -133,12 +207,22 @@ private:
     // -----------------Setter Method-----------------
 
     // -----------------Neighbor Searcher Method-----------------
-    size_t kDefaultHashGridResolution = 8;
-    PointNeighborSearcher3Ptr _neighborSearcher;
-    std::vector<std::vector<size_t>> _neighborLists;
+    Vector3F mGridOrigin;
+    float mGridCellSize = 0.0f;
+    Int mGridSize[3] = {0, 0, 0};
+
+    // particles sorted by cell, mCellStart has one entry more than cells
+    Vec_UInt mCellStart;
+    Vec_UInt mCellParticles;
+    Vec_UInt mParticleCell;
 
-    const Array1<Vector3D> cvtArrayF2D(ConstArrayAccessor1<Vector3F> list);
+    Vec_UInt mNeighborStart;
+    Vec_UInt mNeighbors;
+
+    Int cellCoord(float x, Int axis) const;
     // -----------------Neighbor Searcher Method-----------------
+
+    KiriPBFSolverData mSolverData;
 };
 
 typedef SharedPtr<KiriPBFSystemData> KiriPBFSystemDataPtr;
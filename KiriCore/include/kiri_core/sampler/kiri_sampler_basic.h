@@ -43,6 +43,10 @@ public:
     bool AkinciEdgeSampling(const Vector3F &Point1, const Vector3F &Point2, const float &Radius, Array1Vec3F &Samples);
     bool AkinciMeshSampling(const KiriMeshTriangle *Mesh, const float &Radius, Array1Vec4F &Samples);
 
+    // vertices are welded by position, every unique edge and triangle is sampled once in parallel and
+    // the samples are appended to Samples
+    bool AkinciMeshSampling(const Array1Vec3F &Vertices, const Array1Vec3F &Triangles, const float &Radius, Array1Vec4F &Samples);
+
 private:
     Array1Vec3F mPoints;
 };
@@ -0,0 +1,195 @@
+/*** 
+ * @Author: Xu.WANG
+ * @Date: 2021-02-25 15:08:47
+ * @LastEditTime: 2021-02-25 17:40:26
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriCore\src\kiri_core\geo\geo_cache.cpp
+ */
+
+#include <kiri_core/geo/geo_cache.h>
+#include <kiri_define.h>
+#include <root_directory.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const char kMagic[4] = {'K', 'G', 'C', '1'};
+
+    // bump when the SDF or the sampling changes its results, old entries are ignored then
+    const UInt kVersion = 1;
+
+    struct CacheHeader
+    {
+        char magic[4];
+        UInt version;
+        UInt64 key;
+        UInt dims[4];
+        float aabb[6];
+        UInt reserved[2];
+    };
+    static_assert(sizeof(CacheHeader) == 64, "cache header must stay 64 bytes");
+
+    bool ReadEntry(const String &Path, UInt64 Key, CacheHeader &Header, std::ifstream &File)
+    {
+        File.open(Path, std::ios::binary);
+        if (!File)
+            return false;
+
+        File.read(reinterpret_cast<char *>(&Header), sizeof(CacheHeader));
+        return File && std::equal(kMagic, kMagic + 4, Header.magic) && Header.version == kVersion && Header.key == Key;
+    }
+
+    void WriteEntry(const String &Path, const CacheHeader &Header, const float *Data, size_t Num)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(Path).parent_path(), ec);
+
+        // write aside and rename, a crash or a concurrent reader never sees half an entry
+        const String tmpPath = Path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                KIRI_LOG_WARN("Geo Cache: Can't Write {0}", tmpPath);
+                return;
+            }
+            file.write(reinterpret_cast<const char *>(&Header), sizeof(CacheHeader));
+            file.write(reinterpret_cast<const char *>(Data), Num * sizeof(float));
+            if (!file)
+            {
+                KIRI_LOG_WARN("Geo Cache: Can't Write {0}", tmpPath);
+                return;
+            }
+        }
+
+        std::filesystem::rename(tmpPath, Path, ec);
+        if (ec)
+        {
+            KIRI_LOG_WARN("Geo Cache: Can't Rename {0}, {1}", tmpPath, ec.message());
+            std::filesystem::remove(tmpPath, ec);
+        }
+    }
+
+    CacheHeader MakeHeader(UInt64 Key)
+    {
+        CacheHeader header{};
+        std::copy(kMagic, kMagic + 4, header.magic);
+        header.version = kVersion;
+        header.key = Key;
+        return header;
+    }
+} // namespace
+
+KiriGeoHash &KiriGeoHash::Add(const void *Data, size_t Bytes)
+{
+    const UChar *bytes = static_cast<const UChar *>(Data);
+    for (size_t i = 0; i < Bytes; ++i)
+    {
+        mHash ^= bytes[i];
+        mHash *= 1099511628211ull;
+    }
+    return *this;
+}
+
+bool KiriGeoHash::AddFile(const String &FilePath)
+{
+    std::ifstream file(FilePath, std::ios::binary);
+    if (!file)
+        return false;
+
+    Vec_Char buffer(1 << 20);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        Add(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return true;
+}
+
+String KiriGeoCache::CacheFolder()
+{
+    if (RELEASE && PUBLISH)
+        return "./cache/";
+
+    return String(EXPORT_PATH) + "cache/";
+}
+
+String KiriGeoCache::EntryPath(UInt64 Key, const String &Ext)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(Key));
+    return CacheFolder() + name + Ext;
+}
+
+bool KiriGeoCache::LoadSDF(UInt64 Key, Array3F &SDF, Vector3F &AABBMin, Vector3F &AABBMax)
+{
+    if (!IsEnabled())
+        return false;
+
+    CacheHeader header;
+    std::ifstream file;
+    if (!ReadEntry(EntryPath(Key, ".sdf"), Key, header, file))
+        return false;
+
+    SDF.resize(header.dims[0], header.dims[1], header.dims[2], 0.f);
+    file.read(reinterpret_cast<char *>(SDF.data()), static_cast<size_t>(header.dims[0]) * header.dims[1] * header.dims[2] * sizeof(float));
+    if (!file)
+        return false;
+
+    AABBMin = Vector3F(header.aabb[0], header.aabb[1], header.aabb[2]);
+    AABBMax = Vector3F(header.aabb[3], header.aabb[4], header.aabb[5]);
+
+    KIRI_LOG_INFO("Geo Cache: Load SDF {0:d}x{1:d}x{2:d} From {3}", header.dims[0], header.dims[1], header.dims[2], EntryPath(Key, ".sdf"));
+    return true;
+}
+
+void KiriGeoCache::SaveSDF(UInt64 Key, const Array3F &SDF, const Vector3F &AABBMin, const Vector3F &AABBMax)
+{
+    if (!IsEnabled())
+        return;
+
+    CacheHeader header = MakeHeader(Key);
+    for (Int d = 0; d < 3; ++d)
+    {
+        header.dims[d] = static_cast<UInt>(SDF.size()[d]);
+        header.aabb[d] = AABBMin[d];
+        header.aabb[d + 3] = AABBMax[d];
+    }
+
+    WriteEntry(EntryPath(Key, ".sdf"), header, SDF.data(), static_cast<size_t>(header.dims[0]) * header.dims[1] * header.dims[2]);
+}
+
+bool KiriGeoCache::LoadParticles(UInt64 Key, Array1Vec4F &Particles)
+{
+    if (!IsEnabled())
+        return false;
+
+    CacheHeader header;
+    std::ifstream file;
+    if (!ReadEntry(EntryPath(Key, ".particles"), Key, header, file))
+        return false;
+
+    Array1Vec4F particles(header.dims[0]);
+    file.read(reinterpret_cast<char *>(particles.data()), static_cast<size_t>(header.dims[0]) * sizeof(Vector4F));
+    if (!file)
+        return false;
+
+    Particles = std::move(particles);
+
+    KIRI_LOG_INFO("Geo Cache: Load {0:d} Particles From {1}", header.dims[0], EntryPath(Key, ".particles"));
+    return true;
+}
+
+void KiriGeoCache::SaveParticles(UInt64 Key, const Array1Vec4F &Particles)
+{
+    if (!IsEnabled())
+        return;
+
+    CacheHeader header = MakeHeader(Key);
+    header.dims[0] = static_cast<UInt>(Particles.size());
+
+    WriteEntry(EntryPath(Key, ".particles"), header, reinterpret_cast<const float *>(Particles.data()), Particles.size() * 4);
+}
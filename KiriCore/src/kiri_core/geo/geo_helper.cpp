@@ -76,7 +76,8 @@ namespace KIRI
                          Int i0, Int j0, Int k0,
                          Int i1, Int j1, Int k1)
     {
-        if (closest_tri(i1, j1, k1) != 0xffffffff)
+        // the distance to the triangle already stored for this node can't be smaller
+        if (closest_tri(i1, j1, k1) != 0xffffffff && closest_tri(i1, j1, k1) != closest_tri(i0, j0, k0))
         {
             UInt p = tri[closest_tri(i1, j1, k1)][0];
             UInt q = tri[closest_tri(i1, j1, k1)][1];
@@ -156,6 +157,70 @@ namespace KIRI
         }
     }
 
+    void sweep_blocked(const Vec_Vec3F &tri, const Vec_Vec3F &x,
+                       Array3F &phi, Array3UI &closest_tri, const Vector3F &origin, float dx,
+                       Int di, Int dj, Int dk, Int brickSize)
+    {
+        const Int n[3] = {static_cast<Int>(phi.size()[0]), static_cast<Int>(phi.size()[1]), static_cast<Int>(phi.size()[2])};
+        const Int dir[3] = {di, dj, dk};
+
+        Int nb[3];
+        for (Int d = 0; d < 3; ++d)
+            nb[d] = (n[d] + brickSize - 1) / brickSize;
+
+        // a node only reads its upwind neighbors, which sit in the same brick or in a brick of an earlier plane
+        for (Int plane = 0, planeEnd = nb[0] + nb[1] + nb[2] - 2; plane < planeEnd; ++plane)
+        {
+            Vec_Int bricks;
+            for (Int bk = 0; bk < nb[2]; ++bk)
+                for (Int bj = 0; bj < nb[1]; ++bj)
+                {
+                    const Int bi = plane - bk - bj;
+                    if (bi >= 0 && bi < nb[0])
+                    {
+                        bricks.emplace_back(bi);
+                        bricks.emplace_back(bj);
+                        bricks.emplace_back(bk);
+                    }
+                }
+
+            kiri_math::parallelFor(kiri_math::kZeroSize, bricks.size() / 3, [&](size_t b) {
+                // brick coordinates count along the sweep direction
+                Int lo[3], hi[3];
+                for (Int d = 0; d < 3; ++d)
+                {
+                    const Int bd = dir[d] > 0 ? bricks[3 * b + d] : nb[d] - 1 - bricks[3 * b + d];
+                    const Int first = bd * brickSize, last = std::min(first + brickSize, n[d]) - 1;
+                    lo[d] = dir[d] > 0 ? first : last;
+                    hi[d] = dir[d] > 0 ? last + 1 : first - 1;
+
+                    // the first layer in the sweep direction has no upwind neighbor
+                    if (lo[d] == (dir[d] > 0 ? 0 : n[d] - 1))
+                        lo[d] += dir[d];
+                }
+
+                for (Int k = lo[2]; (k - hi[2]) * dk < 0; k += dk)
+                {
+                    for (Int j = lo[1]; (j - hi[1]) * dj < 0; j += dj)
+                    {
+                        for (Int i = lo[0]; (i - hi[0]) * di < 0; i += di)
+                        {
+                            Vector3F gx = Vector3F(i, j, k) * dx + origin;
+
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i - di, j, k);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i, j - dj, k);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i - di, j - dj, k);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i, j, k - dk);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i - di, j, k - dk);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i, j - dj, k - dk);
+                            check_neighbour(tri, x, phi, closest_tri, gx, i, j, k, i - di, j - dj, k - dk);
+                        }
+                    }
+                }
+            });
+        }
+    }
+
     // calculate twice signed area of triangle (0,0)-(x1,y1)-(x2,y2)
     // return an SOS-determined sign (-1, +1, or 0 only if it's a truly degenerate triangle)
     Int orientation(float x1, float y1, float x2, float y2, float &twice_signed_area)
@@ -9,7 +9,9 @@
 
 #include <kiri_core/geo/geo_object.h>
 #include <kiri_core/geo/geo_helper.h>
+#include <kiri_core/geo/geo_cache.h>
 #include <kiri_core/model/model_tiny_obj_loader.h>
+#include <atomic>
 
 Vector3F KiriGeoObject::transform(const Vector3F &ppos) const
 {
@@ -34,8 +36,30 @@ KiriTriMeshObject::KiriTriMeshObject(const String &meshFilePath, float sdfStep,
     computeSDF();
 }
 
+UInt64 KiriTriMeshObject::computeCacheKey() const
+{
+    // the mesh bytes and every parameter which changes the SDF
+    KiriGeoHash hash;
+    if (!hash.AddFile(KiriModelTinyObjLoader::getFilePath(mTriMeshFile, "models", ".obj")))
+        return 0;
+
+    hash.Add(mStep).Add(mBoxScale).Add(mOffset.x).Add(mOffset.y).Add(mOffset.z);
+    return hash.value();
+}
+
 void KiriTriMeshObject::computeSDF()
 {
+    // repeated loads of the same mesh only read the cached grid
+    mCacheKey = computeCacheKey();
+    if (mCacheKey != 0 && KiriGeoCache::LoadSDF(mCacheKey, mSDFData, mAABBMin, mAABBMax))
+    {
+        mGrid3D.SetGrid(mAABBMin - Vector3F(3.f * mStep),
+                        mAABBMax + Vector3F(3.f * mStep),
+                        mStep);
+        mSDFGenerated = true;
+        return;
+    }
+
     KiriModelTinyObjLoaderPtr meshLoader = std::make_shared<KiriModelTinyObjLoader>(mTriMeshFile, "models", ".obj");
     meshLoader->scaleToBox(mBoxScale);
 
@@ -60,6 +84,9 @@ void KiriTriMeshObject::computeSDF()
     computeSDFMesh(faceList, vertexList,
                    meshLoader->getAABBMin(), mStep, mGrid3D.getNCells()[0], mGrid3D.getNCells()[1], mGrid3D.getNCells()[2], mSDFData);
     mSDFGenerated = true;
+
+    if (mCacheKey != 0)
+        KiriGeoCache::SaveSDF(mCacheKey, mSDFData, mAABBMin, mAABBMax);
 }
 
 // sign distance field for triangle mesh
@@ -77,47 +104,145 @@ void KiriTriMeshObject::computeSDFMesh(const Vec_Vec3F &faces, const Vec_Vec3F &
     // we begin by initializing distances near the mesh, and figuring out intersection counts
     Array3UI intersectionCount(ni, nj, nk, 0u);
 
-    for (UInt face = 0, faceEnd = static_cast<UInt>(faces.size()); face < faceEnd; ++face)
-    {
-        UInt p = faces[face][0];
-        UInt q = faces[face][1];
-        UInt r = faces[face][2];
+    const Int n[3] = {static_cast<Int>(ni), static_cast<Int>(nj), static_cast<Int>(nk)};
+    const Int brickSize = 8;
+    Int nb[3];
+    for (Int d = 0; d < 3; ++d)
+        nb[d] = (n[d] + brickSize - 1) / brickSize;
+    const UInt numOfBricks = static_cast<UInt>(nb[0] * nb[1] * nb[2]);
 
+    const UInt numOfFaces = static_cast<UInt>(faces.size());
+    Vec_Vec3F gridVertices(vertices.size());
+    kiri_math::parallelFor(kiri_math::kZeroSize, vertices.size(), [&](size_t v) {
         // coordinates in grid to high precision
-        Vector3F fp = (vertices[p] - origin) / CellSize;
-        Vector3F fq = (vertices[q] - origin) / CellSize;
-        Vector3F fr = (vertices[r] - origin) / CellSize;
-
-        // do distances nearby
-        Int i0 = kiri_math::clamp(static_cast<Int>(kiri_math::min3(fp[0], fq[0], fr[0])) - exactBand, 0, static_cast<Int>(ni - 1));
-        Int i1 = kiri_math::clamp(static_cast<Int>(kiri_math::max3(fp[0], fq[0], fr[0])) + exactBand + 1, 0, static_cast<Int>(ni - 1));
-        Int j0 = kiri_math::clamp(static_cast<Int>(kiri_math::min3(fp[1], fq[1], fr[1])) - exactBand, 0, static_cast<Int>(nj - 1));
-        Int j1 = kiri_math::clamp(static_cast<Int>(kiri_math::max3(fp[1], fq[1], fr[1])) + exactBand + 1, 0, static_cast<Int>(nj - 1));
-        Int k0 = kiri_math::clamp(static_cast<Int>(kiri_math::min3(fp[2], fq[2], fr[2])) - exactBand, 0, static_cast<Int>(nk - 1));
-        Int k1 = kiri_math::clamp(static_cast<Int>(kiri_math::max3(fp[2], fq[2], fr[2])) + exactBand + 1, 0, static_cast<Int>(nk - 1));
-
-        kiri_math::parallelFor(i0, i1 + 1, j0, j1 + 1, k0, k1 + 1, [&](Int i, Int j, Int k) {
-            Vector3F gx = Vector3F(i, j, k) * CellSize + origin;
-            float d = KIRI::point_triangle_distance(gx, vertices[p], vertices[q], vertices[r]);
-
-            if (d < SDF(i, j, k))
-            {
-                SDF(i, j, k) = d;
-                closest_tri(i, j, k) = face;
-            }
+        gridVertices[v] = (vertices[v] - origin) / CellSize;
+    });
+
+    // node box of the exact band around a face
+    auto bandRange = [&](UInt face, Int lo[3], Int hi[3]) {
+        const Vector3F &fp = gridVertices[static_cast<UInt>(faces[face][0])];
+        const Vector3F &fq = gridVertices[static_cast<UInt>(faces[face][1])];
+        const Vector3F &fr = gridVertices[static_cast<UInt>(faces[face][2])];
+        for (Int d = 0; d < 3; ++d)
+        {
+            lo[d] = kiri_math::clamp(static_cast<Int>(kiri_math::min3(fp[d], fq[d], fr[d])) - exactBand, 0, n[d] - 1);
+            hi[d] = kiri_math::clamp(static_cast<Int>(kiri_math::max3(fp[d], fq[d], fr[d])) + exactBand + 1, 0, n[d] - 1);
+        }
+    };
+
+    // rows (j,k) whose ray may hit a face
+    Int expand_val = 1;
+    auto rayRange = [&](UInt face, Int lo[3], Int hi[3]) {
+        const Vector3F &fp = gridVertices[static_cast<UInt>(faces[face][0])];
+        const Vector3F &fq = gridVertices[static_cast<UInt>(faces[face][1])];
+        const Vector3F &fr = gridVertices[static_cast<UInt>(faces[face][2])];
+        for (Int d = 1; d < 3; ++d)
+        {
+            lo[d] = kiri_math::clamp(static_cast<Int>(std::ceil(kiri_math::min3(fp[d], fq[d], fr[d]))) - expand_val, 0, n[d] - 1);
+            hi[d] = kiri_math::clamp(static_cast<Int>(std::floor(kiri_math::max3(fp[d], fq[d], fr[d]))) + expand_val, 0, n[d] - 1);
+        }
+    };
+
+    // counting sort of the faces into bins, every face goes to the bins of its range;
+    // each bin keeps ascending face order so ties resolve like the serial loop
+    auto binFaces = [&](UInt numOfBins, auto binRange, Vec_UInt &binStart, Vec_UInt &binFaces) {
+        UniquePtr<std::atomic<UInt>[]> counter(new std::atomic<UInt>[numOfBins]);
+        for (UInt b = 0; b < numOfBins; ++b)
+            counter[b] = 0;
+
+        kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(numOfFaces), [&](size_t face) {
+            binRange(static_cast<UInt>(face), [&](UInt b) { counter[b].fetch_add(1, std::memory_order_relaxed); });
         });
 
-        Int expand_val = 1;
-        // and do intersection counts
-        j0 = kiri_math::clamp(static_cast<Int>(std::ceil(kiri_math::min3(fp[1], fq[1], fr[1]))) - expand_val, 0, static_cast<Int>(nj - 1));
-        j1 = kiri_math::clamp(static_cast<Int>(std::floor(kiri_math::max3(fp[1], fq[1], fr[1]))) + expand_val, 0, static_cast<Int>(nj - 1));
-        k0 = kiri_math::clamp(static_cast<Int>(std::ceil(kiri_math::min3(fp[2], fq[2], fr[2]))) - expand_val, 0, static_cast<Int>(nk - 1));
-        k1 = kiri_math::clamp(static_cast<Int>(std::floor(kiri_math::max3(fp[2], fq[2], fr[2]))) + expand_val, 0, static_cast<Int>(nk - 1));
+        binStart.assign(numOfBins + 1, 0);
+        for (UInt b = 0; b < numOfBins; ++b)
+        {
+            binStart[b + 1] = binStart[b] + counter[b].load(std::memory_order_relaxed);
+            counter[b] = 0;
+        }
+
+        binFaces.resize(binStart.back());
+        kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(numOfFaces), [&](size_t face) {
+            binRange(static_cast<UInt>(face), [&](UInt b) {
+                binFaces[binStart[b] + counter[b].fetch_add(1, std::memory_order_relaxed)] = static_cast<UInt>(face);
+            });
+        });
 
-        for (Int k = k0; k <= k1; ++k)
+        kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(numOfBins), [&](size_t b) {
+            std::sort(binFaces.begin() + binStart[b], binFaces.begin() + binStart[b + 1]);
+        });
+    };
+
+    // exact distances near the mesh, every brick owns its nodes so there are no write races
+    Vec_UInt brickStart, brickFaces;
+    binFaces(numOfBricks, [&](UInt face, auto emit) {
+        Int lo[3], hi[3];
+        bandRange(face, lo, hi);
+        for (Int bk = lo[2] / brickSize; bk <= hi[2] / brickSize; ++bk)
+            for (Int bj = lo[1] / brickSize; bj <= hi[1] / brickSize; ++bj)
+                for (Int bi = lo[0] / brickSize; bi <= hi[0] / brickSize; ++bi)
+                    emit(static_cast<UInt>((bk * nb[1] + bj) * nb[0] + bi));
+    },
+             brickStart, brickFaces);
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(numOfBricks), [&](size_t b) {
+        const Int brickOrigin[3] = {static_cast<Int>(b % nb[0]) * brickSize,
+                                     static_cast<Int>((b / nb[0]) % nb[1]) * brickSize,
+                                     static_cast<Int>(b / (nb[0] * nb[1])) * brickSize};
+
+        for (UInt f = brickStart[b]; f < brickStart[b + 1]; ++f)
         {
+            const UInt face = brickFaces[f];
+            UInt p = faces[face][0];
+            UInt q = faces[face][1];
+            UInt r = faces[face][2];
+
+            Int lo[3], hi[3];
+            bandRange(face, lo, hi);
+            for (Int d = 0; d < 3; ++d)
+            {
+                lo[d] = std::max(lo[d], brickOrigin[d]);
+                hi[d] = std::min(hi[d], brickOrigin[d] + brickSize - 1);
+            }
+
+            for (Int k = lo[2]; k <= hi[2]; ++k)
+                for (Int j = lo[1]; j <= hi[1]; ++j)
+                    for (Int i = lo[0]; i <= hi[0]; ++i)
+                    {
+                        Vector3F gx = Vector3F(i, j, k) * CellSize + origin;
+                        float d = KIRI::point_triangle_distance(gx, vertices[p], vertices[q], vertices[r]);
+
+                        if (d < SDF(i, j, k))
+                        {
+                            SDF(i, j, k) = d;
+                            closest_tri(i, j, k) = face;
+                        }
+                    }
+        }
+    });
 
-            for (Int j = j0; j <= j1; ++j)
+    // intersection counts, a k slice only touches its own rows
+    Vec_UInt sliceStart, sliceFaces;
+    binFaces(static_cast<UInt>(n[2]), [&](UInt face, auto emit) {
+        Int lo[3], hi[3];
+        rayRange(face, lo, hi);
+        for (Int k = lo[2]; k <= hi[2]; ++k)
+            emit(static_cast<UInt>(k));
+    },
+             sliceStart, sliceFaces);
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(n[2]), [&](size_t slice) {
+        const Int k = static_cast<Int>(slice);
+        for (UInt f = sliceStart[slice]; f < sliceStart[slice + 1]; ++f)
+        {
+            const UInt face = sliceFaces[f];
+            const Vector3F &fp = gridVertices[static_cast<UInt>(faces[face][0])];
+            const Vector3F &fq = gridVertices[static_cast<UInt>(faces[face][1])];
+            const Vector3F &fr = gridVertices[static_cast<UInt>(faces[face][2])];
+
+            Int lo[3], hi[3];
+            rayRange(face, lo, hi);
+            for (Int j = lo[1]; j <= hi[1]; ++j)
             {
                 float a, b, c;
 
@@ -131,26 +256,26 @@ void KiriTriMeshObject::computeSDFMesh(const Vec_Vec3F &faces, const Vec_Vec3F &
 
                     // we enlarge the first interval to include everything to the -x direction
                     // we ignore intersections that are beyond the +x side of the grid
-                    if (i_interval < static_cast<Int>(ni))
+                    if (i_interval < n[0])
                     {
                         ++intersectionCount(i_interval, j, k);
                     }
                 }
             }
         }
-    } // end loop face
+    });
 
     // and now we fill in the rest of the distances with fast sweeping
     for (UInt pass = 0; pass < 2; ++pass)
     {
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, +1, +1, +1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, -1, -1, -1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, +1, +1, -1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, -1, -1, +1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, +1, -1, +1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, -1, +1, -1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, +1, -1, -1);
-        KIRI::sweep(faces, vertices, SDF, closest_tri, origin, CellSize, -1, +1, +1);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, +1, +1, +1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, -1, -1, -1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, +1, +1, -1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, -1, -1, +1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, +1, -1, +1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, -1, +1, -1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, +1, -1, -1, brickSize);
+        KIRI::sweep_blocked(faces, vertices, SDF, closest_tri, origin, CellSize, -1, +1, +1, brickSize);
     }
 
     kiri_math::parallelFor<UInt>(0, static_cast<UInt>(nk), [&](UInt k) {
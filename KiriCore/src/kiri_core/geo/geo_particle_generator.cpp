@@ -7,10 +7,19 @@
  * @FilePath: \Kiri\KiriCore\src\kiri_core\geo\geo_particle_generator.cpp
  */
 #include <kiri_core/geo/geo_particle_generator.h>
-#include <random>
-#include <omp.h>
+#include <kiri_core/geo/geo_random.h>
+#include <kiri_core/geo/geo_cache.h>
 void KiriGeoParticleGenerator::generateParticles()
 {
+    // only seeded runs are cached, a random seed is expected to give new jitter every time
+    UInt64 cacheKey = 0;
+    if (mSeed != 0 && obj->cacheKey() != 0)
+    {
+        cacheKey = KiriGeoHash().Add(obj->cacheKey()).Add(mParticleRadius).Add(mSamplingRatio).Add(mJitterRatio).Add(mSeed).value();
+        if (KiriGeoCache::LoadParticles(cacheKey, particles))
+            return;
+    }
+
     float spacing = mParticleRadius * 2.f * mSamplingRatio;
     float jitter = mJitterRatio * mParticleRadius;
 
@@ -29,34 +38,86 @@ void KiriGeoParticleGenerator::generateParticles()
 
     //KIRI_LOG_INFO("Grid Size=({0:f},{1:f},{2:f})", grid.x, grid.y, grid.z);
 
-    std::random_device seed_gen;
-    std::default_random_engine engine(seed_gen());
-    std::uniform_real_distribution<> dist(-1.f, 1.f);
+    // the jitter of a grid point only depends on (seed, cell index), not on the thread running it
+    KIRI::KiriCounterRandom rng(mSeed != 0 ? static_cast<uint64_t>(mSeed) : KIRI::KiriCounterRandom::randomSeed());
+
+    const UInt nx = static_cast<UInt>(grid[0]), ny = static_cast<UInt>(grid[1]), nz = static_cast<UInt>(grid[2]);
 
-    omp_lock_t writelock;
-    omp_init_lock(&writelock);
+    // coarse blocks whose center is far enough from the surface are completely inside or outside,
+    // the interpolated SDF changes at most by sqrt(3) * scale per unit, 2 * scale keeps some margin
+    enum BlockClass : Int
+    {
+        Inside = -1,
+        Mixed = 0,
+        Outside = 1
+    };
+    const UInt coarse = 8;
+    const UInt cnx = (nx + coarse - 1) / coarse, cny = (ny + coarse - 1) / coarse, cnz = (nz + coarse - 1) / coarse;
+    Vec_Int blockClass(cnx * cny * cnz, Mixed);
+    kiri_math::parallelFor(kiri_math::kZeroSize, blockClass.size(),
+                           [&](size_t b) {
+                               const UInt bx = static_cast<UInt>(b % cnx), by = static_cast<UInt>((b / cnx) % cny), bz = static_cast<UInt>(b / (cnx * cny));
+                               const Vector3F lo((float)(bx * coarse), (float)(by * coarse), (float)(bz * coarse));
+                               const Vector3F hi((float)(std::min((bx + 1) * coarse, nx) - 1), (float)(std::min((by + 1) * coarse, ny) - 1), (float)(std::min((bz + 1) * coarse, nz) - 1));
+                               const float halfDiagonal = 0.5f * (hi - lo).length() * spacing;
+                               const float bound = 2.f * obj->uniformScale() * halfDiagonal;
+
+                               const float centerPhi = obj->signedDistance(boxMin + 0.5f * (lo + hi) * spacing);
+                               if (centerPhi > bound)
+                                   blockClass[b] = Outside;
+                               else if (centerPhi < -(bound + jitter))
+                                   blockClass[b] = Inside;
+                           });
 
-    UInt count = 0;
-    float maxNum = grid[0] * grid[1] * grid[2];
-    kiri_math::parallelFor<UInt>(0, static_cast<UInt>(grid[0]), 0, static_cast<UInt>(grid[1]), 0, static_cast<UInt>(grid[2]),
-                                 [&](UInt i, UInt j, UInt k) {
-                                     Vector3F ppos = boxMin + Vector3F((float)i, (float)j, (float)k) * spacing;
-                                     auto geoPhi = obj->signedDistance(ppos);
+    // every z slice fills its own buffer in grid order, no locks and no sort
+    Vector<Vector<Vector4F>> sliceParticles(nz);
+    kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(nz),
+                           [&](size_t slice) {
+                               const UInt k = static_cast<UInt>(slice);
+                               auto &buffer = sliceParticles[k];
+                               for (UInt j = 0; j < ny; ++j)
+                               {
+                                   for (UInt i = 0; i < nx; ++i)
+                                   {
+                                       const Int cls = blockClass[((k / coarse) * cny + j / coarse) * cnx + i / coarse];
+                                       if (cls == Outside)
+                                           continue;
 
-                                     if (geoPhi < 0)
-                                     {
-                                         if (geoPhi < -jitter)
-                                         {
-                                             ppos += jitter * Vector3F(dist(engine), dist(engine), dist(engine)).normalized();
-                                         }
+                                       Vector3F ppos = boxMin + Vector3F((float)i, (float)j, (float)k) * spacing;
+                                       bool deepInside = true;
+                                       if (cls == Mixed)
+                                       {
+                                           auto geoPhi = obj->signedDistance(ppos);
+                                           if (geoPhi >= 0)
+                                               continue;
+                                           deepInside = geoPhi < -jitter;
+                                       }
 
-                                         omp_set_lock(&writelock);
+                                       if (deepInside)
+                                       {
+                                           const UInt cellIdx = (k * ny + j) * nx + i;
+                                           ppos += jitter * Vector3F(rng.uniform(cellIdx, 0, -1.f, 1.f), rng.uniform(cellIdx, 1, -1.f, 1.f), rng.uniform(cellIdx, 2, -1.f, 1.f)).normalized();
+                                       }
 
-                                         particles.append(Vector4F(ppos.x, ppos.y, ppos.z, mParticleRadius));
+                                       buffer.emplace_back(Vector4F(ppos.x, ppos.y, ppos.z, mParticleRadius));
+                                   }
+                               }
+                           });
 
-                                         omp_unset_lock(&writelock);
-                                     }
-                                 });
+    Vec_UInt sliceStart(nz + 1, 0);
+    for (UInt k = 0; k < nz; ++k)
+        sliceStart[k + 1] = sliceStart[k] + static_cast<UInt>(sliceParticles[k].size());
+
+    particles.resize(sliceStart[nz]);
+    kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(nz),
+                           [&](size_t k) {
+                               for (size_t n = 0; n < sliceParticles[k].size(); ++n)
+                                   particles[sliceStart[k] + n] = sliceParticles[k][n];
+                               Vector<Vector4F>().swap(sliceParticles[k]);
+                           });
 
     KIRI_LOG_INFO("Sampling Number={0:d}", particles.size());
+
+    if (cacheKey != 0)
+        KiriGeoCache::SaveParticles(cacheKey, particles);
 }
\ No newline at end of file
@@ -1,10 +1,579 @@
 /*** 
  * @Author: Xu.WANG
  * @Date: 2020-12-30 20:33:45
- * @LastEditTime: 2020-12-30 20:33:57
+ * @LastEditTime: 2021-02-24 14:51:08
  * @LastEditors: Xu.WANG
  * @Description: 
  * @FilePath: \Kiri\KiriCore\src\kiri_core\marching_cube\mc_cpu.cpp
  */
 
 #include <kiri_core/marching_cube/mc_cpu.h>
+#include <kiri_core/marching_cube/mc_table.h>
+#include <Eigen/Eigenvalues>
+#include <atomic>
+
+static inline Int FloorDiv(Int a, Int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+KiriMarchingCubeCPU::KiriMarchingCubeCPU()
+    : KiriMarchingCubeCPU(1.f, 0.5f) {}
+
+KiriMarchingCubeCPU::KiriMarchingCubeCPU(float KernelRadius, float CellSize, float IsoValue, UInt BlockSize)
+    : mKernelRadius(KernelRadius), mCellSize(CellSize), mIsoValue(IsoValue), mBlockSize(static_cast<Int>(std::max(BlockSize, 1u)))
+{
+    for (Int d = 0; d < 3; ++d)
+        mNumOfCells[d] = mNumOfBlocks[d] = 0;
+}
+
+Int KiriMarchingCubeCPU::FieldIndex(Int X, Int Y, Int Z) const
+{
+    const Int dim = mBlockSize + 3;
+    return ((Z + 1) * dim + (Y + 1)) * dim + (X + 1);
+}
+
+void KiriMarchingCubeCPU::SetAnisotropic(bool Enable, float MaxStretch, UInt MinNeighbors, float Smoothing)
+{
+    bAnisotropic = Enable;
+    mMaxStretch = std::max(MaxStretch, 1.f);
+    mMinNeighbors = MinNeighbors;
+    mSmoothing = Smoothing;
+}
+
+void KiriMarchingCubeCPU::NodeRange(const Vector3F &Position, float Radius, Int Lo[3], Int Hi[3]) const
+{
+    const auto &bMin = mGrid.getBMin();
+    for (Int d = 0; d < 3; ++d)
+    {
+        Lo[d] = std::max(0, static_cast<Int>(std::ceil((Position[d] - Radius - bMin[d]) / mCellSize)));
+        Hi[d] = std::min(mNumOfCells[d], static_cast<Int>(std::floor((Position[d] + Radius - bMin[d]) / mCellSize)));
+    }
+}
+
+void KiriMarchingCubeCPU::Reconstruct(const Array1Vec3F &Positions)
+{
+    if (!bAnisotropic || Positions.size() == 0)
+    {
+        mCenters = Positions;
+        mExtents.assign(Positions.size(), mKernelRadius);
+        mTransforms.clear();
+        Polygonize();
+        return;
+    }
+
+    // same layout as the solver's searcher, with the kernel radius as cell size
+    Vector3F bMin = Positions[0], bMax = Positions[0];
+    for (size_t i = 1; i < Positions.size(); ++i)
+        for (Int d = 0; d < 3; ++d)
+        {
+            bMin[d] = std::min(bMin[d], Positions[i][d]);
+            bMax[d] = std::max(bMax[d], Positions[i][d]);
+        }
+
+    KiriMCCellGrid grid;
+    grid.lowestPoint = bMin;
+    grid.cellSize = mKernelRadius;
+    for (Int d = 0; d < 3; ++d)
+        grid.gridSize[d] = std::max(1, static_cast<Int>(std::ceil((bMax[d] - bMin[d]) / mKernelRadius)));
+
+    const UInt numOfCells = static_cast<UInt>(grid.gridSize[0] * grid.gridSize[1] * grid.gridSize[2]);
+    Vec_UInt hash(Positions.size());
+    kiri_math::parallelFor(kiri_math::kZeroSize, Positions.size(),
+                           [&](size_t i) {
+                               Int xyz[3];
+                               for (Int d = 0; d < 3; ++d)
+                                   xyz[d] = std::min(std::max(static_cast<Int>((Positions[i][d] - grid.lowestPoint[d]) / grid.cellSize), 0), grid.gridSize[d] - 1);
+                               hash[i] = static_cast<UInt>((xyz[0] * grid.gridSize[1] + xyz[1]) * grid.gridSize[2] + xyz[2]);
+                           });
+
+    grid.cellStart.assign(numOfCells + 1, 0);
+    for (auto h : hash)
+        grid.cellStart[h + 1]++;
+    for (UInt c = 0; c < numOfCells; ++c)
+        grid.cellStart[c + 1] += grid.cellStart[c];
+
+    Vec_UInt cursor(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    Array1Vec3F sorted;
+    sorted.resize(Positions.size());
+    for (size_t i = 0; i < Positions.size(); ++i)
+        sorted[cursor[hash[i]]++] = Positions[i];
+
+    Reconstruct(sorted, grid);
+}
+
+void KiriMarchingCubeCPU::Reconstruct(const Array1Vec3F &SortedPositions, const KiriMCCellGrid &Grid)
+{
+    if (bAnisotropic)
+        ComputeAnisotropy(SortedPositions, Grid);
+    else
+    {
+        mCenters = SortedPositions;
+        mExtents.assign(SortedPositions.size(), mKernelRadius);
+        mTransforms.clear();
+    }
+
+    Polygonize();
+}
+
+void KiriMarchingCubeCPU::Reconstruct(const KiriMetaBall &MetaBall)
+{
+    if (MetaBall.cutoffRatio() <= 0.f)
+    {
+        KIRI_LOG_WARN("Marching Cubes: metaballs without a cutoff reach every block, set a cutoff ratio first");
+        return;
+    }
+
+    const size_t num = MetaBall.size();
+    mCenters.resize(num);
+    mExtents.resize(num);
+    mTransforms.clear();
+    for (size_t i = 0; i < num; ++i)
+    {
+        mCenters[i] = MetaBall.metaBall(i).center;
+        mExtents[i] = MetaBall.cutoffRadius(i);
+    }
+
+    const float isoValue = mIsoValue;
+    mIsoValue = MetaBall.equipotentialValue();
+    mMetaBall = &MetaBall;
+    Polygonize();
+    mMetaBall = nullptr;
+    mIsoValue = isoValue;
+}
+
+void KiriMarchingCubeCPU::ComputeAnisotropy(const Array1Vec3F &SortedPositions, const KiriMCCellGrid &Grid)
+{
+    const size_t num = SortedPositions.size();
+    const float r = Grid.cellSize;
+    const float invR = 1.f / mKernelRadius;
+
+    mCenters.resize(num);
+    mExtents.assign(num, mKernelRadius);
+    mTransforms.assign(num, Matrix3x3F::makeScaleMatrix(invR, invR, invR));
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                           [&](size_t i) {
+                               const Vector3F &pi = SortedPositions[i];
+                               Int xyz[3];
+                               for (Int d = 0; d < 3; ++d)
+                                   xyz[d] = std::min(std::max(static_cast<Int>((pi[d] - Grid.lowestPoint[d]) / Grid.cellSize), 0), Grid.gridSize[d] - 1);
+
+                               auto forEachNeighbor = [&](auto func) {
+                                   for (Int m = 0; m < 27; ++m)
+                                   {
+                                       const Int x = xyz[0] + m / 9 - 1, y = xyz[1] + (m % 9) / 3 - 1, z = xyz[2] + m % 3 - 1;
+                                       if (x < 0 || y < 0 || z < 0 || x >= Grid.gridSize[0] || y >= Grid.gridSize[1] || z >= Grid.gridSize[2])
+                                           continue;
+
+                                       const UInt h = static_cast<UInt>((x * Grid.gridSize[1] + y) * Grid.gridSize[2] + z);
+                                       for (UInt j = Grid.cellStart[h]; j < Grid.cellStart[h + 1]; ++j)
+                                       {
+                                           const float dist = (SortedPositions[j] - pi).length();
+                                           if (dist < r)
+                                           {
+                                               const float q = dist / r;
+                                               func(SortedPositions[j], 1.f - q * q * q);
+                                           }
+                                       }
+                                   }
+                               };
+
+                               // weighted mean, then the weighted covariance around it
+                               float sumW = 0.f;
+                               UInt count = 0;
+                               Vector3F mean(0.f);
+                               forEachNeighbor([&](const Vector3F &pj, float w) {
+                                   sumW += w;
+                                   mean += w * pj;
+                                   count++;
+                               });
+                               mean = mean / sumW;
+
+                               // Laplacian smoothing of the centers pulls the surface particles inwards
+                               mCenters[i] = (1.f - mSmoothing) * pi + mSmoothing * mean;
+
+                               if (count < mMinNeighbors)
+                                   return;
+
+                               Eigen::Matrix3f cov = Eigen::Matrix3f::Zero();
+                               forEachNeighbor([&](const Vector3F &pj, float w) {
+                                   const Eigen::Vector3f d(pj.x - mean.x, pj.y - mean.y, pj.z - mean.z);
+                                   cov += w * d * d.transpose();
+                               });
+                               cov /= sumW;
+
+                               Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigen(cov);
+                               Eigen::Vector3f sigma = eigen.eigenvalues();
+                               const float sigmaMax = sigma.maxCoeff();
+                               if (!(sigmaMax > 0.f))
+                                   return;
+
+                               // limit the stretch and keep the kernel volume
+                               for (Int d = 0; d < 3; ++d)
+                                   sigma[d] = std::max(sigma[d], sigmaMax / mMaxStretch);
+                               sigma /= std::cbrt(sigma[0] * sigma[1] * sigma[2]);
+
+                               const Eigen::Matrix3f &rot = eigen.eigenvectors();
+                               const Eigen::Matrix3f g = invR * rot * sigma.cwiseInverse().asDiagonal() * rot.transpose();
+                               mTransforms[i] = Matrix3x3F(g(0, 0), g(0, 1), g(0, 2),
+                                                           g(1, 0), g(1, 1), g(1, 2),
+                                                           g(2, 0), g(2, 1), g(2, 2));
+                               mExtents[i] = mKernelRadius * sigma.maxCoeff();
+                           });
+}
+
+void KiriMarchingCubeCPU::Polygonize()
+{
+    KIRI::KiriTimer timer;
+
+    mVertices.clear();
+    mNormals.clear();
+    mIndices.clear();
+    mNumOfSurfaceBlocks = 0;
+
+    if (mCenters.size() == 0)
+        return;
+
+    // the grid keeps the largest kernel plus two cells of empty space around the particles
+    Vector3F bMin = mCenters[0], bMax = mCenters[0];
+    float maxExtent = 0.f;
+    for (size_t i = 0; i < mCenters.size(); ++i)
+    {
+        for (Int d = 0; d < 3; ++d)
+        {
+            bMin[d] = std::min(bMin[d], mCenters[i][d]);
+            bMax[d] = std::max(bMax[d], mCenters[i][d]);
+        }
+        maxExtent = std::max(maxExtent, mExtents[i]);
+    }
+
+    const float pad = maxExtent + 2.f * mCellSize;
+    mGrid.SetGrid(bMin - Vector3F(pad), bMax + Vector3F(pad), mCellSize);
+
+    UInt numOfBlocks = 1;
+    for (Int d = 0; d < 3; ++d)
+    {
+        mNumOfCells[d] = static_cast<Int>(mGrid.getNCells()[d]);
+        mNumOfBlocks[d] = (mNumOfCells[d] + mBlockSize - 1) / mBlockSize;
+        numOfBlocks *= mNumOfBlocks[d];
+    }
+
+    Vec_UInt blockStart, blockParticles;
+    BinParticles(blockStart, blockParticles);
+
+    Vec_UInt occupied;
+    for (UInt b = 0; b < numOfBlocks; ++b)
+        if (blockStart[b + 1] > blockStart[b])
+            occupied.emplace_back(b);
+
+    // splat every occupied block, only the ones crossing the iso value are kept
+    Vector<SurfaceBlock> candidates(occupied.size());
+    Vector<UChar> isSurface(occupied.size(), 0);
+    kiri_math::parallelFor(kiri_math::kZeroSize, occupied.size(),
+                           [&](size_t i) {
+                               const UInt b = occupied[i];
+                               auto &block = candidates[i];
+                               block.origin[0] = static_cast<Int>(b % mNumOfBlocks[0]) * mBlockSize;
+                               block.origin[1] = static_cast<Int>((b / mNumOfBlocks[0]) % mNumOfBlocks[1]) * mBlockSize;
+                               block.origin[2] = static_cast<Int>(b / (mNumOfBlocks[0] * mNumOfBlocks[1])) * mBlockSize;
+                               isSurface[i] = SplatBlock(&blockParticles[blockStart[b]], blockStart[b + 1] - blockStart[b], block) ? 1 : 0;
+                           });
+
+    Vector<SurfaceBlock> blocks;
+    Vec_Int surfaceIdx(numOfBlocks, -1);
+    for (size_t i = 0; i < occupied.size(); ++i)
+    {
+        if (!isSurface[i])
+            continue;
+        surfaceIdx[occupied[i]] = static_cast<Int>(blocks.size());
+        blocks.emplace_back(std::move(candidates[i]));
+    }
+    Vector<SurfaceBlock>().swap(candidates);
+    mNumOfSurfaceBlocks = static_cast<UInt>(blocks.size());
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, blocks.size(),
+                           [&](size_t i) {
+                               PolygonizeVertices(blocks[i]);
+                           });
+
+    Vec_UInt vertexOffset(blocks.size() + 1, 0);
+    for (size_t i = 0; i < blocks.size(); ++i)
+        vertexOffset[i + 1] = vertexOffset[i] + static_cast<UInt>(blocks[i].vertices.size());
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, blocks.size(),
+                           [&](size_t i) {
+                               PolygonizeTriangles(blocks[i], blocks, surfaceIdx, vertexOffset);
+                           });
+
+    Vec_UInt indexOffset(blocks.size() + 1, 0);
+    for (size_t i = 0; i < blocks.size(); ++i)
+        indexOffset[i + 1] = indexOffset[i] + static_cast<UInt>(blocks[i].triangles.size());
+
+    mVertices.resize(vertexOffset.back());
+    mNormals.resize(vertexOffset.back());
+    mIndices.resize(indexOffset.back());
+    kiri_math::parallelFor(kiri_math::kZeroSize, blocks.size(),
+                           [&](size_t i) {
+                               const auto &block = blocks[i];
+                               for (size_t v = 0; v < block.vertices.size(); ++v)
+                               {
+                                   mVertices[vertexOffset[i] + v] = block.vertices[v];
+                                   mNormals[vertexOffset[i] + v] = block.normals[v];
+                               }
+                               for (size_t t = 0; t < block.triangles.size(); ++t)
+                                   mIndices[indexOffset[i] + t] = block.triangles[t];
+                           });
+
+    KIRI_LOG_INFO("Marching Cubes: particles={0:d}, occupied blocks={1:d}, surface blocks={2:d}, vertices={3:d}, triangles={4:d}, time={5:f}s",
+                  mCenters.size(), occupied.size(), blocks.size(), mVertices.size(), mIndices.size() / 3, timer.Elapsed());
+}
+
+void KiriMarchingCubeCPU::BinParticles(Vec_UInt &BlockStart, Vec_UInt &BlockParticles)
+{
+    const UInt numOfBlocks = mNumOfBlocks[0] * mNumOfBlocks[1] * mNumOfBlocks[2];
+
+    // a block needs every particle which reaches one of its nodes or apron nodes
+    auto blockRange = [&](size_t i, Int bLo[3], Int bHi[3]) {
+        Int lo[3], hi[3];
+        NodeRange(mCenters[i], mExtents[i], lo, hi);
+        for (Int d = 0; d < 3; ++d)
+        {
+            bLo[d] = std::max(0, FloorDiv(lo[d] + mBlockSize - 2, mBlockSize) - 1);
+            bHi[d] = std::min(mNumOfBlocks[d] - 1, FloorDiv(hi[d] + 1, mBlockSize));
+        }
+    };
+
+    UniquePtr<std::atomic<UInt>[]> counter(new std::atomic<UInt>[numOfBlocks]);
+    for (UInt b = 0; b < numOfBlocks; ++b)
+        counter[b] = 0;
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, mCenters.size(),
+                           [&](size_t i) {
+                               Int bLo[3], bHi[3];
+                               blockRange(i, bLo, bHi);
+                               for (Int bz = bLo[2]; bz <= bHi[2]; ++bz)
+                                   for (Int by = bLo[1]; by <= bHi[1]; ++by)
+                                       for (Int bx = bLo[0]; bx <= bHi[0]; ++bx)
+                                           counter[BlockIndex(bx, by, bz)].fetch_add(1, std::memory_order_relaxed);
+                           });
+
+    BlockStart.assign(numOfBlocks + 1, 0);
+    for (UInt b = 0; b < numOfBlocks; ++b)
+    {
+        BlockStart[b + 1] = BlockStart[b] + counter[b].load(std::memory_order_relaxed);
+        counter[b] = 0;
+    }
+
+    BlockParticles.resize(BlockStart.back());
+    kiri_math::parallelFor(kiri_math::kZeroSize, mCenters.size(),
+                           [&](size_t i) {
+                               Int bLo[3], bHi[3];
+                               blockRange(i, bLo, bHi);
+                               for (Int bz = bLo[2]; bz <= bHi[2]; ++bz)
+                                   for (Int by = bLo[1]; by <= bHi[1]; ++by)
+                                       for (Int bx = bLo[0]; bx <= bHi[0]; ++bx)
+                                       {
+                                           const UInt b = BlockIndex(bx, by, bz);
+                                           BlockParticles[BlockStart[b] + counter[b].fetch_add(1, std::memory_order_relaxed)] = static_cast<UInt>(i);
+                                       }
+                           });
+
+    // neighbor blocks must sum a shared node in the same order to agree on its sign
+    kiri_math::parallelFor(kiri_math::kZeroSize, static_cast<size_t>(numOfBlocks),
+                           [&](size_t b) {
+                               std::sort(BlockParticles.begin() + BlockStart[b], BlockParticles.begin() + BlockStart[b + 1]);
+                           });
+}
+
+bool KiriMarchingCubeCPU::SplatBlock(const UInt *Particles, UInt Num, SurfaceBlock &Block)
+{
+    const Int dim = mBlockSize + 3;
+    const auto &bMin = mGrid.getBMin();
+    const float invR2 = 1.f / (mKernelRadius * mKernelRadius);
+
+    // scratch field reused by the thread, interior blocks never allocate their own
+    thread_local Vec_Float field;
+    field.assign(dim * dim * dim, 0.f);
+
+    const bool anisotropic = !mTransforms.empty();
+    const float shift = mMetaBall ? 1.f / (mMetaBall->cutoffRatio() * mMetaBall->cutoffRatio()) : 0.f;
+
+    for (UInt n = 0; n < Num; ++n)
+    {
+        const auto &p = mCenters[Particles[n]];
+        Int lo[3], hi[3];
+        NodeRange(p, mExtents[Particles[n]], lo, hi);
+        for (Int d = 0; d < 3; ++d)
+        {
+            lo[d] = std::max(lo[d], Block.origin[d] - 1) - Block.origin[d];
+            hi[d] = std::min(hi[d], Block.origin[d] + mBlockSize + 1) - Block.origin[d];
+        }
+
+        for (Int z = lo[2]; z <= hi[2]; ++z)
+            for (Int y = lo[1]; y <= hi[1]; ++y)
+                for (Int x = lo[0]; x <= hi[0]; ++x)
+                {
+                    const Vector3F node = bMin + Vector3F(static_cast<float>(Block.origin[0] + x),
+                                                          static_cast<float>(Block.origin[1] + y),
+                                                          static_cast<float>(Block.origin[2] + z)) *
+                                                     mCellSize;
+                    if (mMetaBall)
+                    {
+                        // same shifted field as KiriMetaBall::Sampling, the node range already is the cutoff sphere's box
+                        const float d2 = (node - p).lengthSquared();
+                        const float radius = mMetaBall->metaBall(Particles[n]).radius;
+                        if (d2 < mExtents[Particles[n]] * mExtents[Particles[n]])
+                            field[FieldIndex(x, y, z)] += radius * radius / (d2 + MEpsilon<float>()) - shift;
+                        continue;
+                    }
+
+                    const float q = anisotropic ? 1.f - (mTransforms[Particles[n]] * (node - p)).lengthSquared()
+                                                : 1.f - (node - p).lengthSquared() * invR2;
+                    if (q > 0.f)
+                        field[FieldIndex(x, y, z)] += q * q * q;
+                }
+    }
+
+    bool inside = false, outside = false;
+    for (Int z = 0; z <= mBlockSize; ++z)
+        for (Int y = 0; y <= mBlockSize; ++y)
+            for (Int x = 0; x <= mBlockSize; ++x)
+            {
+                if (field[FieldIndex(x, y, z)] > mIsoValue)
+                    inside = true;
+                else
+                    outside = true;
+            }
+
+    if (!(inside && outside))
+        return false;
+
+    Block.field = field;
+    return true;
+}
+
+void KiriMarchingCubeCPU::PolygonizeVertices(SurfaceBlock &Block)
+{
+    const Int b = mBlockSize;
+    const auto &bMin = mGrid.getBMin();
+    const auto &f = Block.field;
+
+    auto gradient = [&](Int x, Int y, Int z) {
+        return Vector3F(f[FieldIndex(x + 1, y, z)] - f[FieldIndex(x - 1, y, z)],
+                        f[FieldIndex(x, y + 1, z)] - f[FieldIndex(x, y - 1, z)],
+                        f[FieldIndex(x, y, z + 1)] - f[FieldIndex(x, y, z - 1)]);
+    };
+
+    Block.edgeVertex.assign(b * b * b * 3, -1);
+    for (Int z = 0; z < b; ++z)
+        for (Int y = 0; y < b; ++y)
+            for (Int x = 0; x < b; ++x)
+            {
+                if (Block.origin[0] + x >= mNumOfCells[0] || Block.origin[1] + y >= mNumOfCells[1] || Block.origin[2] + z >= mNumOfCells[2])
+                    continue;
+
+                const float v0 = f[FieldIndex(x, y, z)];
+                for (Int axis = 0; axis < 3; ++axis)
+                {
+                    const Int x1 = x + (axis == 0), y1 = y + (axis == 1), z1 = z + (axis == 2);
+                    const float v1 = f[FieldIndex(x1, y1, z1)];
+                    if ((v0 > mIsoValue) == (v1 > mIsoValue))
+                        continue;
+
+                    const float t = (mIsoValue - v0) / (v1 - v0);
+                    Vector3F local(static_cast<float>(Block.origin[0] + x), static_cast<float>(Block.origin[1] + y), static_cast<float>(Block.origin[2] + z));
+                    local[axis] += t;
+
+                    // the field grows towards the fluid, the normal points out of it
+                    Vector3F n = -((1.f - t) * gradient(x, y, z) + t * gradient(x1, y1, z1));
+                    const float len = n.length();
+                    n = len > 0.f ? n / len : Vector3F(0.f);
+
+                    Block.edgeVertex[((z * b + y) * b + x) * 3 + axis] = static_cast<Int>(Block.vertices.size());
+                    Block.vertices.emplace_back(bMin + local * mCellSize);
+                    Block.normals.emplace_back(n);
+                }
+            }
+
+    // the triangles only need the corner values, drop the apron
+    Vec_Float corners;
+    corners.reserve((b + 1) * (b + 1) * (b + 1));
+    for (Int z = 0; z <= b; ++z)
+        for (Int y = 0; y <= b; ++y)
+            for (Int x = 0; x <= b; ++x)
+                corners.emplace_back(f[FieldIndex(x, y, z)]);
+    Block.field.swap(corners);
+}
+
+void KiriMarchingCubeCPU::PolygonizeTriangles(SurfaceBlock &Block, const Vector<SurfaceBlock> &Blocks, const Vec_Int &SurfaceIdx, const Vec_UInt &VertexOffset)
+{
+    const Int b = mBlockSize;
+    auto corner = [&](Int x, Int y, Int z) { return Block.field[(z * (b + 1) + y) * (b + 1) + x]; };
+
+    // global index of the vertex on the edge which starts at global node g along axis
+    auto vertexOf = [&](const Int g[3], Int axis) -> Int {
+        Int owner[3], local[3];
+        for (Int d = 0; d < 3; ++d)
+        {
+            owner[d] = g[d] / b;
+            local[d] = g[d] - owner[d] * b;
+            if (owner[d] >= mNumOfBlocks[d])
+                return -1;
+        }
+        const Int s = SurfaceIdx[BlockIndex(owner[0], owner[1], owner[2])];
+        if (s < 0)
+            return -1;
+        const Int v = Blocks[s].edgeVertex[((local[2] * b + local[1]) * b + local[0]) * 3 + axis];
+        return v < 0 ? -1 : static_cast<Int>(VertexOffset[s]) + v;
+    };
+
+    for (Int z = 0; z < b; ++z)
+        for (Int y = 0; y < b; ++y)
+            for (Int x = 0; x < b; ++x)
+            {
+                if (Block.origin[0] + x >= mNumOfCells[0] || Block.origin[1] + y >= mNumOfCells[1] || Block.origin[2] + z >= mNumOfCells[2])
+                    continue;
+
+                Int cubeIdx = 0;
+                for (Int c = 0; c < 8; ++c)
+                    if (corner(x + MC_CORNER[c][0], y + MC_CORNER[c][1], z + MC_CORNER[c][2]) > mIsoValue)
+                        cubeIdx |= 1 << c;
+
+                if (MC_EDGE_TABLE[cubeIdx] == 0)
+                    continue;
+
+                Int edgeVertex[12];
+                for (Int e = 0; e < 12; ++e)
+                {
+                    if (!(MC_EDGE_TABLE[cubeIdx] & (1 << e)))
+                        continue;
+
+                    const Int *c0 = MC_CORNER[MC_EDGE_CORNER[e][0]];
+                    const Int *c1 = MC_CORNER[MC_EDGE_CORNER[e][1]];
+                    Int g[3], axis = 0;
+                    for (Int d = 0; d < 3; ++d)
+                    {
+                        g[d] = Block.origin[d] + std::min(c0[d], c1[d]) + (d == 0 ? x : (d == 1 ? y : z));
+                        if (c0[d] != c1[d])
+                            axis = d;
+                    }
+
+                    // edges starting in this block are its own, the ones on its upper faces belong to a neighbor
+                    edgeVertex[e] = vertexOf(g, axis);
+                }
+
+                for (Int t = 0; MC_TRI_TABLE[cubeIdx][t] != -1; t += 3)
+                {
+                    const Int v0 = edgeVertex[MC_TRI_TABLE[cubeIdx][t]];
+                    const Int v1 = edgeVertex[MC_TRI_TABLE[cubeIdx][t + 1]];
+                    const Int v2 = edgeVertex[MC_TRI_TABLE[cubeIdx][t + 2]];
+                    if (v0 < 0 || v1 < 0 || v2 < 0)
+                        continue;
+
+                    Block.triangles.emplace_back(static_cast<UInt>(v0));
+                    Block.triangles.emplace_back(static_cast<UInt>(v1));
+                    Block.triangles.emplace_back(static_cast<UInt>(v2));
+                }
+            }
+}
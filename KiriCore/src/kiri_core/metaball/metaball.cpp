@@ -1,7 +1,7 @@
 /*** 
  * @Author: Xu.WANG
  * @Date: 2020-12-30 19:52:50
- * @LastEditTime: 2020-12-30 20:19:15
+ * @LastEditTime: 2021-02-25 11:20:43
  * @LastEditors: Xu.WANG
  * @Description: 
  * @FilePath: \Kiri\KiriCore\src\kiri_core\metaball\metaball.cpp
@@ -9,9 +9,26 @@
 
 #include <kiri_core/metaball/metaball.h>
 
+void MetaBallBatch::clear()
+{
+    cx.clear();
+    cy.clear();
+    cz.clear();
+    r2.clear();
+    cutoff2.clear();
+    shift.clear();
+}
+
 void KiriMetaBall::PushMetaBall(Vector3F Center, float Radius)
 {
     mMetaBallArray.append(MetaBallData(Center, Radius));
+    mGridDirty = true;
+}
+
+void KiriMetaBall::SetCutoffRatio(float CutoffRatio)
+{
+    mCutoffRatio = std::max(CutoffRatio, 0.f);
+    mGridDirty = true;
 }
 
 float KiriMetaBall::MetaBallStandardFunc(Vector3F Position, Vector3F Center, float Radius)
@@ -20,14 +37,212 @@ float KiriMetaBall::MetaBallStandardFunc(Vector3F Position, Vector3F Center, flo
     return Radius * Radius / (distance.lengthSquared() + MEpsilon<float>());
 }
 
-float KiriMetaBall::Sampling(Vector3F Position)
+void KiriMetaBall::Gather(const UInt *Indices, size_t Num, MetaBallBatch &Batch) const
+{
+    const bool cutoff = mCutoffRatio > 0.f;
+    const float shift = cutoff ? 1.f / (mCutoffRatio * mCutoffRatio) : 0.f;
+    for (size_t n = 0; n < Num; ++n)
+    {
+        const auto &ball = mMetaBallArray[Indices ? Indices[n] : n];
+        const float r2 = ball.radius * ball.radius;
+        Batch.cx.emplace_back(ball.center.x);
+        Batch.cy.emplace_back(ball.center.y);
+        Batch.cz.emplace_back(ball.center.z);
+        Batch.r2.emplace_back(r2);
+        Batch.cutoff2.emplace_back(cutoff ? r2 / shift : Huge<float>());
+        Batch.shift.emplace_back(shift);
+    }
+}
+
+float KiriMetaBall::Evaluate(const MetaBallBatch &Batch, const Vector3F &Position)
 {
+    const float *cx = Batch.cx.data(), *cy = Batch.cy.data(), *cz = Batch.cz.data();
+    const float *r2 = Batch.r2.data(), *cutoff2 = Batch.cutoff2.data(), *shift = Batch.shift.data();
+    const Int num = static_cast<Int>(Batch.size());
+    const float px = Position.x, py = Position.y, pz = Position.z;
+
     float r = 0.f;
+    for (Int i = 0; i < num; ++i)
+    {
+        const float dx = px - cx[i], dy = py - cy[i], dz = pz - cz[i];
+        const float d2 = dx * dx + dy * dy + dz * dz;
+        const float v = r2[i] / (d2 + MEpsilon<float>()) - shift[i];
+        r += d2 < cutoff2[i] ? v : 0.f;
+    }
+
+    return r;
+}
+
+Int KiriMetaBall::CellCoord(float X, Int Axis) const
+{
+    const Int c = static_cast<Int>(std::floor((X - mGridOrigin[Axis]) / mGridCellSize));
+    return std::min(std::max(c, 0), mGridSize[Axis] - 1);
+}
+
+void KiriMetaBall::EnsureGrid()
+{
+    if (!mGridDirty.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> lock(mGridMutex);
+    if (mGridDirty.load(std::memory_order_relaxed))
+    {
+        BuildGrid();
+        mGridDirty.store(false, std::memory_order_release);
+    }
+}
+
+void KiriMetaBall::BuildGrid()
+{
+    mAllBalls.clear();
+    mCellStart.clear();
+    mCellBalls.clear();
+    mGridSize[0] = mGridSize[1] = mGridSize[2] = 0;
+
+    const size_t num = mMetaBallArray.size();
+    if (num == 0)
+        return;
+
+    if (mCutoffRatio <= 0.f)
+    {
+        Gather(nullptr, num, mAllBalls);
+        return;
+    }
 
-    for (size_t i = 0; i < mMetaBallArray.size(); i++)
+    Vector3F bMin = mMetaBallArray[0].center, bMax = mMetaBallArray[0].center;
+    float maxCutoff = 0.f;
+    for (size_t i = 0; i < num; ++i)
     {
-        r += MetaBallStandardFunc(Position, mMetaBallArray[i].center, mMetaBallArray[i].radius);
+        for (Int d = 0; d < 3; ++d)
+        {
+            bMin[d] = std::min(bMin[d], mMetaBallArray[i].center[d]);
+            bMax[d] = std::max(bMax[d], mMetaBallArray[i].center[d]);
+        }
+        maxCutoff = std::max(maxCutoff, cutoffRadius(i));
+    }
+
+    // a ball reaches at most the 27 cells around its own one
+    mGridOrigin = bMin;
+    mGridCellSize = std::max(maxCutoff, MEpsilon<float>());
+    for (Int d = 0; d < 3; ++d)
+        mGridSize[d] = std::max(1, static_cast<Int>(std::ceil((bMax[d] - bMin[d]) / mGridCellSize)));
+
+    const UInt numOfCells = static_cast<UInt>(mGridSize[0] * mGridSize[1] * mGridSize[2]);
+    Vec_UInt hash(num);
+    mCellStart.assign(numOfCells + 1, 0);
+    for (size_t i = 0; i < num; ++i)
+    {
+        const auto &c = mMetaBallArray[i].center;
+        hash[i] = static_cast<UInt>((CellCoord(c.z, 2) * mGridSize[1] + CellCoord(c.y, 1)) * mGridSize[0] + CellCoord(c.x, 0));
+        mCellStart[hash[i] + 1]++;
+    }
+    for (UInt c = 0; c < numOfCells; ++c)
+        mCellStart[c + 1] += mCellStart[c];
+
+    Vec_UInt cursor(mCellStart.begin(), mCellStart.end() - 1);
+    mCellBalls.resize(num);
+    for (size_t i = 0; i < num; ++i)
+        mCellBalls[cursor[hash[i]]++] = static_cast<UInt>(i);
+}
+
+float KiriMetaBall::Sampling(Vector3F Position)
+{
+    if (mCutoffRatio <= 0.f)
+    {
+        float r = 0.f;
+
+        for (size_t i = 0; i < mMetaBallArray.size(); i++)
+        {
+            r += MetaBallStandardFunc(Position, mMetaBallArray[i].center, mMetaBallArray[i].radius);
+        }
+
+        return r - mEquipotentialValue;
+    }
+
+    EnsureGrid();
+
+    float r = 0.f;
+    const Int x = CellCoord(Position.x, 0), y = CellCoord(Position.y, 1), z = CellCoord(Position.z, 2);
+    for (Int m = 0; m < 27; ++m)
+    {
+        const Int nx = x + m % 3 - 1, ny = y + (m % 9) / 3 - 1, nz = z + m / 9 - 1;
+        if (nx < 0 || ny < 0 || nz < 0 || nx >= mGridSize[0] || ny >= mGridSize[1] || nz >= mGridSize[2])
+            continue;
+
+        const UInt nc = static_cast<UInt>((nz * mGridSize[1] + ny) * mGridSize[0] + nx);
+        for (UInt k = mCellStart[nc]; k < mCellStart[nc + 1]; ++k)
+        {
+            const auto &ball = mMetaBallArray[mCellBalls[k]];
+            const float cutoff = mCutoffRatio * ball.radius;
+            if ((Position - ball.center).lengthSquared() < cutoff * cutoff)
+                r += MetaBallStandardFunc(Position, ball.center, ball.radius) - 1.f / (mCutoffRatio * mCutoffRatio);
+        }
     }
 
     return r - mEquipotentialValue;
 }
+
+void KiriMetaBall::Sampling(const Array1Vec3F &Positions, Array1<float> &Values)
+{
+    const size_t num = Positions.size();
+    Values.resize(num);
+    if (num == 0)
+        return;
+
+    EnsureGrid();
+
+    // without a cutoff every point sees every ball, only the batch loop and the threads help
+    if (mCutoffRatio <= 0.f || mCellStart.empty())
+    {
+        kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                               [&](size_t i) {
+                                   Values[i] = Evaluate(mAllBalls, Positions[i]) - mEquipotentialValue;
+                               });
+        return;
+    }
+
+    // group the points by cell, points outside the grid are clamped to the border cells
+    const UInt numOfCells = static_cast<UInt>(mGridSize[0] * mGridSize[1] * mGridSize[2]);
+    Vec_UInt hash(num), pointStart(numOfCells + 1, 0), points(num);
+    kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                           [&](size_t i) {
+                               const auto &p = Positions[i];
+                               hash[i] = static_cast<UInt>((CellCoord(p.z, 2) * mGridSize[1] + CellCoord(p.y, 1)) * mGridSize[0] + CellCoord(p.x, 0));
+                           });
+    for (size_t i = 0; i < num; ++i)
+        pointStart[hash[i] + 1]++;
+    for (UInt c = 0; c < numOfCells; ++c)
+        pointStart[c + 1] += pointStart[c];
+    Vec_UInt cursor(pointStart.begin(), pointStart.end() - 1);
+    for (size_t i = 0; i < num; ++i)
+        points[cursor[hash[i]]++] = static_cast<UInt>(i);
+
+    Vec_UInt occupied;
+    for (UInt c = 0; c < numOfCells; ++c)
+        if (pointStart[c + 1] > pointStart[c])
+            occupied.emplace_back(c);
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, occupied.size(),
+                           [&](size_t o) {
+                               const UInt c = occupied[o];
+                               const Int x = static_cast<Int>(c % mGridSize[0]);
+                               const Int y = static_cast<Int>((c / mGridSize[0]) % mGridSize[1]);
+                               const Int z = static_cast<Int>(c / (mGridSize[0] * mGridSize[1]));
+
+                               // the candidates of the whole cell are gathered once and shared by all its points
+                               thread_local MetaBallBatch batch;
+                               batch.clear();
+                               for (Int m = 0; m < 27; ++m)
+                               {
+                                   const Int nx = x + m % 3 - 1, ny = y + (m % 9) / 3 - 1, nz = z + m / 9 - 1;
+                                   if (nx < 0 || ny < 0 || nz < 0 || nx >= mGridSize[0] || ny >= mGridSize[1] || nz >= mGridSize[2])
+                                       continue;
+
+                                   const UInt nc = static_cast<UInt>((nz * mGridSize[1] + ny) * mGridSize[0] + nx);
+                                   Gather(&mCellBalls[mCellStart[nc]], mCellStart[nc + 1] - mCellStart[nc], batch);
+                               }
+
+                               for (UInt k = pointStart[c]; k < pointStart[c + 1]; ++k)
+                                   Values[points[k]] = Evaluate(batch, Positions[points[k]]) - mEquipotentialValue;
+                           });
+}
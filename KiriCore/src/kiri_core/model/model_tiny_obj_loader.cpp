@@ -14,16 +14,23 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
-KiriModelTinyObjLoader::KiriModelTinyObjLoader(const String &name, const String &folder = "models", const String &ext = ".obj")
-    : mName(name), mExtension(ext), mFolder(folder)
+String KiriModelTinyObjLoader::getFilePath(const String &name, const String &folder, const String &ext)
 {
-    String filePath = String(DB_PBR_PATH) + mFolder + "/" + mName + "/" + mName + mExtension;
+    String filePath = String(DB_PBR_PATH) + folder + "/" + name + "/" + name + ext;
 
     if (RELEASE && PUBLISH)
     {
-        //filePath = String(DB_PBR_PATH) + mFolder + "/" + mName + "/" + mName + mExtension;
-        filePath = "./resources/" + mFolder + "/" + mName + "/" + mName + mExtension;
+        //filePath = String(DB_PBR_PATH) + folder + "/" + name + "/" + name + ext;
+        filePath = "./resources/" + folder + "/" + name + "/" + name + ext;
     }
+
+    return filePath;
+}
+
+KiriModelTinyObjLoader::KiriModelTinyObjLoader(const String &name, const String &folder = "models", const String &ext = ".obj")
+    : mName(name), mExtension(ext), mFolder(folder)
+{
+    String filePath = getFilePath(mName, mFolder, mExtension);
     KIRI_LOG_INFO("Tiny Obj Loader Model Path={0:s}", filePath);
 
     clearData();
@@ -5,6 +5,7 @@
  * @Last Modified time: 2020-04-26 02:37:07
  */
 #include <kiri_core/pbd/pbf_system.h>
+#include <kiri_timer.h>
 
 KiriPBFSystem::KiriPBFSystem()
 {
@@ -18,6 +19,33 @@ KiriPBFSystemDataPtr KiriPBFSystem::pbfSystemData() const
     return _pbfSystemData;
 }
 
+const KiriPBFSolverStats &KiriPBFSystem::solverStats() const
+{
+    return _solverStats;
+}
+
+void KiriPBFSystem::SetSolverType(PBFSolverType type)
+{
+    _solverType = type;
+}
+
+void KiriPBFSystem::SetIterations(size_t minIter, size_t maxIter)
+{
+    _maxIter = std::max(maxIter, (size_t)1);
+    _minIter = std::min(minIter, _maxIter);
+}
+
+void KiriPBFSystem::SetDensityErrorTolerance(float tolerance)
+{
+    _densityErrorTolerance = std::max(tolerance, 0.0f);
+}
+
+void KiriPBFSystem::SetWarmStartScale(float scale)
+{
+    // the whole last correction overshoots as soon as the flow changes
+    _warmStartScale = std::min(std::max(scale, 0.0f), 0.9f);
+}
+
 void KiriPBFSystem::addBoxFluidAndBoxBoundary(Array1<BoundingBox3F> fluids, BoundingBox3F boundary, bool bcc)
 {
     float spacing = pbfSystemData()->particleRadius() * 2.0f;
@@ -73,6 +101,45 @@ void KiriPBFSystem::Update()
 }
 
 // --------------------------------PBF Method--------------------------------
+// --------------------------------Benchmark--------------------------------
+
+Vector<KiriPBFSystem::BenchmarkResult> KiriPBFSystem::BenchmarkSolvers(
+    const Array1<BoundingBox3F> &fluids,
+    const BoundingBox3F &boundary,
+    size_t steps,
+    size_t maxIter,
+    float tolerance)
+{
+    Vector<BenchmarkResult> results;
+    for (auto type : {JacobiSolver, ColoredGaussSeidelSolver})
+    {
+        KiriPBFSystem system;
+        system.SetSolverType(type);
+        system.SetIterations(1, maxIter);
+        system.SetDensityErrorTolerance(tolerance);
+        system.addBoxFluidAndBoxBoundary(fluids, boundary);
+
+        BenchmarkResult result = {type, steps, 0, 0.0f, 0.0f};
+        KIRI::KiriTimer timer;
+        for (size_t s = 0; s < steps; ++s)
+        {
+            system.Update();
+            result.iterations += system.solverStats().iterations;
+            result.avgDensityError += system.solverStats().avgDensityError;
+        }
+        result.milliseconds = static_cast<float>(timer.Elapsed() * 1000.0);
+        result.avgDensityError /= std::max(steps, (size_t)1);
+
+        KIRI_LOG_INFO("PBF {0}: {1} iterations in {2} steps, average density error {3}, {4} ms",
+                      type == JacobiSolver ? "Jacobi" : "Colored Gauss-Seidel",
+                      result.iterations, steps, result.avgDensityError, result.milliseconds);
+        results.emplace_back(result);
+    }
+
+    return results;
+}
+
+// --------------------------------Benchmark--------------------------------
 // --------------------------------PBF Calculation--------------------------------
 
 void KiriPBFSystem::calcExternalForces()
@@ -151,6 +218,7 @@ void KiriPBFSystem::semiImplicitEuler()
 void KiriPBFSystem::constraintProjection()
 {
     size_t n = pbfSystemData()->numOfFluidParticles();
+    size_t num = pbfSystemData()->NumOfParticles();
 
     auto p = pbfSystemData()->positions();
     auto m = pbfSystemData()->masses();
@@ -161,32 +229,100 @@ void KiriPBFSystem::constraintProjection()
 
     auto kr = pbfSystemData()->SphKernelRadius();
     auto fd = pbfSystemData()->fluidDensity();
-    auto fp = pbfSystemData()->fluidPositions();
+    const kiri_math::SphCubicKernel3F mKernel(kr);
+    const float w0 = mKernel.W_zero();
 
     // build fluid particles searcher
     pbfSystemData()->buildNeighborSearcher(kr, p);
     pbfSystemData()->buildNeighborLists(kr, p);
-    size_t iter = 0;
-    while (iter < _maxIter)
-    {
-        // calculate density and lagrange multiplier.
+
+    const UInt *start = pbfSystemData()->neighborStart().data();
+    const UInt *indices = pbfSystemData()->neighborIndices().data();
+
+    // the iterations run on SoA copies of the positions, boundary particles never move
+    auto &solver = pbfSystemData()->solverData();
+    solver.resize(num, start[n]);
+    float *px = solver.posX.data(), *py = solver.posY.data(), *pz = solver.posZ.data();
+    float *gx = solver.gradX.data(), *gy = solver.gradY.data(), *gz = solver.gradZ.data();
+    float *err = solver.densityError.data();
+    float *warm = solver.warmLambdas.data();
+    const float *mass = m.data();
+    float *lambda = l.data();
+
+    kiri_math::parallelFor(
+        kiri_math::kZeroSize,
+        num,
+        [&](size_t i) {
+            px[i] = p[i].x;
+            py[i] = p[i].y;
+            pz[i] = p[i].z;
+        });
+
+    // constraint gradients of every neighbor pair, the density and the multiplier only if asked for
+    auto computeGradients = [&](bool updateLambda) {
         kiri_math::parallelFor(
             kiri_math::kZeroSize,
             n,
             [&](size_t i) {
-                float density_err;
-                const auto &neighbors = pbfSystemData()->neighborLists()[i];
-                computeFluidDensity(i, n, p, m, neighbors, kr, fd, density_err, d[i]);
-                computeLagrangeMultiplier(i, n, p, m, neighbors, d[i], kr, fd, l[i]);
+                const float xi = px[i], yi = py[i], zi = pz[i];
+                float density = mass[i] * w0;
+                float gradCiX = 0.0f, gradCiY = 0.0f, gradCiZ = 0.0f;
+                float sumGradCj = 0.0f;
+
+                for (UInt k = start[i]; k < start[i + 1]; ++k)
+                {
+                    const UInt j = indices[k];
+                    const Vector3F r(xi - px[j], yi - py[j], zi - pz[j]);
+                    if (updateLambda)
+                        density += mass[j] * mKernel(r);
+
+                    const Vector3F gradCj = mass[j] / fd * mKernel.gradW(r);
+                    gx[k] = gradCj.x;
+                    gy[k] = gradCj.y;
+                    gz[k] = gradCj.z;
+                    gradCiX += gradCj.x;
+                    gradCiY += gradCj.y;
+                    gradCiZ += gradCj.z;
+                    sumGradCj += gradCj.lengthSquared();
+                }
+
+                if (!updateLambda)
+                    return;
+
+                d[i] = density;
+
+                const float eps = 1.0e-6f;
+                const float constraint = std::max(density / fd - 1.0f, 0.0f);
+                err[i] = constraint;
+                if (constraint != 0.0f)
+                {
+                    sumGradCj += gradCiX * gradCiX + gradCiY * gradCiY + gradCiZ * gradCiZ;
+                    lambda[i] = -constraint / (sumGradCj + eps);
+                }
+                else
+                    lambda[i] = 0.0f;
             });
+    };
 
-        // perform density constraint.
+    // perform density constraint with the cached gradients, boundary neighbors only contribute the particle's own multiplier
+    auto applyCorrection = [&](const float *multiplier) {
         kiri_math::parallelFor(
             kiri_math::kZeroSize,
             n,
             [&](size_t i) {
-                const auto &neighbors = pbfSystemData()->neighborLists()[i];
-                solveDensityConstraint(i, n, p, m, neighbors, l, kr, fd, dp[i]);
+                const float li = multiplier[i];
+                const UInt first = start[i], last = start[i + 1];
+                float dx = 0.0f, dy = 0.0f, dz = 0.0f;
+                for (UInt k = first; k < last; ++k)
+                {
+                    const UInt j = indices[k];
+                    const float c = li + (j < n ? multiplier[j] : 0.0f);
+                    dx += c * gx[k];
+                    dy += c * gy[k];
+                    dz += c * gz[k];
+                }
+
+                dp[i] = Vector3F(dx, dy, dz);
             });
 
         // add the delta position to particles' position.
@@ -194,11 +330,215 @@ void KiriPBFSystem::constraintProjection()
             kiri_math::kZeroSize,
             n,
             [&](size_t i) {
-                p[i] += dp[i];
+                px[i] += dp[i].x;
+                py[i] += dp[i].y;
+                pz[i] += dp[i].z;
+            });
+    };
+
+    // fixed size blocks, the result doesn't depend on the number of threads
+    auto reduceDensityError = [&](float &avgError, float &maxError) {
+        const size_t blockSize = 4096;
+        const size_t numOfBlocks = (n + blockSize - 1) / blockSize;
+        Vec_Float blockSum(numOfBlocks, 0.0f), blockMax(numOfBlocks, 0.0f);
+        kiri_math::parallelFor(
+            kiri_math::kZeroSize,
+            numOfBlocks,
+            [&](size_t b) {
+                for (size_t i = b * blockSize; i < std::min(n, (b + 1) * blockSize); ++i)
+                {
+                    blockSum[b] += err[i];
+                    blockMax[b] = std::max(blockMax[b], err[i]);
+                }
+            });
+
+        float sum = 0.0f;
+        maxError = 0.0f;
+        for (size_t b = 0; b < numOfBlocks; ++b)
+        {
+            sum += blockSum[b];
+            maxError = std::max(maxError, blockMax[b]);
+        }
+        avgError = n > 0 ? sum / n : 0.0f;
+    };
+
+    // the last step's multipliers are a good guess in calm regions, only a part is applied to stay safe in splashes
+    const bool warmStart = _warmStartScale > 0.0f;
+    if (warmStart)
+    {
+        kiri_math::parallelFor(
+            kiri_math::kZeroSize,
+            n,
+            [&](size_t i) {
+                warm[i] *= _warmStartScale;
             });
 
-        ++iter;
+        computeGradients(false);
+        applyCorrection(warm);
+    }
+
+    _solverStats = KiriPBFSolverStats();
+    size_t iter = 0;
+    while (_solverType == JacobiSolver)
+    {
+        computeGradients(true);
+
+        float avgError, maxError;
+        reduceDensityError(avgError, maxError);
+        if (iter == 0)
+            _solverStats.initialAvgDensityError = avgError;
+        _solverStats.avgDensityError = avgError;
+        _solverStats.maxDensityError = maxError;
+
+        _solverStats.converged = avgError <= _densityErrorTolerance;
+        if (_solverStats.converged && iter >= _minIter)
+            break;
+
+        applyCorrection(lambda);
+
+        if (warmStart)
+        {
+            kiri_math::parallelFor(
+                kiri_math::kZeroSize,
+                n,
+                [&](size_t i) {
+                    warm[i] += lambda[i];
+                });
+        }
+
+        // the limit is checked after the correction, no extra density pass only for the statistics
+        if (++iter >= _maxIter)
+            break;
+    }
+
+    if (_solverType == ColoredGaussSeidelSolver)
+    {
+        // with the kernel radius as cell size, cells of one color are more than two radii apart,
+        // so two constraints projected at the same time never share a particle
+        const Int *gs = pbfSystemData()->gridSize();
+        const auto &cellStart = pbfSystemData()->cellStart();
+        const auto &cellParticles = pbfSystemData()->cellParticles();
+        const UInt numOfCells = static_cast<UInt>(gs[0] * gs[1] * gs[2]);
+
+        solver.colorStart.assign(28, 0);
+        solver.colorCells.clear();
+        auto cellColor = [&](UInt cell) {
+            const Int x = cell % gs[0], y = (cell / gs[0]) % gs[1], z = cell / (gs[0] * gs[1]);
+            return static_cast<UInt>((z % 3) * 9 + (y % 3) * 3 + x % 3);
+        };
+        auto hasFluid = [&](UInt cell) {
+            for (UInt s = cellStart[cell]; s < cellStart[cell + 1]; ++s)
+                if (cellParticles[s] < n)
+                    return true;
+            return false;
+        };
+        for (UInt cell = 0; cell < numOfCells; ++cell)
+            if (hasFluid(cell))
+                solver.colorStart[cellColor(cell) + 1]++;
+        for (UInt c = 0; c < 27; ++c)
+            solver.colorStart[c + 1] += solver.colorStart[c];
+        solver.colorCells.resize(solver.colorStart[27]);
+        Vec_UInt cursor(solver.colorStart.begin(), solver.colorStart.end() - 1);
+        for (UInt cell = 0; cell < numOfCells; ++cell)
+            if (hasFluid(cell))
+                solver.colorCells[cursor[cellColor(cell)]++] = cell;
+
+        // projects the constraint of particle i and moves i and its fluid neighbors right away
+        auto projectConstraint = [&](UInt i) {
+            const float xi = px[i], yi = py[i], zi = pz[i];
+            float density = mass[i] * w0;
+            float gradCiX = 0.0f, gradCiY = 0.0f, gradCiZ = 0.0f;
+            float sumGradCj = 0.0f;
+
+            for (UInt k = start[i]; k < start[i + 1]; ++k)
+            {
+                const UInt j = indices[k];
+                const Vector3F r(xi - px[j], yi - py[j], zi - pz[j]);
+                density += mass[j] * mKernel(r);
+
+                const Vector3F gradCj = mass[j] / fd * mKernel.gradW(r);
+                gx[k] = gradCj.x;
+                gy[k] = gradCj.y;
+                gz[k] = gradCj.z;
+                gradCiX += gradCj.x;
+                gradCiY += gradCj.y;
+                gradCiZ += gradCj.z;
+                sumGradCj += gradCj.lengthSquared();
+            }
+
+            d[i] = density;
+
+            const float eps = 1.0e-6f;
+            const float constraint = std::max(density / fd - 1.0f, 0.0f);
+            err[i] = constraint;
+            lambda[i] = 0.0f;
+            if (constraint == 0.0f)
+                return;
+
+            sumGradCj += gradCiX * gradCiX + gradCiY * gradCiY + gradCiZ * gradCiZ;
+            const float li = -constraint / (sumGradCj + eps);
+            lambda[i] = li;
+
+            px[i] += li * gradCiX;
+            py[i] += li * gradCiY;
+            pz[i] += li * gradCiZ;
+            for (UInt k = start[i]; k < start[i + 1]; ++k)
+            {
+                const UInt j = indices[k];
+                if (j >= n)
+                    continue;
+                px[j] -= li * gx[k];
+                py[j] -= li * gy[k];
+                pz[j] -= li * gz[k];
+            }
+        };
+
+        while (true)
+        {
+            for (UInt c = 0; c < 27; ++c)
+            {
+                kiri_math::parallelFor(
+                    static_cast<size_t>(solver.colorStart[c]),
+                    static_cast<size_t>(solver.colorStart[c + 1]),
+                    [&](size_t t) {
+                        const UInt cell = solver.colorCells[t];
+                        for (UInt s = cellStart[cell]; s < cellStart[cell + 1]; ++s)
+                            if (cellParticles[s] < n)
+                                projectConstraint(cellParticles[s]);
+                    });
+            }
+
+            // the errors are measured during the sweep, right before each projection
+            float avgError, maxError;
+            reduceDensityError(avgError, maxError);
+            if (iter == 0)
+                _solverStats.initialAvgDensityError = avgError;
+            _solverStats.avgDensityError = avgError;
+            _solverStats.maxDensityError = maxError;
+            _solverStats.converged = avgError <= _densityErrorTolerance;
+
+            if (warmStart)
+            {
+                kiri_math::parallelFor(
+                    kiri_math::kZeroSize,
+                    n,
+                    [&](size_t i) {
+                        warm[i] += lambda[i];
+                    });
+            }
+
+            if ((_solverStats.converged && ++iter >= _minIter) || (!_solverStats.converged && ++iter >= _maxIter))
+                break;
+        }
     }
+    _solverStats.iterations = iter;
+
+    kiri_math::parallelFor(
+        kiri_math::kZeroSize,
+        n,
+        [&](size_t i) {
+            p[i] = Vector3F(px[i], py[i], pz[i]);
+        });
 }
 
 void KiriPBFSystem::velocityUpdateFirstOrder()
@@ -235,7 +575,7 @@ void KiriPBFSystem::computeXSPHViscosity()
         kiri_math::kZeroSize,
         n,
         [&](size_t i) {
-            const auto &neighbors = pbfSystemData()->neighborLists()[i];
+            const auto neighbors = pbfSystemData()->neighbors(i);
             Vector3F sum_value(0.0f);
             for (size_t j : neighbors)
             {
@@ -260,164 +600,62 @@ void KiriPBFSystem::computeVorticityConfinement()
     auto m = pbfSystemData()->masses();
     auto v = pbfSystemData()->velocities();
     auto d = pbfSystemData()->densities();
+    auto omega = pbfSystemData()->vorticities();
 
     float SphKernelRadius = pbfSystemData()->SphKernelRadius();
     const kiri_math::SphCubicKernel3F mKernel(SphKernelRadius);
 
-    Array1Vec3F deltaVelocity;
-    deltaVelocity.resize(n);
+    // the kernel gradients of the first pass are kept in the solver's pair cache for the second one
+    const UInt *start = pbfSystemData()->neighborStart().data();
+    const UInt *indices = pbfSystemData()->neighborIndices().data();
+    auto &solver = pbfSystemData()->solverData();
+    solver.resize(pbfSystemData()->NumOfParticles(), start[n]);
+    float *gx = solver.gradX.data(), *gy = solver.gradY.data(), *gz = solver.gradZ.data();
 
+    // vorticity of every fluid particle
     kiri_math::parallelFor(
         kiri_math::kZeroSize,
         n,
         [&](size_t i) {
-            const auto &neighbors = pbfSystemData()->neighborLists()[i];
-
-            Vector3F N(0.0f);
             Vector3F curl(0.0f);
-            Vector3F curlX(0.0f);
-            Vector3F curlY(0.0f);
-            Vector3F curlZ(0.0f);
-
-            for (size_t j : neighbors)
+            for (UInt k = start[i]; k < start[i + 1]; ++k)
             {
+                const UInt j = indices[k];
                 if (j >= n)
                     continue;
-                const Vector3F velGap = v[j] - v[i];
 
-                curl += velGap.cross(mKernel.gradW(p[i] - p[j]));
-                curlX += velGap.cross(mKernel.gradW(p[i] + Vector3F(0.01f, 0.0f, 0.0f) - p[j]));
-                curlY += velGap.cross(mKernel.gradW(p[i] + Vector3F(0.0f, 0.01f, 0.0f) - p[j]));
-                curlZ += velGap.cross(mKernel.gradW(p[i] + Vector3F(0.0f, 0.0f, 0.01f) - p[j]));
-            }
-
-            if (curl.x == curl.x || curl.y == curl.y || curl.z == curl.z)
-            {
-                float curlLen = curl.length();
-                N.x = curlX.length() - curlLen;
-                N.y = curlY.length() - curlLen;
-                N.z = curlZ.length() - curlLen;
-                N.normalize();
-
-                if (N.x == N.x || N.y == N.y || N.z == N.z)
-                {
-                    Vector3F force = 0.000010f * N.cross(curl);
-                    deltaVelocity[i] = _timeStep * force;
-                }
+                const Vector3F gradW = mKernel.gradW(p[i] - p[j]);
+                gx[k] = gradW.x;
+                gy[k] = gradW.y;
+                gz[k] = gradW.z;
+                curl += (v[j] - v[i]).cross(gradW);
             }
+            omega[i] = curl;
         });
 
+    // eta = grad |omega| from the stored vorticities, the force pushes towards higher vorticity
     kiri_math::parallelFor(
         kiri_math::kZeroSize,
         n,
         [&](size_t i) {
-            v[i] += deltaVelocity[i];
-        });
-}
-
-bool KiriPBFSystem::computeFluidDensity(
-    const size_t &particleIndex,
-    const size_t &numFluidParticle,
-    const ConstArrayAccessor1<Vector3F> &position,
-    const ConstArrayAccessor1<float> &mass,
-    const std::vector<size_t> &neighbors,
-    const float &SphKernelRadius,
-    const float &fluidDensity,
-    float &density_err,
-    float &density)
-{
-    const kiri_math::SphCubicKernel3F mKernel(SphKernelRadius);
-
-    density = mass[particleIndex] * mKernel.W_zero();
-    for (size_t j : neighbors)
-    {
-        if (j < numFluidParticle)
-        {
-            density += mass[j] * mKernel(position[particleIndex] - position[j]);
-        }
-        else
-        {
-            density += mass[j] * mKernel(position[particleIndex] - position[j]);
-        }
-    }
-
-    density_err = std::max(density, fluidDensity) - fluidDensity;
-    return true;
-}
-
-bool KiriPBFSystem::computeLagrangeMultiplier(
-    const size_t &particleIndex,
-    const size_t &numFluidParticle,
-    const ConstArrayAccessor1<Vector3F> &position,
-    const ConstArrayAccessor1<float> &mass,
-    const std::vector<size_t> &neighbors,
-    const float &density,
-    const float &SphKernelRadius,
-    const float &fluidDensity,
-    float &lambda)
-{
-    const kiri_math::SphCubicKernel3F mKernel(SphKernelRadius);
-
-    const float eps = 1.0e-6f;
-    const float constraint = std::max(density / fluidDensity - 1.0f, 0.0f);
-    if (constraint != 0.0f)
-    {
-        float sum_grad_cj = 0.0f;
-        Vector3F grad_ci(0.0f);
-        for (size_t j : neighbors)
-        {
-            if (j < numFluidParticle)
+            const float omegaLen = omega[i].length();
+            Vector3F eta(0.0f);
+            for (UInt k = start[i]; k < start[i + 1]; ++k)
             {
-                Vector3F grad_cj = mass[j] / fluidDensity * mKernel.gradW(position[particleIndex] - position[j]);
-                sum_grad_cj += pow(grad_cj.length(), 2.0f);
-                grad_ci += grad_cj;
+                const UInt j = indices[k];
+                if (j >= n)
+                    continue;
+
+                eta += (m[j] / d[j] * (omega[j].length() - omegaLen)) * Vector3F(gx[k], gy[k], gz[k]);
             }
-            else
+
+            const float etaLen = eta.length();
+            if (etaLen > MEpsilon<float>())
             {
-                Vector3F grad_cj = mass[j] / fluidDensity * mKernel.gradW(position[particleIndex] - position[j]);
-                sum_grad_cj += pow(grad_cj.length(), 2.0f);
-                grad_ci += grad_cj;
+                const Vector3F force = 0.000010f * (eta / etaLen).cross(omega[i]);
+                v[i] += _timeStep * force;
             }
-        }
-        sum_grad_cj += pow(grad_ci.length(), 2.0f);
-        lambda = -constraint / (sum_grad_cj + eps);
-    }
-    else
-        lambda = 0.0f;
-
-    return true;
-}
-
-bool KiriPBFSystem::solveDensityConstraint(
-    const size_t &particleIndex,
-    const size_t &numFluidParticle,
-    const ConstArrayAccessor1<Vector3F> &position,
-    const ConstArrayAccessor1<float> &mass,
-    const std::vector<size_t> &neighbors,
-    const ConstArrayAccessor1<float> &lambda,
-    const float &SphKernelRadius,
-    const float &fluidDensity,
-    Vector3F &deltaPos)
-{
-    const kiri_math::SphCubicKernel3F mKernel(SphKernelRadius);
-
-    deltaPos = Vector3F(0.0f);
-
-    for (size_t j : neighbors)
-    {
-        if (j < numFluidParticle)
-        {
-            Vector3F grad_cj = mass[j] / fluidDensity * mKernel.gradW(position[particleIndex] - position[j]);
-            deltaPos += (lambda[particleIndex] + lambda[j]) * grad_cj;
-        }
-        else
-        {
-            Vector3F grad_cj = mass[j] / fluidDensity * mKernel.gradW(position[particleIndex] - position[j]);
-            deltaPos += (lambda[particleIndex]) * grad_cj;
-        }
-    }
-
-    return true;
+        });
 }
 
 // --------------------------------PBF Calculation--------------------------------
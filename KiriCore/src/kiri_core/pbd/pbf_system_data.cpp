@@ -7,6 +7,19 @@
 
 #include <kiri_core/pbd/pbf_system_data.h>
 
+void KiriPBFSolverData::resize(size_t numOfParticles, size_t numOfPairs)
+{
+    posX.resize(numOfParticles);
+    posY.resize(numOfParticles);
+    posZ.resize(numOfParticles);
+
+    gradX.resize(numOfPairs);
+    gradY.resize(numOfPairs);
+    gradZ.resize(numOfPairs);
+
+    densityError.resize(numOfParticles);
+}
+
 KiriPBFSystemData::KiriPBFSystemData()
 {
     _lambdaIdx = addScalarData();
@@ -24,6 +37,7 @@ KiriPBFSystemData::KiriPBFSystemData()
     _lastPositionIdx = addVectorData();
 
     _deltaPositionIdx = addVectorData();
+    _vorticityIdx = addVectorData();
 
     _kernelRadius = 4.0f * mParticleRadius;
 }
@@ -83,6 +97,8 @@ void KiriPBFSystemData::addParticles(const Array1Vec3F &fluidPosition, const Arr
     resizeScalar(_lambdaIdx, _numOfFluidParticles);
     resizeScalar(_densityIdx, _numOfFluidParticles);
     resizeVector(_deltaPositionIdx, _numOfFluidParticles);
+    resizeVector(_vorticityIdx, _numOfFluidParticles);
+    mSolverData.warmLambdas.assign(_numOfFluidParticles, 0.0f);
 
     auto p = positions();
     auto v = velocities();
@@ -138,7 +154,7 @@ void KiriPBFSystemData::addParticles(const Array1Vec3F &fluidPosition, const Arr
             rp[i + _numOfFluidParticles] = boundaryPosition[i];
 
             // calculate boundary mass
-            const auto &neighbors = neighborLists()[i];
+            const auto neighbors = this->neighbors(i);
             float delta = mKernel.W_zero();
             for (size_t j : neighbors)
             {
@@ -301,6 +317,16 @@ ConstArrayAccessor1<Vector3F> KiriPBFSystemData::deltaPositions() const
     return vectorDataAt(_deltaPositionIdx);
 }
 
+ArrayAccessor1<Vector3F> KiriPBFSystemData::vorticities()
+{
+    return vectorDataAt(_vorticityIdx);
+}
+
+ConstArrayAccessor1<Vector3F> KiriPBFSystemData::vorticities() const
+{
+    return vectorDataAt(_vorticityIdx);
+}
+
 size_t KiriPBFSystemData::numOfFluidParticles() const
 {
     return _numOfFluidParticles;
@@ -361,67 +387,156 @@ ConstArrayAccessor1<Vector3F> KiriPBFSystemData::boundaryPositions() const
 
 // --------------------------------Getter Method--------------------------------
 
+KiriPBFSolverData &KiriPBFSystemData::solverData()
+{
+    return mSolverData;
+}
+
 // --------------------------------Neighbor Searcher Method--------------------------------
-const Array1<Vector3D> KiriPBFSystemData::cvtArrayF2D(ConstArrayAccessor1<Vector3F> list)
+const Vec_UInt &KiriPBFSystemData::cellStart() const
 {
-    Array1<Vector3D> arrayD;
-    for (size_t i = 0; i < list.size(); i++)
-    {
-        arrayD.append(Vector3D((double)list[i].x, (double)list[i].y, (double)list[i].z));
-    }
-    return arrayD;
+    return mCellStart;
 }
 
-const PointNeighborSearcher3Ptr &KiriPBFSystemData::neighborSearcher() const
+const Vec_UInt &KiriPBFSystemData::cellParticles() const
 {
-    return _neighborSearcher;
+    return mCellParticles;
 }
 
-void KiriPBFSystemData::SetNeighborSearcher(
-    const PointNeighborSearcher3Ptr &newNeighborSearcher)
+const Int *KiriPBFSystemData::gridSize() const
 {
-    _neighborSearcher = newNeighborSearcher;
+    return mGridSize;
 }
 
-const std::vector<std::vector<size_t>> &
-KiriPBFSystemData::neighborLists() const
+KiriPBFSystemData::NeighborRange KiriPBFSystemData::neighbors(size_t idx) const
 {
-    return _neighborLists;
+    const UInt *indices = mNeighbors.data();
+    return NeighborRange{indices + mNeighborStart[idx], indices + mNeighborStart[idx + 1]};
 }
 
-void KiriPBFSystemData::buildNeighborSearcher(double maxSearchRadius, ConstArrayAccessor1<Vector3F> list)
+const Vec_UInt &KiriPBFSystemData::neighborStart() const
 {
+    return mNeighborStart;
+}
 
-    // Use PointParallelHashGridSearcher3 by default
-    _neighborSearcher = std::make_shared<PointParallelHashGridSearcher3>(
-        kDefaultHashGridResolution,
-        kDefaultHashGridResolution,
-        kDefaultHashGridResolution,
-        2.0 * maxSearchRadius);
+const Vec_UInt &KiriPBFSystemData::neighborIndices() const
+{
+    return mNeighbors;
+}
 
-    _neighborSearcher->build(cvtArrayF2D(list).constAccessor());
+Int KiriPBFSystemData::cellCoord(float x, Int axis) const
+{
+    const Int c = static_cast<Int>(std::floor((x - mGridOrigin[axis]) / mGridCellSize));
+    return std::min(std::max(c, 0), mGridSize[axis] - 1);
 }
 
-void KiriPBFSystemData::buildNeighborLists(double maxSearchRadius, ConstArrayAccessor1<Vector3F> list)
+void KiriPBFSystemData::buildNeighborSearcher(float maxSearchRadius, ConstArrayAccessor1<Vector3F> list)
 {
-    _neighborLists.resize(list.size());
+    const size_t num = list.size();
+    mGridSize[0] = mGridSize[1] = mGridSize[2] = 0;
+    mCellStart.clear();
+    mParticleCell.resize(num);
+    mCellParticles.resize(num);
+    if (num == 0)
+        return;
+
+    Vector3F bMin = list[0], bMax = list[0];
+    for (size_t i = 1; i < num; ++i)
+    {
+        for (Int d = 0; d < 3; ++d)
+        {
+            bMin[d] = std::min(bMin[d], list[i][d]);
+            bMax[d] = std::max(bMax[d], list[i][d]);
+        }
+    }
+
+    // a query only has to look at the 27 cells around its own one
+    mGridOrigin = bMin;
+    mGridCellSize = std::max(maxSearchRadius, MEpsilon<float>());
 
-    auto points = list;
-    for (size_t i = 0; i < list.size(); ++i)
+    // a few particles thrown far away must not blow up the grid, larger cells are still correct
+    const double maxNumOfCells = 8.0 * num + 4096.0;
+    while (true)
     {
-        Vector3D origin((double)points[i].x, (double)points[i].y, (double)points[i].z);
-        _neighborLists[i].clear();
-
-        _neighborSearcher->forEachNearbyPoint(
-            origin,
-            maxSearchRadius,
-            [&](size_t j, const Vector3D &) {
-                if (i != j)
+        double cells = 1.0;
+        for (Int d = 0; d < 3; ++d)
+            cells *= std::floor((bMax[d] - bMin[d]) / mGridCellSize) + 1.0;
+        if (cells <= maxNumOfCells || !std::isfinite(cells))
+            break;
+        mGridCellSize *= 2.0f;
+    }
+
+    for (Int d = 0; d < 3; ++d)
+        mGridSize[d] = static_cast<Int>(std::floor((bMax[d] - bMin[d]) / mGridCellSize)) + 1;
+
+    const UInt numOfCells = static_cast<UInt>(mGridSize[0] * mGridSize[1] * mGridSize[2]);
+    kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                           [&](size_t i) {
+                               const auto &p = list[i];
+                               mParticleCell[i] = static_cast<UInt>((cellCoord(p.z, 2) * mGridSize[1] + cellCoord(p.y, 1)) * mGridSize[0] + cellCoord(p.x, 0));
+                           });
+
+    mCellStart.assign(numOfCells + 1, 0);
+    for (size_t i = 0; i < num; ++i)
+        mCellStart[mParticleCell[i] + 1]++;
+    for (UInt c = 0; c < numOfCells; ++c)
+        mCellStart[c + 1] += mCellStart[c];
+
+    // stable, every cell keeps its particles in index order
+    Vec_UInt cursor(mCellStart.begin(), mCellStart.end() - 1);
+    for (size_t i = 0; i < num; ++i)
+        mCellParticles[cursor[mParticleCell[i]]++] = static_cast<UInt>(i);
+}
+
+void KiriPBFSystemData::buildNeighborLists(float maxSearchRadius, ConstArrayAccessor1<Vector3F> list)
+{
+    const size_t num = list.size();
+    mNeighborStart.resize(num + 1);
+    mNeighborStart[0] = 0;
+    if (num == 0 || mCellStart.empty())
+    {
+        std::fill(mNeighborStart.begin(), mNeighborStart.end(), 0);
+        mNeighbors.clear();
+        return;
+    }
+
+    const float radius2 = maxSearchRadius * maxSearchRadius;
+    auto forEachNeighbor = [&](size_t i, auto &&func) {
+        const auto &origin = list[i];
+        const Int cell = static_cast<Int>(mParticleCell[i]);
+        const Int x = cell % mGridSize[0], y = (cell / mGridSize[0]) % mGridSize[1], z = cell / (mGridSize[0] * mGridSize[1]);
+        for (Int nz = std::max(z - 1, 0); nz <= std::min(z + 1, mGridSize[2] - 1); ++nz)
+        {
+            for (Int ny = std::max(y - 1, 0); ny <= std::min(y + 1, mGridSize[1] - 1); ++ny)
+            {
+                const UInt row = static_cast<UInt>((nz * mGridSize[1] + ny) * mGridSize[0]);
+                const UInt first = mCellStart[row + std::max(x - 1, 0)], last = mCellStart[row + std::min(x + 1, mGridSize[0] - 1) + 1];
+                for (UInt k = first; k < last; ++k)
                 {
-                    _neighborLists[i].push_back(j);
+                    const UInt j = mCellParticles[k];
+                    if (j != i && (list[j] - origin).lengthSquared() <= radius2)
+                        func(j);
                 }
-            });
-    }
+            }
+        }
+    };
+
+    kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                           [&](size_t i) {
+                               UInt count = 0;
+                               forEachNeighbor(i, [&](UInt) { ++count; });
+                               mNeighborStart[i + 1] = count;
+                           });
+
+    for (size_t i = 0; i < num; ++i)
+        mNeighborStart[i + 1] += mNeighborStart[i];
+
+    mNeighbors.resize(mNeighborStart[num]);
+    kiri_math::parallelFor(kiri_math::kZeroSize, num,
+                           [&](size_t i) {
+                               UInt *out = mNeighbors.data() + mNeighborStart[i];
+                               forEachNeighbor(i, [&](UInt j) { *out++ = j; });
+                           });
 }
 
-// --------------------------------Neighbor Searcher Method--------------------------------
\ No newline at end of file
+// --------------------------------Neighbor Searcher Method--------------------------------
@@ -9,6 +9,10 @@
  */
 
 #include <kiri_core/sampler/kiri_sampler_basic.h>
+#include <atomic>
+#include <cstring>
+#include <tuple>
+#include <unordered_map>
 
 KiriSamplerBasic::KiriSamplerBasic()
 {
@@ -473,52 +477,101 @@ bool KiriSamplerBasic::AkinciTriangleSampling(const Vector3F &Point1, const Vect
 
 bool KiriSamplerBasic::AkinciMeshSampling(const KiriMeshTriangle *Mesh, const float &Radius, Array1Vec4F &Samples)
 {
-    bool success = true, tmp_success = false;
+    return AkinciMeshSampling(Mesh->vertices(), Mesh->triangles(), Radius, Samples);
+}
 
-    //Sample Vertices
-    Array1Vec3F tmp_sample;
-    for (size_t i = 0; i < Mesh->vertices().size(); ++i)
-    {
-        bool contains = false;
-        tmp_sample.forEach([&](Vector3F elem) {
-            if (elem == Vector3F(Mesh->vertices()[i].x, Mesh->vertices()[i].y, Mesh->vertices()[i].z))
-                contains = true;
-        });
+bool KiriSamplerBasic::AkinciMeshSampling(const Array1Vec3F &Vertices, const Array1Vec3F &Triangles, const float &Radius, Array1Vec4F &Samples)
+{
+    const size_t first = Samples.size();
 
-        if (!contains)
+    // weld vertices with equal positions, split vertices (normals, uvs) would otherwise sample their edges twice
+    auto positionKey = [](const Vector3F &p) {
+        // +0.f turns -0 into 0
+        UInt bits[3];
+        for (Int d = 0; d < 3; ++d)
         {
-            tmp_sample.append(Vector3F(Mesh->vertices()[i].x, Mesh->vertices()[i].y, Mesh->vertices()[i].z));
-            Samples.append(Vector4F(Mesh->vertices()[i].x, Mesh->vertices()[i].y, Mesh->vertices()[i].z, Radius));
+            const float v = p[d] + 0.f;
+            std::memcpy(&bits[d], &v, sizeof(float));
         }
-    }
-
-    //Sample edges
-    tmp_sample.clear();
-    Array1<std::pair<Int, Int>> edges;
-    Mesh->GetEdges(edges);
-    for (size_t i = 0; i < edges.size(); ++i)
+        return std::make_tuple(bits[0], bits[1], bits[2]);
+    };
+    struct PositionHash
     {
-        tmp_success = AkinciEdgeSampling(Mesh->vertices()[edges[i].first], Mesh->vertices()[edges[i].second], Radius, tmp_sample);
-        for (size_t j = 0; j < tmp_sample.size(); ++j)
+        size_t operator()(const std::tuple<UInt, UInt, UInt> &k) const
         {
-            Vector4F p(tmp_sample[j].x, tmp_sample[j].y, tmp_sample[j].z, Radius);
-            Samples.append(p);
+            return (static_cast<size_t>(std::get<0>(k)) * 73856093u) ^ (static_cast<size_t>(std::get<1>(k)) * 19349663u) ^ (static_cast<size_t>(std::get<2>(k)) * 83492791u);
         }
+    };
 
-        success = success && tmp_success;
+    std::unordered_map<std::tuple<UInt, UInt, UInt>, UInt, PositionHash> welded;
+    welded.reserve(Vertices.size());
+    Vec_UInt weldedIdx(Vertices.size());
+    Array1Vec3F points;
+    for (size_t i = 0; i < Vertices.size(); ++i)
+    {
+        auto ret = welded.emplace(positionKey(Vertices[i]), static_cast<UInt>(points.size()));
+        if (ret.second)
+            points.append(Vertices[i]);
+        weldedIdx[i] = ret.first->second;
     }
 
-    //Sample triangles
-    tmp_sample.clear();
-    for (size_t i = 0; i < Mesh->triangles().size(); ++i)
+    // unique edges of the welded mesh
+    Vec_UInt64 edges;
+    edges.reserve(Triangles.size() * 3);
+    for (size_t i = 0; i < Triangles.size(); ++i)
     {
-        tmp_success = AkinciTriangleSampling(Mesh->vertices()[Mesh->triangles()[i][0]], Mesh->vertices()[Mesh->triangles()[i][1]], Mesh->vertices()[Mesh->triangles()[i][2]], Radius, tmp_sample);
-        for (size_t j = 0; j < tmp_sample.size(); ++j)
-            Samples.append(Vector4F(tmp_sample[j].x, tmp_sample[j].y, tmp_sample[j].z, Radius));
-        success = success && tmp_success;
+        for (Int e = 0; e < 3; ++e)
+        {
+            const UInt a = weldedIdx[(Int)Triangles[i][e]], b = weldedIdx[(Int)Triangles[i][(e + 1) % 3]];
+            if (a != b)
+                edges.emplace_back((static_cast<UInt64>(std::min(a, b)) << 32) | std::max(a, b));
+        }
     }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // every item is sampled once into its own buffer, the buffers are concatenated into the output resized once;
+    // vertices come first, then edges, then triangles
+    const size_t numOfItems = points.size() + edges.size() + Triangles.size();
+    std::atomic<bool> success(true);
+    auto sampleItem = [&](size_t item, Array1Vec3F &out) {
+        if (item < points.size())
+        {
+            out.append(points[item]);
+            return;
+        }
+
+        item -= points.size();
+        bool ok;
+        if (item < edges.size())
+            ok = AkinciEdgeSampling(points[edges[item] >> 32], points[edges[item] & 0xffffffffull], Radius, out);
+        else
+        {
+            item -= edges.size();
+            ok = AkinciTriangleSampling(points[weldedIdx[(Int)Triangles[item][0]]], points[weldedIdx[(Int)Triangles[item][1]]], points[weldedIdx[(Int)Triangles[item][2]]], Radius, out);
+        }
+
+        if (!ok)
+            success = false;
+    };
 
-    KIRI_LOG_INFO("Vertex Number={0:d}", Mesh->vertices().size());
-    KIRI_LOG_INFO("Sampling Points Number={0:d}", Samples.size());
+    Vector<Array1Vec3F> itemSamples(numOfItems);
+    kiri_math::parallelFor(kiri_math::kZeroSize, numOfItems, [&](size_t i) {
+        sampleItem(i, itemSamples[i]);
+    });
+
+    Vec_UInt offset(numOfItems + 1, 0);
+    for (size_t i = 0; i < numOfItems; ++i)
+        offset[i + 1] = offset[i] + static_cast<UInt>(itemSamples[i].size());
+
+    Samples.resize(first + offset[numOfItems]);
+    kiri_math::parallelFor(kiri_math::kZeroSize, numOfItems, [&](size_t i) {
+        const Array1Vec3F &out = itemSamples[i];
+        for (size_t j = 0; j < out.size(); ++j)
+            Samples[first + offset[i] + j] = Vector4F(out[j].x, out[j].y, out[j].z, Radius);
+    });
+
+    KIRI_LOG_INFO("Vertex Number={0:d}, Welded={1:d}, Edges={2:d}", Vertices.size(), points.size(), edges.size());
+    KIRI_LOG_INFO("Sampling Points Number={0:d}", Samples.size() - first);
     return success;
-}
\ No newline at end of file
+}
@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <functional>
 #include <kiri_pbs_cuda/data/cuda_sph_params.h>
 #include <kiri_pbs_cuda/data/cuda_boundary_params.h>
 #include <kiri_pbs_cuda/particle/cuda_sph_particles.cuh>
@@ -32,6 +33,9 @@ namespace KIRI
 
         virtual ~CudaBaseSolver() noexcept {}
 
+        // the system sorts the fluids and builds their cell start before every step only if the solver reads them
+        virtual bool NeedsSortedFluids() const { return true; }
+
     protected:
         virtual void Advect(
             CudaSphParticlesPtr &fluids,
@@ -46,6 +50,9 @@ namespace KIRI
     };
 
     typedef SharedPtr<CudaBaseSolver> CudaBaseSolverPtr;
+
+    // creates a solver for the given number of particles
+    typedef std::function<CudaBaseSolverPtr(const uint)> CudaSolverFactory;
 } // namespace KIRI
 
 #endif
\ No newline at end of file
@@ -25,6 +25,31 @@ namespace KIRI
         float3 world_center;
         int3 grid_size;
 
+        // 1 for axes on which the fluid leaving the box enters again on the other side, the boundary particles
+        // of those walls have to be left out. a periodic axis needs at least three grid cells
+        int3 periodic = make_int3(0, 0, 0);
+
+        // domain length on the periodic axes, 0 on the closed ones
+        float3 PeriodicLength() const
+        {
+            const float3 size = highest_point - lowest_point;
+            return make_float3(
+                periodic.x ? size.x : 0.f,
+                periodic.y ? size.y : 0.f,
+                periodic.z ? size.z : 0.f);
+        }
+
+        // 1 for axes whose lower wall is a symmetry plane, only the upper half of the scene is sampled and the
+        // plane itself carries no boundary particles. the SPH and WCSPH kernels add the mirror images of the
+        // particles near the plane; CudaSphSystem rejects a symmetric axis which is also periodic, and symmetry
+        // together with adaptive resolution or the PBF solver, which have no mirror terms
+        int3 symmetric = make_int3(0, 0, 0);
+
+        // bit 0 for x, 1 for y and 2 for z
+        uint SymmetryMask() const
+        {
+            return (symmetric.x ? 1u : 0u) | (symmetric.y ? 2u : 0u) | (symmetric.z ? 4u : 0u);
+        }
     };
 
     extern CudaBoundaryParams CUDA_BOUNDARY_PARAMS;
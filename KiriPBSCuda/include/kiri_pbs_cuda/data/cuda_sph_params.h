@@ -16,6 +16,15 @@
 
 namespace KIRI
 {
+    // kick-drift-kick leapfrog and velocity verlet give the same trajectory when the forces are evaluated once per step,
+    // leapfrog carries the half step velocity between steps and verlet the last acceleration
+    enum class IntegratorType
+    {
+        SemiImplicitEuler,
+        Leapfrog,
+        VelocityVerlet
+    };
+
     struct CudaSphParams
     {
 
@@ -30,9 +39,55 @@ namespace KIRI
         float nu;
         float bnu;
 
+        // fluid-fluid viscosity solved implicitly by conjugate gradient, the boundary friction stays explicit
+        bool implicit_visc = false;
+        uint visc_max_iterations = 50;
+        float visc_tolerance = 1e-4f;
+
         float3 gravity;
 
         float dt;
+        IntegratorType integrator = IntegratorType::SemiImplicitEuler;
+
+        // stable sort, atomic free cell counting and fixed order reductions
+        bool deterministic = false;
+
+        // print CudaSphSystem::StateHash every n steps, 0 never prints
+        uint state_hash_interval = 0;
+
+        // particles slower than sleep_velocity and with less than sleep_acceleration fall asleep,
+        // they skip the force evaluation and advection until a particle in a neighbor cell moves
+        bool sleeping = false;
+        float sleep_velocity = 0.01f;
+        float sleep_acceleration = 0.1f;
+
+        // wcsph only: dt is the finest step, particles whose own CFL limit allows it are updated every 2^level steps
+        // up to local_dt_levels - 1 and drift in between. replaces sleeping and uses the explicit viscosity
+        bool local_dt = false;
+        uint local_dt_levels = 4;
+        float local_dt_cfl = 0.4f;
+
+        // wcsph only: particles near the free surface or inside the region of interest keep rest_mass, deeper ones
+        // merge pairwise up to adaptive_max_level times (mass rest_mass * 2^level, kernel radius scaled by the cube root).
+        // every adaptive_band cells away from the surface allow one more level, the adaptation runs every
+        // adaptive_interval steps, particles below adaptive_surface_density * rest_density count as surface
+        // on periodic axes the largest kernel radius has to stay below half of the period.
+        // the adaptive forces only have the explicit laminar viscosity, implicit_visc and atf_visc are rejected.
+        // rest_mass is the finest resolution: every particle starts and is emitted with it and a split never goes
+        // below it, so the scene has to be sampled at the finest spacing it needs. rest_mass cannot change while
+        // adaptive is on
+        bool adaptive = false;
+        uint adaptive_max_level = 3;
+        uint adaptive_band = 2;
+        uint adaptive_interval = 10;
+        float adaptive_surface_density = 0.9f;
+        float3 adaptive_roi_lower = make_float3(0.f);
+        float3 adaptive_roi_upper = make_float3(-1.f);
+
+        // position based fluids, the relaxation is added to the denominator of the multipliers
+        uint pbf_iterations = 4;
+        float pbf_relaxation = 100.f;
+        float pbf_xsph = 0.01f;
     };
 
     struct CudaSphAppParams
@@ -22,17 +22,22 @@ namespace KIRI
 		explicit CudaBoundaryParticles::CudaBoundaryParticles(
 			const Vec_Float3 &p)
 			: CudaParticles(p),
-			  mVolume(p.size()) {}
+			  mVolume(p.size()),
+			  bPrepared(false) {}
 
 		CudaBoundaryParticles(const CudaBoundaryParticles &) = delete;
 		CudaBoundaryParticles &operator=(const CudaBoundaryParticles &) = delete;
 
 		float *GetVolumePtr() const { return mVolume.Data(); }
 
+		bool IsPrepared() const { return bPrepared; }
+		void SetPrepared() { bPrepared = true; }
+
 		virtual ~CudaBoundaryParticles() noexcept {}
 
 	protected:
 		CudaArray<float> mVolume;
+		bool bPrepared;
 	};
 
 	typedef SharedPtr<CudaBoundaryParticles> CudaBoundaryParticlesPtr;
@@ -19,20 +19,25 @@ namespace KIRI
     class CudaParticles
     {
     public:
-        explicit CudaParticles(const Vec_Float3 &p) : mPos(p.size())
+        explicit CudaParticles(const Vec_Float3 &p, const uint maxNumOfParticles = 0)
+            : mPos(max(static_cast<uint>(p.size()), maxNumOfParticles)),
+              mNumOfParticles(p.size())
         {
-            KIRI_CUCALL(cudaMemcpy(mPos.Data(), &p[0], sizeof(float3) * p.size(), cudaMemcpyHostToDevice));
+            if (!p.empty())
+                KIRI_CUCALL(cudaMemcpy(mPos.Data(), &p[0], sizeof(float3) * p.size(), cudaMemcpyHostToDevice));
         }
 
         CudaParticles(const CudaParticles &) = delete;
         CudaParticles &operator=(const CudaParticles &) = delete;
 
-        uint Size() const { return mPos.Length(); }
+        uint Size() const { return mNumOfParticles; }
+        uint MaxSize() const { return mPos.Length(); }
         float3 *GetPosPtr() const { return mPos.Data(); }
         virtual ~CudaParticles() noexcept {}
 
     protected:
         CudaArray<float3> mPos;
+        uint mNumOfParticles;
     };
 
     typedef SharedPtr<CudaParticles> CudaParticlesPtr;
@@ -0,0 +1,96 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-26 18:10:25
+ * @LastEditTime: 2021-02-26 22:47:03
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\particle\cuda_sph_emitter.cuh
+ */
+
+#ifndef _CUDA_SPH_EMITTER_CUH_
+#define _CUDA_SPH_EMITTER_CUH_
+
+#pragma once
+
+#include <kiri_pbs_cuda/particle/cuda_sph_particles.cuh>
+
+namespace KIRI
+{
+    // poisson disk layers of a disc or a rectangle, cut from one periodic tile with different shifts
+    struct CudaEmitterPattern
+    {
+        explicit CudaEmitterPattern(const uint num) : offsets(max(num, 1u)) {}
+
+        CudaArray<float2> offsets;
+        Vector<uint> layerStart;
+
+        uint NumOfLayers() const { return static_cast<uint>(layerStart.size()) - 1; }
+        uint LayerSize(const uint layer) const { return layerStart[layer + 1] - layerStart[layer]; }
+    };
+
+    typedef SharedPtr<const CudaEmitterPattern> CudaEmitterPatternPtr;
+
+    // emits a new layer every time the fluid has moved one spacing away from the emitter plane (SphDynamicEmitterPDS).
+    // the pattern is sampled and uploaded once per shape and shared by all emitters with the same shape,
+    // an emission is a single transform on the device
+    class CudaSphEmitter
+    {
+    public:
+        CudaSphEmitter(
+            const float3 position,
+            const float3 velocity,
+            const float3 color,
+            const float particleRadius,
+            const bool squareShaped,
+            const float emitRadius,
+            const float emitWidth = 0.f,
+            const float emitHeight = 0.f,
+            const uint seed = 1);
+
+        CudaSphEmitter(const CudaSphEmitter &) = delete;
+        CudaSphEmitter &operator=(const CudaSphEmitter &) = delete;
+
+        // returns the number of emitted particles, stops silently when the capacity of fluids is reached
+        uint Emit(CudaSphParticlesPtr &fluids, const float dt, const float mass);
+
+        void SetEnable(const bool enable) { bEnable = enable; }
+        bool IsEnabled() const { return bEnable; }
+
+        void SetPosition(const float3 position) { mPosition = position; }
+        float3 GetPosition() const { return mPosition; }
+        float3 GetVelocity() const { return mVelocity; }
+
+        uint NumOfEmitted() const { return mNumOfEmitted; }
+        const CudaEmitterPatternPtr &GetPattern() const { return mPattern; }
+
+        // sampled patterns are kept until this is called
+        static void ClearPatternCache();
+
+        ~CudaSphEmitter() noexcept {}
+
+    private:
+        float3 mPosition;
+        float3 mVelocity;
+        float3 mColor;
+        float3 mAxisU, mAxisV, mDirection;
+        float mSpacing;
+        float mDistance;
+        uint mLayer;
+        uint mNumOfEmitted;
+        bool bEnable;
+
+        CudaEmitterPatternPtr mPattern;
+
+        static CudaEmitterPatternPtr GetPattern(
+            const bool squareShaped,
+            const float emitRadius,
+            const float emitWidth,
+            const float emitHeight,
+            const float spacing,
+            const uint seed);
+    };
+
+    typedef SharedPtr<CudaSphEmitter> CudaSphEmitterPtr;
+} // namespace KIRI
+
+#endif
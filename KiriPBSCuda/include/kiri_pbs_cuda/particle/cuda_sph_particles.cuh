@@ -13,6 +13,7 @@
 #pragma once
 
 #include <kiri_pbs_cuda/particle/cuda_particles.cuh>
+#include <kiri_pbs_cuda/data/cuda_sph_params.h>
 
 namespace KIRI
 {
@@ -21,16 +22,24 @@ namespace KIRI
 	public:
 		explicit CudaSphParticles::CudaSphParticles(
 			const Vec_Float3 &p,
-			const Vec_Float3 &col)
-			: CudaParticles(p),
-			  mVel(p.size()),
-			  mAcc(p.size()),
-			  mCol(p.size()),
-			  mPressure(p.size()),
-			  mDensity(p.size()),
-			  mMass(p.size())
+			const Vec_Float3 &col,
+			const uint maxNumOfParticles = 0)
+			: CudaParticles(p, maxNumOfParticles),
+			  mVel(MaxSize()),
+			  mAcc(MaxSize()),
+			  mCol(MaxSize()),
+			  mPressure(MaxSize()),
+			  mDensity(MaxSize()),
+			  mMass(MaxSize()),
+			  mSmoothingLength(MaxSize()),
+			  mLabel(MaxSize()),
+			  mActive(MaxSize()),
+			  mIntegratorState(MaxSize())
 		{
-			KIRI_CUCALL(cudaMemcpy(mCol.Data(), &col[0], sizeof(float3) * col.size(), cudaMemcpyHostToDevice));
+			if (!col.empty())
+				KIRI_CUCALL(cudaMemcpy(mCol.Data(), &col[0], sizeof(float3) * col.size(), cudaMemcpyHostToDevice));
+
+			thrust::fill(thrust::device, mActive.Data(), mActive.Data() + MaxSize(), 1u);
 		}
 
 		CudaSphParticles(const CudaSphParticles &) = delete;
@@ -42,10 +51,76 @@ namespace KIRI
 		float *GetPressurePtr() const { return mPressure.Data(); }
 		float *GetDensityPtr() const { return mDensity.Data(); }
 		float *GetMassPtr() const { return mMass.Data(); }
+		float *GetSmoothingLengthPtr() const { return mSmoothingLength.Data(); }
+		uint *GetLabelPtr() const { return mLabel.Data(); }
+		uint *GetActivePtr() const { return mActive.Data(); }
+		float4 *GetIntegratorStatePtr() const { return mIntegratorState.Data(); }
 
 		virtual ~CudaSphParticles() noexcept {}
 
-		void Advect(const float dt);
+		// one fused pass over position, velocity and acceleration,
+		// sleeping particles keep their position and velocity when onlyActive is set.
+		// the second order schemes store the velocity predicted for the end of the step,
+		// so the forces of the next step see synchronized velocities
+		void Advect(
+			const float dt,
+			const bool onlyActive = false,
+			const IntegratorType integrator = IntegratorType::SemiImplicitEuler);
+
+		// the next step starts the second order schemes from the current velocities, e.g. after the integrator changed
+		void ResetIntegratorState();
+
+		// replace the active particles by host data, the other per-particle quantities are reset
+		void SetParticles(
+			const Vec_Float3 &pos,
+			const Vec_Float3 &vel,
+			const Vec_Float3 &col,
+			const Vector<uint> &label,
+			const float mass);
+
+		// same as above, but mass, kernel radius, active flag and integrator state come from the host as well,
+		// e.g. for particles which migrated from another rank
+		void SetParticles(
+			const Vec_Float3 &pos,
+			const Vec_Float3 &vel,
+			const Vec_Float3 &col,
+			const Vector<uint> &label,
+			const Vector<float> &mass,
+			const Vector<float> &smoothingLength,
+			const Vector<uint> &active,
+			const Vector<float4> &integratorState);
+
+		// appends num particles at origin + offset.x * axisU + offset.y * axisV behind the current ones,
+		// the offsets stay on the device, returns the number of particles which fit into the capacity
+		uint AppendParticles(
+			const float2 *offsets,
+			const uint num,
+			const float3 origin,
+			const float3 axisU,
+			const float3 axisV,
+			const float3 vel,
+			const float3 col,
+			const float mass);
+
+		// makes room for num particles behind the current ones, the caller fills their data.
+		// returns the number of particles which fit into the capacity
+		uint Extend(const uint num);
+
+		// compacts every per-particle array, drops the particles with a non zero flag and returns the new size
+		uint RemoveParticles(const uint *removed);
+
+		void GetParticles(
+			Vec_Float3 &pos,
+			Vec_Float3 &vel,
+			Vec_Float3 &col,
+			Vector<uint> &label) const;
+
+		// the state which SetParticles with host vectors restores
+		void GetParticleState(
+			Vector<float> &mass,
+			Vector<float> &smoothingLength,
+			Vector<uint> &active,
+			Vector<float4> &integratorState) const;
 
 	protected:
 		CudaArray<float3> mVel;
@@ -54,6 +129,19 @@ namespace KIRI
 		CudaArray<float> mPressure;
 		CudaArray<float> mDensity;
 		CudaArray<float> mMass;
+
+		// kernel radius of the particle, 0 means the kernel radius of the scene
+		CudaArray<float> mSmoothingLength;
+
+		// user label which follows the particle through sorting, e.g. halo flag for domain decomposition
+		CudaArray<uint> mLabel;
+
+		// 1 for particles which are simulated, 0 for sleeping ones
+		CudaArray<uint> mActive;
+
+		// half step velocity (leapfrog) or last acceleration (verlet) in xyz, w is 0 until the first step
+		// after the particle was set, the first step then assumes a constant acceleration
+		CudaArray<float4> mIntegratorState;
 	};
 
 	typedef SharedPtr<CudaSphParticles> CudaSphParticlesPtr;
@@ -0,0 +1,52 @@
+/*** 
+ * @Author: Xu.WANG
+ * @Date: 2021-02-26 13:20:41
+ * @LastEditTime: 2021-02-26 18:02:15
+ * @LastEditors: Xu.WANG
+ * @Description: grid accelerated parallel poisson disk sampling
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\particle\particles_sampler_poisson.h
+ * @Reference: Wei, Parallel Poisson Disk Sampling, SIGGRAPH 2008
+ */
+
+#ifndef _PARTICLES_SAMPLER_POISSON_H_
+#define _PARTICLES_SAMPLER_POISSON_H_
+
+#pragma once
+
+#include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
+
+// dart throwing on a background grid whose cells hold at most one sample, cells three apart never see each other,
+// so the 3^d phase groups are sampled one after another and the cells of one group in parallel.
+// every candidate only depends on (seed, cell, trial), the result does not depend on the number of threads
+class ParticlesSamplerPoisson
+{
+public:
+    explicit ParticlesSamplerPoisson(const uint seed = 0, const uint numOfTrials = 30);
+
+    // every pair of samples inside [lower, upper] is at least minDistance apart
+    std::vector<float3> GetBoxSampling(float3 lower, float3 upper, float minDistance);
+
+    // periodic tile of at least minSize, the real size is returned in size,
+    // copies of the tile placed side by side keep the minimum distance across the seams
+    std::vector<float2> GetTileSampling(float2 minSize, float minDistance, float2 &size);
+
+    uint GetSeed() const { return mSeed; }
+
+private:
+    uint mSeed;
+    uint mNumOfTrials;
+    uint mNumOfThreads;
+
+    void Sampling(
+        const int dim,
+        const int n[3],
+        const float cellSize,
+        const float extent[3],
+        const bool periodic,
+        const float minDistance,
+        std::vector<float> &samples);
+};
+
+typedef std::shared_ptr<ParticlesSamplerPoisson> ParticlesSamplerPoissonPtr;
+
+#endif
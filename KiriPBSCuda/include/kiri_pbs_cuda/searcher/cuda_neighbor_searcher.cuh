@@ -45,19 +45,25 @@ namespace KIRI
 
         void BuildGNSearcher(const CudaParticlesPtr &particles);
 
+        void SetDeterministic(const bool deterministic) { bDeterministic = deterministic; }
+
     protected:
-        const uint mCudaGridSize;
         const int3 mGridSize;
         const float mCellSize;
         const float3 mLowestPoint;
         const float3 mHighestPoint;
         const uint mNumOfGridCells;
-        const uint mNumOfParticles;
+        const uint mMaxNumOfParticles;
+
+        bool bDeterministic = false;
 
         CudaArray<uint> mGridIdxArray;
         CudaArray<uint> mCellStart;
 
         virtual void SortData(const CudaParticlesPtr &particles) = 0;
+
+        // cell start of the first num sorted keys in mGridIdxArray
+        void BuildCellStart(const uint num);
     };
 
     class CudaGNSearcher final : public CudaGNBaseSearcher
@@ -74,8 +80,66 @@ namespace KIRI
 
         virtual ~CudaGNSearcher() noexcept {}
 
+        // fraction of particles allowed to change cell before falling back to a full sort, 0 (default) disables the
+        // incremental path. it is still O(N) with more passes than the full sort and has not been benchmarked against it
+        void SetIncrementalSortThreshold(const float threshold) { mIncrementalSortThreshold = threshold; }
+        uint GetNumOfChangedParticles() const { return mNumOfChanged; }
+
+    protected:
+        virtual void SortData(const CudaParticlesPtr &particles) override final;
+
+    private:
+        float mIncrementalSortThreshold;
+        bool bHasSortedKeys;
+        uint mNumOfSorted;
+        uint mNumOfChanged;
+
+        // sorted keys of the last build, the particles are still stored in that order
+        CudaArray<uint> mSortedGridIdx;
+        CudaArray<uint> mSortIdx;
+        CudaArray<uint> mMergedIdx;
+        CudaArray<uint> mScratchUInt;
+        CudaArray<float> mScratchFloat;
+        CudaArray<float3> mScratchFloat3;
+        CudaArray<float4> mScratchFloat4;
+
+        void FullSort(const CudaSphParticlesPtr &fluids);
+        void IncrementalSort(const CudaSphParticlesPtr &fluids, const uint numOfUnchanged);
+    };
+
+    // only the indices are sorted by cell, the particle data stays in place. used for positions which
+    // are not stored in particles, e.g. the predicted positions of the pbf solver
+    class CudaGNIndexSearcher final : public CudaGNBaseSearcher
+    {
+    public:
+        explicit CudaGNIndexSearcher(
+            const float3 lp,
+            const float3 hp,
+            const uint num,
+            const float cellSize);
+
+        CudaGNIndexSearcher(const CudaGNIndexSearcher &) = delete;
+        CudaGNIndexSearcher &operator=(const CudaGNIndexSearcher &) = delete;
+
+        virtual ~CudaGNIndexSearcher() noexcept {}
+
+        using CudaGNBaseSearcher::BuildGNSearcher;
+        // positions outside the box on a periodic axis are hashed into the cell they wrap to
+        void BuildGNSearcher(const float3 *pos, const uint size, const float3 period);
+
+        // cell of every particle in the original order
+        uint *GetCellIdxPtr() const { return mCellIdx.Data(); }
+        // particle indices sorted by cell, the cell start points into this array
+        uint *GetSortedIdxPtr() const { return mSortedIdx.Data(); }
+
     protected:
         virtual void SortData(const CudaParticlesPtr &particles) override final;
+
+    private:
+        CudaArray<uint> mCellIdx;
+        CudaArray<uint> mSortedIdx;
+
+        void SortIndices(const uint num);
     };
 
     class CudaGNBoundarySearcher final : public CudaGNBaseSearcher
@@ -98,6 +162,7 @@ namespace KIRI
 
     typedef SharedPtr<CudaGNBaseSearcher> CudaGNBaseSearcherPtr;
     typedef SharedPtr<CudaGNSearcher> CudaGNSearcherPtr;
+    typedef SharedPtr<CudaGNIndexSearcher> CudaGNIndexSearcherPtr;
     typedef SharedPtr<CudaGNBoundarySearcher> CudaGNBoundarySearcherPtr;
 } // namespace KIRI
 
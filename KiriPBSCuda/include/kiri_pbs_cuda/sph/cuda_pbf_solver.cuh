@@ -0,0 +1,110 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-27 13:05:41
+ * @LastEditTime: 2021-02-27 18:22:10
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\sph\cuda_pbf_solver.cuh
+ * @Reference: Macklin and Mueller, Position Based Fluids, SIGGRAPH 2013
+ */
+
+#ifndef _CUDA_PBF_SOLVER_CUH_
+#define _CUDA_PBF_SOLVER_CUH_
+
+#pragma once
+
+#include <kiri_pbs_cuda/sph/cuda_sph_solver.cuh>
+#include <kiri_pbs_cuda/searcher/cuda_neighbor_searcher.cuh>
+
+namespace KIRI
+{
+    // position based fluids on the same grid and boundary volumes as the sph solvers.
+    // the fluid neighbors are searched on the predicted positions, the fluids are not sorted by the system
+    // because that grid would not bound how far a particle moves during the constraint iterations
+    class CudaPBFSolver final : public CudaSphSolver
+    {
+    public:
+        virtual void UpdateSolver(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            CudaSphParams params,
+            CudaBoundaryParams bparams) override;
+
+        explicit CudaPBFSolver(
+            const uint num)
+            : CudaSphSolver(num)
+        {
+        }
+
+        virtual ~CudaPBFSolver() noexcept {}
+
+        // the neighbors are searched on the predicted positions only
+        virtual bool NeedsSortedFluids() const override { return false; }
+
+    private:
+        // predicted positions of the step, the sorted positions stay untouched until the end
+        SharedPtr<CudaArray<float3>> mPredPos;
+        // position corrections, reused as the new velocities of the xsph pass
+        SharedPtr<CudaArray<float3>> mDeltaPos;
+        SharedPtr<CudaArray<float>> mLambda;
+
+        // grid of the predicted positions, only the indices are sorted, the particle data stays in place
+        CudaGNIndexSearcherPtr mPredSearcher;
+
+        // allocated on first use with the capacity of the fluids, so emitted particles fit as well
+        void AllocateBuffers(
+            const uint maxNum,
+            const float3 lowestPoint,
+            const float3 highestPoint,
+            const float kernelSize);
+
+        void PredictPosition(
+            CudaSphParticlesPtr &fluids,
+            const float dt,
+            const float3 lowestPoint,
+            const float3 highestPoint,
+            const float radius);
+
+        void ComputeLambda(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float relaxation,
+            const float kernelSize,
+            const int3 gridSize);
+
+        void SolveDensityConstraint(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float3 lowestPoint,
+            const float3 highestPoint,
+            const float radius,
+            const float kernelSize,
+            const int3 gridSize);
+
+        void UpdateVelocity(
+            CudaSphParticlesPtr &fluids,
+            const float dt);
+
+        void ComputeXSPHViscosity(
+            CudaSphParticlesPtr &fluids,
+            const float xsph,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // the predicted positions become the particle positions, wrapped on the periodic axes.
+        // the grid is rebuilt by the next step
+        void CommitPositions(
+            CudaSphParticlesPtr &fluids,
+            const float3 lowestPoint);
+    };
+
+    typedef SharedPtr<CudaPBFSolver> CudaPBFSolverPtr;
+} // namespace KIRI
+
+#endif /* _CUDA_PBF_SOLVER_CUH_ */
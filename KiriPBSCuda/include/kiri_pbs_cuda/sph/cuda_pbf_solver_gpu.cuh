@@ -0,0 +1,258 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-27 13:05:41
+ * @LastEditTime: 2021-02-27 18:22:10
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\sph\cuda_pbf_solver_gpu.cuh
+ */
+
+#ifndef _CUDA_PBF_SOLVER_GPU_CUH_
+#define _CUDA_PBF_SOLVER_GPU_CUH_
+
+#pragma once
+
+#include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
+#include <kiri_pbs_cuda/sph/cuda_sph_solver_common_gpu.cuh>
+
+namespace KIRI
+{
+    // periodic axes are left open, the predicted positions are wrapped once the step is committed
+    static __device__ inline float3 ClampToBox(
+        float3 p,
+        const float3 lowestPoint,
+        const float3 highestPoint,
+        const float radius,
+        const float3 period)
+    {
+        const float3 lower = lowestPoint + make_float3(2.f * radius);
+        const float3 upper = highestPoint - make_float3(2.f * radius);
+        return make_float3(
+            period.x > 0.f ? p.x : fminf(fmaxf(p.x, lower.x), upper.x),
+            period.y > 0.f ? p.y : fminf(fmaxf(p.y, lower.y), upper.y),
+            period.z > 0.f ? p.z : fminf(fmaxf(p.z, lower.z), upper.z));
+    }
+
+    static __global__ void PredictPosition_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float3 *predPos,
+        const float dt,
+        const uint num,
+        const float3 lowestPoint,
+        const float3 highestPoint,
+        const float radius,
+        const float3 period)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        vel[i] += dt * acc[i];
+        predPos[i] = ClampToBox(pos[i] + dt * vel[i], lowestPoint, highestPoint, radius, period);
+        return;
+    }
+
+    static __device__ inline int3 PredictedGridXYZ(const uint cell, const int3 gridSize)
+    {
+        return make_int3(cell / (gridSize.y * gridSize.z), (cell / gridSize.z) % gridSize.y, cell % gridSize.z);
+    }
+
+    template <typename GridXYZ2GridHash, typename Func, typename GradientFunc>
+    __global__ void ComputeLambda_CUDA(
+        float3 *predPos,
+        float *mass,
+        float *density,
+        float *lambda,
+        const float rho0,
+        const float relaxation,
+        const uint num,
+        uint *predCell,
+        uint *predIdx,
+        uint *predCellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        GridXYZ2GridHash xyz2hash,
+        Func W,
+        GradientFunc nablaW)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const float3 pi = predPos[i];
+        float rho = 0.f;
+        float3 gradCi = make_float3(0.f);
+        float sumGradCj = 0.f;
+        int3 gridXYZ = PredictedGridXYZ(predCell[i], gridSize);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            for (uint k = predCellStart[hashIdx]; k < predCellStart[hashIdx + 1]; ++k)
+            {
+                const uint j = predIdx[k];
+                const float3 pij = xyz2hash.MinimumImage(pi - predPos[j]);
+                rho += mass[j] * W(length(pij));
+                if (i != j)
+                {
+                    const float3 gradCj = mass[j] / rho0 * nablaW(pij);
+                    gradCi += gradCj;
+                    sumGradCj += lengthSquared(gradCj);
+                }
+            }
+
+            // boundary particles never move, they only add to the particle's own gradient
+            for (uint j = bCellStart[hashIdx]; j < bCellStart[hashIdx + 1]; ++j)
+            {
+                const float3 pij = xyz2hash.MinimumImage(pi - bPos[j]);
+                rho += rho0 * bVolume[j] * W(length(pij));
+                gradCi += bVolume[j] * nablaW(pij);
+            }
+        }
+
+        density[i] = rho;
+
+        // only compression is corrected, a free surface is not pulled together
+        const float constraint = fmaxf(rho / rho0 - 1.f, 0.f);
+        lambda[i] = -constraint / (sumGradCj + lengthSquared(gradCi) + relaxation);
+        return;
+    }
+
+    template <typename GridXYZ2GridHash, typename GradientFunc>
+    __global__ void ComputeDeltaPos_CUDA(
+        float3 *predPos,
+        float3 *deltaPos,
+        float *mass,
+        float *lambda,
+        const float rho0,
+        const uint num,
+        uint *predCell,
+        uint *predIdx,
+        uint *predCellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        GridXYZ2GridHash xyz2hash,
+        GradientFunc nablaW)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const float3 pi = predPos[i];
+        const float li = lambda[i];
+        float3 dp = make_float3(0.f);
+        int3 gridXYZ = PredictedGridXYZ(predCell[i], gridSize);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            for (uint k = predCellStart[hashIdx]; k < predCellStart[hashIdx + 1]; ++k)
+            {
+                const uint j = predIdx[k];
+                if (i != j)
+                    dp += (li + lambda[j]) * mass[j] / rho0 * nablaW(xyz2hash.MinimumImage(pi - predPos[j]));
+            }
+
+            for (uint j = bCellStart[hashIdx]; j < bCellStart[hashIdx + 1]; ++j)
+                dp += li * bVolume[j] * nablaW(xyz2hash.MinimumImage(pi - bPos[j]));
+        }
+
+        deltaPos[i] = dp;
+        return;
+    }
+
+    static __global__ void ApplyDeltaPos_CUDA(
+        float3 *predPos,
+        float3 *deltaPos,
+        const uint num,
+        const float3 lowestPoint,
+        const float3 highestPoint,
+        const float radius,
+        const float3 period)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        predPos[i] = ClampToBox(predPos[i] + deltaPos[i], lowestPoint, highestPoint, radius, period);
+        return;
+    }
+
+    static __global__ void UpdateVelocity_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *predPos,
+        const float invDt,
+        const uint num)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        vel[i] = (predPos[i] - pos[i]) * invDt;
+        return;
+    }
+
+    // writes the smoothed velocities to newVel, the neighbors still read the old ones
+    template <typename GridXYZ2GridHash, typename Func>
+    __global__ void ComputeXSPHViscosity_CUDA(
+        float3 *predPos,
+        float3 *vel,
+        float3 *newVel,
+        float *mass,
+        float *density,
+        const float xsph,
+        const uint num,
+        uint *predCell,
+        uint *predIdx,
+        uint *predCellStart,
+        const int3 gridSize,
+        GridXYZ2GridHash xyz2hash,
+        Func W)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        float3 dv = make_float3(0.f);
+        int3 gridXYZ = PredictedGridXYZ(predCell[i], gridSize);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            for (uint k = predCellStart[hashIdx]; k < predCellStart[hashIdx + 1]; ++k)
+            {
+                const uint j = predIdx[k];
+                if (i != j)
+                    dv += mass[j] / fmaxf(KIRI_EPSILON, density[j]) * (vel[j] - vel[i]) * W(length(xyz2hash.MinimumImage(predPos[i] - predPos[j])));
+            }
+        }
+
+        newVel[i] = vel[i] + xsph * dv;
+        return;
+    }
+
+} // namespace KIRI
+
+#endif /* _CUDA_PBF_SOLVER_GPU_CUH_ */
@@ -36,8 +36,26 @@ namespace KIRI
 
         virtual ~CudaSphSolver() noexcept {}
 
+        // conjugate gradient iterations of the last implicit viscosity solve
+        uint GetViscosityIterations() const { return mViscIterations; }
+
     protected:
         uint mCudaGridSize;
+        uint mViscIterations = 0;
+
+        // only advect the particles flagged as active
+        bool bSleeping = false;
+
+        // fixed order reductions, see CudaSphParams::deterministic
+        bool bDeterministic = false;
+
+        IntegratorType mIntegrator = IntegratorType::SemiImplicitEuler;
+
+        // domain length on the periodic axes of the boundary, 0 on the closed ones
+        float3 mPeriod = make_float3(0.f);
+
+        // axes whose lower wall is a symmetry plane, see CudaBoundaryParams::SymmetryMask
+        uint mSymmetry = 0;
 
         virtual void ExtraForces(
             CudaSphParticlesPtr &fluids,
@@ -95,6 +113,59 @@ namespace KIRI
             const float3 lowestPoint,
             const float kernelSize,
             const int3 gridSize);
+
+        // adds the density of the mirror images across the symmetry planes, between the density and the pressure
+        virtual void ComputeMirrorDensity(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const float rho0,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // adds pressure and viscosity of the mirror images, needs the pressure of the step
+        virtual void ComputeMirrorForces(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float visc,
+            const float nu,
+            const float bnu,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // solves (I - dt * visc * L) v' = v + dt * a with a matrix free conjugate gradient over the grid,
+        // starting from the right hand side, i.e. the last solved velocities moved by this step's forces.
+        // the result is written back as acceleration (v' - v) / dt, so the advection stays the same.
+        void ComputeImplicitViscosity(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float visc,
+            const float bnu,
+            const float dt,
+            const uint maxIterations,
+            const float tolerance,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+    private:
+        // conjugate gradient vectors, allocated on first use with the capacity of the fluids
+        SharedPtr<CudaArray<float3>> mViscX, mViscR, mViscP, mViscAp;
+
+        // per block sums of the fixed order dot products
+        SharedPtr<CudaArray<float3>> mDotPartial;
+
+        // a . b per component, thrust's reduction in the default mode and a fixed order one in the deterministic mode
+        float3 ComponentDot(const float3 *a, const float3 *b, const uint num);
     };
 
     typedef SharedPtr<CudaSphSolver> CudaSphSolverPtr;
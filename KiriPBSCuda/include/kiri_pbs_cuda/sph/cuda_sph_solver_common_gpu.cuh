@@ -16,6 +16,56 @@
 
 namespace KIRI
 {
+    // no mask means every particle is active
+    static __device__ inline bool IsActive(const uint *active, const uint i)
+    {
+        return active == nullptr || active[i] != 0;
+    }
+
+    // moves positions which left the box on a periodic axis back in from the other side
+    static __host__ __device__ inline float3 WrapPeriodic(float3 p, const float3 lowestPoint, const float3 period)
+    {
+        if (period.x > 0.f)
+            p.x -= period.x * floorf((p.x - lowestPoint.x) / period.x);
+        if (period.y > 0.f)
+            p.y -= period.y * floorf((p.y - lowestPoint.y) / period.y);
+        if (period.z > 0.f)
+            p.z -= period.z * floorf((p.z - lowestPoint.z) / period.z);
+        return p;
+    }
+
+    // reflection across the symmetry planes selected by the bits of image, bit 0 for x, 1 for y and 2 for z
+    static __host__ __device__ inline float3 Mirror(float3 p, const float3 plane, const uint image)
+    {
+        if (image & 1u)
+            p.x = 2.f * plane.x - p.x;
+        if (image & 2u)
+            p.y = 2.f * plane.y - p.y;
+        if (image & 4u)
+            p.z = 2.f * plane.z - p.z;
+        return p;
+    }
+
+    // the mirrored direction of a vector, e.g. a velocity or a distance
+    static __host__ __device__ inline float3 Reflect(float3 v, const uint image)
+    {
+        if (image & 1u)
+            v.x = -v.x;
+        if (image & 2u)
+            v.y = -v.y;
+        if (image & 4u)
+            v.z = -v.z;
+        return v;
+    }
+
+    // an image only has neighbors when the particle is within the kernel radius of each of its planes
+    static __device__ inline bool HasMirrorNeighbors(const float3 p, const float3 plane, const uint image, const uint symmetry, const float kernelSize)
+    {
+        return (image & symmetry) == image &&
+               (!(image & 1u) || p.x - plane.x < kernelSize) &&
+               (!(image & 2u) || p.y - plane.y < kernelSize) &&
+               (!(image & 4u) || p.z - plane.z < kernelSize);
+    }
 
     static __global__ void BoundaryConstrain_CUDA(
         float3 *pos,
@@ -23,64 +73,90 @@ namespace KIRI
         const uint num,
         const float3 lowestPoint,
         const float3 highestPoint,
-        const float radius)
+        const float radius,
+        const float3 period,
+        const uint symmetry,
+        float4 *halfVel)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
         if (i >= num)
             return;
 
-        float3 tmpPos = pos[i];
+        float3 tmpPos = WrapPeriodic(pos[i], lowestPoint, period);
         float3 tmpVel = vel[i];
 
-        if (tmpPos.x > highestPoint.x - 2 * radius)
+        // the half step velocity of the leapfrog integrator must not point into the wall either
+        float4 tmpHalfVel = halfVel != nullptr ? halfVel[i] : make_float4(0.f);
+
+        // particles which crossed a symmetry plane continue as their mirror image
+        const uint crossed = (symmetry & 1u) * (tmpPos.x < lowestPoint.x) |
+                             (symmetry & 2u) * (tmpPos.y < lowestPoint.y) |
+                             (symmetry & 4u) * (tmpPos.z < lowestPoint.z);
+        if (crossed)
+        {
+            tmpPos = Mirror(tmpPos, lowestPoint, crossed);
+            tmpVel = Reflect(tmpVel, crossed);
+            const float3 tmpHalfVel3 = Reflect(make_float3(tmpHalfVel), crossed);
+            tmpHalfVel = make_float4(tmpHalfVel3, tmpHalfVel.w);
+        }
+
+        if (period.x == 0.f && tmpPos.x > highestPoint.x - 2 * radius)
         {
             tmpPos.x = highestPoint.x - 2 * radius;
             tmpVel.x = fminf(tmpVel.x, 0.0f);
+            tmpHalfVel.x = fminf(tmpHalfVel.x, 0.0f);
             //tmpVel.x = 0.f;
         }
 
-        if (tmpPos.x < lowestPoint.x + 2 * radius)
+        if (period.x == 0.f && !(symmetry & 1u) && tmpPos.x < lowestPoint.x + 2 * radius)
         {
             tmpPos.x = lowestPoint.x + 2 * radius;
             tmpVel.x = fmaxf(tmpVel.x, 0.0f);
+            tmpHalfVel.x = fmaxf(tmpHalfVel.x, 0.0f);
             //tmpVel.x = 0.f;
         }
 
-        if (tmpPos.y > highestPoint.y - 2 * radius)
+        if (period.y == 0.f && tmpPos.y > highestPoint.y - 2 * radius)
         {
             tmpPos.y = highestPoint.y - 2 * radius;
             tmpVel.y = fminf(tmpVel.y, 0.0f);
+            tmpHalfVel.y = fminf(tmpHalfVel.y, 0.0f);
             //tmpVel.y = 0.f;
         }
 
-        if (tmpPos.y < lowestPoint.y + 2 * radius)
+        if (period.y == 0.f && !(symmetry & 2u) && tmpPos.y < lowestPoint.y + 2 * radius)
         {
             tmpPos.y = lowestPoint.y + 2 * radius;
             tmpVel.y = fmaxf(tmpVel.y, 0.0f);
+            tmpHalfVel.y = fmaxf(tmpHalfVel.y, 0.0f);
             //tmpVel.y = 0.f;
         }
 
-        if (tmpPos.z > highestPoint.z - 2 * radius)
+        if (period.z == 0.f && tmpPos.z > highestPoint.z - 2 * radius)
         {
             tmpPos.z = highestPoint.z - 2 * radius;
             tmpVel.z = fminf(tmpVel.z, 0.0f);
+            tmpHalfVel.z = fminf(tmpHalfVel.z, 0.0f);
             //tmpVel.z = 0.f;
         }
 
-        if (tmpPos.z < lowestPoint.z + 2 * radius)
+        if (period.z == 0.f && !(symmetry & 4u) && tmpPos.z < lowestPoint.z + 2 * radius)
         {
             tmpPos.z = lowestPoint.z + 2 * radius;
             tmpVel.z = fmaxf(tmpVel.z, 0.0f);
+            tmpHalfVel.z = fmaxf(tmpHalfVel.z, 0.0f);
             //tmpVel.z = 0.f;
         }
 
         pos[i] = tmpPos;
         vel[i] = tmpVel;
+        if (halfVel != nullptr)
+            halfVel[i] = tmpHalfVel;
 
         return;
     }
 
-    template <typename Func>
+    template <typename Func, typename GridXYZ2GridHash>
     __device__ void ComputeFluidDensity(
         float *density,
         const uint i,
@@ -88,18 +164,19 @@ namespace KIRI
         float *mass,
         uint j,
         const uint cellEnd,
-        Func W)
+        Func W,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
-            *density += mass[j] * W(length(pos[i] - pos[j]));
+            *density += mass[j] * W(length(xyz2hash.MinimumImage(pos[i] - pos[j])));
             ++j;
         }
 
         return;
     }
 
-    template <typename Func>
+    template <typename Func, typename GridXYZ2GridHash>
     __device__ void ComputeBoundaryDensity(
         float *density,
         const float3 posi,
@@ -108,17 +185,18 @@ namespace KIRI
         const float rho0,
         uint j,
         const uint cellEnd,
-        Func W)
+        Func W,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
-            *density += rho0 * volume[j] * W(length(posi - bpos[j]));
+            *density += rho0 * volume[j] * W(length(xyz2hash.MinimumImage(posi - bpos[j])));
             ++j;
         }
         return;
     }
 
-    template <typename GradientFunc>
+    template <typename GradientFunc, typename GridXYZ2GridHash>
     __device__ void ComputeBoundaryPressure(
         float3 *a,
         const float3 posi,
@@ -129,18 +207,19 @@ namespace KIRI
         const float rho0,
         uint j,
         const uint cellEnd,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
-            *a += -rho0 * volume[j] * (pressurei / fmaxf(KIRI_EPSILON, densityi * densityi)) * nablaW(posi - bpos[j]);
+            *a += -rho0 * volume[j] * (pressurei / fmaxf(KIRI_EPSILON, densityi * densityi)) * nablaW(xyz2hash.MinimumImage(posi - bpos[j]));
             //*a += -volume[j] * (pressurei / rho0) * nablaW(posi - bpos[j]);
             ++j;
         }
         return;
     }
 
-    template <typename GradientFunc>
+    template <typename GradientFunc, typename GridXYZ2GridHash>
     __device__ void ComputeBoundaryViscosity(
         float3 *a,
         const float3 posi,
@@ -152,12 +231,13 @@ namespace KIRI
         const float rho0,
         uint j,
         const uint cellEnd,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
 
-            float3 dpij = posi - bpos[j];
+            float3 dpij = xyz2hash.MinimumImage(posi - bpos[j]);
 
             float dot_dvdp = dot(veli, dpij);
             if (dot_dvdp < 0.f)
@@ -171,7 +251,7 @@ namespace KIRI
         return;
     }
 
-    template <typename GradientFunc>
+    template <typename GradientFunc, typename GridXYZ2GridHash>
     __device__ void ComputeFluidPressure(
         float3 *a,
         const uint i,
@@ -181,19 +261,20 @@ namespace KIRI
         float *pressure,
         uint j,
         const uint cellEnd,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
             if (i != j)
-                *a += -mass[j] * (pressure[i] / fmaxf(KIRI_EPSILON, density[i] * density[i]) + pressure[j] / fmaxf(KIRI_EPSILON, density[j] * density[j])) * nablaW(pos[i] - pos[j]);
+                *a += -mass[j] * (pressure[i] / fmaxf(KIRI_EPSILON, density[i] * density[i]) + pressure[j] / fmaxf(KIRI_EPSILON, density[j] * density[j])) * nablaW(xyz2hash.MinimumImage(pos[i] - pos[j]));
             ++j;
         }
 
         return;
     }
 
-    template <typename LaplacianFunc>
+    template <typename LaplacianFunc, typename GridXYZ2GridHash>
     __device__ void ViscosityMuller2003(
         float3 *a,
         const uint i,
@@ -203,17 +284,18 @@ namespace KIRI
         float *density,
         uint j,
         const uint cellEnd,
-        LaplacianFunc nablaW2)
+        LaplacianFunc nablaW2,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
-            *a += mass[j] * ((vel[j] - vel[i]) / density[j]) * nablaW2(length(pos[i] - pos[j]));
+            *a += mass[j] * ((vel[j] - vel[i]) / density[j]) * nablaW2(length(xyz2hash.MinimumImage(pos[i] - pos[j])));
             ++j;
         }
         return;
     }
 
-    template <typename GradientFunc>
+    template <typename GradientFunc, typename GridXYZ2GridHash>
     __device__ void ArtificialViscosity(
         float3 *a,
         const uint i,
@@ -224,12 +306,13 @@ namespace KIRI
         const float nu,
         uint j,
         const uint cellEnd,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
 
-            float3 dpij = pos[i] - pos[j];
+            float3 dpij = xyz2hash.MinimumImage(pos[i] - pos[j]);
             float3 dv = vel[i] - vel[j];
 
             float dot_dvdp = dot(dv, dpij);
@@ -258,12 +341,15 @@ namespace KIRI
         const int3 gridSize,
         Pos2GridXYZ p2xyz,
         GridXYZ2GridHash xyz2hash,
-        Func W)
+        Func W,
+        const uint *active = nullptr)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
-        if (i >= num)
+        if (i >= num || !IsActive(active, i))
             return;
 
+        // sleeping particles keep the density of their last active step
+        float rho = 0.f;
         int3 gridXYZ = p2xyz(pos[i]);
 
 #pragma unroll
@@ -274,10 +360,11 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ComputeFluidDensity(&density[i], i, pos, mass, cellStart[hashIdx], cellStart[hashIdx + 1], W);
-            ComputeBoundaryDensity(&density[i], pos[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], W);
+            ComputeFluidDensity(&rho, i, pos, mass, cellStart[hashIdx], cellStart[hashIdx + 1], W, xyz2hash);
+            ComputeBoundaryDensity(&rho, pos[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], W, xyz2hash);
         }
 
+        density[i] = rho;
         return;
     }
 
@@ -300,10 +387,11 @@ namespace KIRI
         Pos2GridXYZ p2xyz,
         GridXYZ2GridHash xyz2hash,
         GradientFunc nablaW,
-        LaplacianFunc nablaW2)
+        LaplacianFunc nablaW2,
+        const uint *active = nullptr)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
-        if (i >= num)
+        if (i >= num || !IsActive(active, i))
             return;
 
         float3 a = make_float3(0.f);
@@ -318,8 +406,8 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ViscosityMuller2003(&a, i, pos, vel, mass, density, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW2);
-            ComputeBoundaryViscosity(&a, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW);
+            ViscosityMuller2003(&a, i, pos, vel, mass, density, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW2, xyz2hash);
+            ComputeBoundaryViscosity(&a, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
         }
 
         acc[i] += visc * a;
@@ -344,10 +432,11 @@ namespace KIRI
         const int3 gridSize,
         Pos2GridXYZ p2xyz,
         GridXYZ2GridHash xyz2hash,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        const uint *active = nullptr)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
-        if (i >= num)
+        if (i >= num || !IsActive(active, i))
             return;
 
         float3 a = make_float3(0.0f);
@@ -363,14 +452,260 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ArtificialViscosity(&a, i, pos, vel, mass, density, nu, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW);
-            ComputeBoundaryViscosity(&a, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW);
+            ArtificialViscosity(&a, i, pos, vel, mass, density, nu, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW, xyz2hash);
+            ComputeBoundaryViscosity(&a, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
+        }
+
+        acc[i] += a;
+        return;
+    }
+
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash, typename GradientFunc>
+    __global__ void ComputeBoundaryViscosityTerm_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float *density,
+        const float rho0,
+        const float bnu,
+        const uint num,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        GradientFunc nablaW)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        float3 a = make_float3(0.f);
+        int3 gridXYZ = p2xyz(pos[i]);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            ComputeBoundaryViscosity(&a, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
+        }
+
+        acc[i] += a;
+        return;
+    }
+
+    // adds the mirror images of the fluid and boundary particles across the symmetry planes, no ghosts are stored:
+    // |p_i - mirror(p_j)| = |mirror(p_i) - p_j|, so the grid is searched around the mirrored particle
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash, typename Func>
+    __global__ void ComputeMirrorDensity_CUDA(
+        float3 *pos,
+        float *mass,
+        float *density,
+        const float rho0,
+        const uint num,
+        uint *cellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        Func W,
+        const float3 plane,
+        const uint symmetry,
+        const float kernelSize,
+        const uint *active = nullptr)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !IsActive(active, i))
+            return;
+
+        float rho = 0.f;
+        for (uint image = 1; image < 8; ++image)
+        {
+            if (!HasMirrorNeighbors(pos[i], plane, image, symmetry, kernelSize))
+                continue;
+
+            const float3 posm = Mirror(pos[i], plane, image);
+            int3 gridXYZ = p2xyz(posm);
+
+#pragma unroll
+            for (int m = 0; m < 27; ++m)
+            {
+                int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+                const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+                if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                    continue;
+
+                for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                    rho += mass[j] * W(length(xyz2hash.MinimumImage(posm - pos[j])));
+
+                ComputeBoundaryDensity(&rho, posm, bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], W, xyz2hash);
+            }
+        }
+
+        density[i] += rho;
+        return;
+    }
+
+    // pressure and viscosity of the mirror images, the pairs are evaluated in the mirrored frame
+    // (mirrored particle against the real neighbors) and reflected back. visc scales the laplacian
+    // viscosity, nu the artificial one, a zero switches the term off
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash, typename GradientFunc, typename LaplacianFunc>
+    __global__ void ComputeMirrorForces_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float *mass,
+        float *density,
+        float *pressure,
+        const float rho0,
+        const float visc,
+        const float nu,
+        const float bnu,
+        const uint num,
+        uint *cellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        GradientFunc nablaW,
+        LaplacianFunc nablaW2,
+        const float3 plane,
+        const uint symmetry,
+        const float kernelSize,
+        const uint *active = nullptr)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !IsActive(active, i))
+            return;
+
+        const float pi = pressure[i] / fmaxf(KIRI_EPSILON, density[i] * density[i]);
+        float3 a = make_float3(0.f);
+        for (uint image = 1; image < 8; ++image)
+        {
+            if (!HasMirrorNeighbors(pos[i], plane, image, symmetry, kernelSize))
+                continue;
+
+            const float3 posm = Mirror(pos[i], plane, image);
+            const float3 velm = Reflect(vel[i], image);
+            float3 ap = make_float3(0.f);
+            float3 av = make_float3(0.f);
+            int3 gridXYZ = p2xyz(posm);
+
+#pragma unroll
+            for (int m = 0; m < 27; ++m)
+            {
+                int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+                const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+                if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                    continue;
+
+                // the own image is a neighbor as well, a particle on the plane has a zero gradient to it
+                for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                {
+                    const float3 dpij = xyz2hash.MinimumImage(posm - pos[j]);
+                    const float pj = pressure[j] / fmaxf(KIRI_EPSILON, density[j] * density[j]);
+                    ap += -mass[j] * (pi + pj) * nablaW(dpij);
+                    av += visc * mass[j] * ((vel[j] - velm) / density[j]) * nablaW2(length(dpij));
+
+                    const float dot_dvdp = dot(velm - vel[j], dpij);
+                    if (nu > 0.f && dot_dvdp < 0.f)
+                    {
+                        const float pij = -nu / (density[i] + density[j]) * (dot_dvdp / (lengthSquared(dpij) + KIRI_EPSILON));
+                        av += -mass[j] * pij * nablaW(dpij);
+                    }
+                }
+
+                ComputeBoundaryPressure(&ap, posm, density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
+                ComputeBoundaryViscosity(&av, posm, bPos, velm, density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
+            }
+
+            a += Reflect(ap + av, image);
         }
 
         acc[i] += a;
         return;
     }
 
+    // y = (I - dt * visc * L) x with the symmetric weights 2 m_j / (rho_i + rho_j) * lapW_ij,
+    // so the matrix is symmetric positive definite for the conjugate gradient
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash, typename LaplacianFunc>
+    __global__ void ImplicitViscosityMatVec_CUDA(
+        float3 *pos,
+        float3 *x,
+        float3 *y,
+        float *mass,
+        float *density,
+        const float coef,
+        const uint num,
+        uint *cellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        LaplacianFunc nablaW2)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const float3 xi = x[i];
+        float3 lap = make_float3(0.f);
+        int3 gridXYZ = p2xyz(pos[i]);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                if (i != j)
+                    lap += 2.f * mass[j] / fmaxf(KIRI_EPSILON, density[i] + density[j]) * nablaW2(length(xyz2hash.MinimumImage(pos[i] - pos[j]))) * (x[j] - xi);
+        }
+
+        y[i] = xi - coef * lap;
+        return;
+    }
+
+    // component wise dot product in a fixed order: every block strides over the same slice and sums it as a
+    // tree in shared memory, launched with a fixed number of blocks the partial sums are the same in every run
+    static __global__ void ComponentDotPartial_CUDA(
+        const float3 *a,
+        const float3 *b,
+        float3 *partial,
+        const uint num)
+    {
+        __shared__ float3 sum[KIRI_CUBLOCKSIZE];
+        const uint tid = threadIdx.x;
+
+        float3 s = make_float3(0.f);
+        for (uint i = __umul24(blockIdx.x, blockDim.x) + tid; i < num; i += blockDim.x * gridDim.x)
+            s += a[i] * b[i];
+        sum[tid] = s;
+        __syncthreads();
+
+        for (uint stride = blockDim.x / 2; stride > 0; stride >>= 1)
+        {
+            if (tid < stride)
+                sum[tid] += sum[tid + stride];
+            __syncthreads();
+        }
+
+        if (tid == 0)
+            partial[blockIdx.x] = sum[0];
+        return;
+    }
+
 } // namespace KIRI
 
 #endif /* _CUDA_SPH_SOLVER_COMMON_GPU_CUH_ */
\ No newline at end of file
@@ -66,8 +66,8 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ComputeFluidPressure(&a, i, pos, mass, density, pressure, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW);
-            ComputeBoundaryPressure(&a, pos[i], density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW);
+            ComputeFluidPressure(&a, i, pos, mass, density, pressure, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW, xyz2hash);
+            ComputeBoundaryPressure(&a, pos[i], density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
         }
 
         acc[i] += a;
@@ -35,10 +35,86 @@ namespace KIRI
 
         virtual ~CudaWCSphSolver() noexcept {}
 
+        // particles whose forces were evaluated in the last step
+        uint GetNumOfUpdatedParticles() const { return mNumOfUpdated; }
+
     private:
         float mNegativeScale;
         bool bCubicKernel = false;
 
+        // one flag per grid cell which holds an active particle, allocated on first use
+        SharedPtr<CudaArray<uint>> mCellActive;
+
+        // local time stepping, base steps within the longest period and the finest level of each cell
+        bool bLocalTimeStep = false;
+        uint mLocalStep = 0;
+        uint mNumOfUpdated = 0;
+        SharedPtr<CudaArray<uint>> mCellLevel;
+
+        // adaptive resolution, buffers are allocated on first use
+        bool bAdaptive = false;
+        uint mAdaptiveStep = 0;
+        SharedPtr<CudaArray<uint>> mCellDist, mResolutionAction, mMergePartner, mSplitSlot, mRemoved;
+
+        const uint *ActivePtr(const CudaSphParticlesPtr &fluids) const;
+
+        // wakes every sleeping particle with an active particle in one of its 27 neighbor cells
+        void WakeParticles(
+            CudaSphParticlesPtr &fluids,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // flags the particles due in this step of the local time stepping
+        void ScheduleLocalTimeStep(
+            CudaSphParticlesPtr &fluids,
+            const uint numOfLevels,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        void AdvectLocalTimeStep(
+            CudaSphParticlesPtr &fluids,
+            const float dt,
+            const uint numOfLevels,
+            const float cfl,
+            const float3 lowestPoint,
+            const float3 highestPoint,
+            const float kernelSize,
+            const int3 gridSize,
+            const float radius);
+
+        // density, tait pressure, pressure and viscosity forces with per-particle mass and kernel radius
+        void ComputeAdaptiveForces(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float stiff,
+            const float visc,
+            const float bnu,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // splits the particles closer to the surface than their level allows and merges the deeper ones,
+        // runs between the forces and the advection while the grid still matches the positions. the new particles
+        // carry the accelerations of their parents and the next sort brings them into the grid
+        void AdaptResolution(
+            CudaSphParticlesPtr &fluids,
+            const CudaArray<uint> &cellStart,
+            const CudaSphParams &params,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize);
+
+        // puts the active particles which are slow and force free to sleep
+        void UpdateActivity(
+            CudaSphParticlesPtr &fluids,
+            const float velThreshold,
+            const float accThreshold);
+
         virtual void ComputeDensity(
             CudaSphParticlesPtr &fluids,
             CudaBoundaryParticlesPtr &boundaries,
@@ -83,6 +159,29 @@ namespace KIRI
             const float3 lowestPoint,
             const float kernelSize,
             const int3 gridSize) override;
+
+        virtual void ComputeMirrorDensity(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const float rho0,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize) override;
+
+        virtual void ComputeMirrorForces(
+            CudaSphParticlesPtr &fluids,
+            CudaBoundaryParticlesPtr &boundaries,
+            const CudaArray<uint> &cellStart,
+            const CudaArray<uint> &boundaryCellStart,
+            const float rho0,
+            const float visc,
+            const float nu,
+            const float bnu,
+            const float3 lowestPoint,
+            const float kernelSize,
+            const int3 gridSize) override;
     };
 
     typedef SharedPtr<CudaWCSphSolver> CudaWCSphSolverPtr;
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
+#include <kiri_pbs_cuda/sph/cuda_sph_solver_common_gpu.cuh>
 
 namespace KIRI
 {
@@ -22,10 +23,11 @@ namespace KIRI
         const uint num,
         const float rho0,
         const float stiff,
-        const float negativeScale)
+        const float negativeScale,
+        const uint *active = nullptr)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
-        if (i >= num)
+        if (i >= num || !IsActive(active, i))
             return;
 
         pressure[i] = stiff * (powf((density[i] / rho0), 7.f) - 1.0f);
@@ -54,10 +56,11 @@ namespace KIRI
         const int3 gridSize,
         Pos2GridXYZ p2xyz,
         GridXYZ2GridHash xyz2hash,
-        GradientFunc nablaW)
+        GradientFunc nablaW,
+        const uint *active = nullptr)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
-        if (i >= num)
+        if (i >= num || !IsActive(active, i))
             return;
 
         auto a = make_float3(0.0f);
@@ -71,8 +74,8 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ComputeFluidPressure(&a, i, pos, mass, density, pressure, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW);
-            ComputeBoundaryPressure(&a, pos[i], density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW);
+            ComputeFluidPressure(&a, i, pos, mass, density, pressure, cellStart[hashIdx], cellStart[hashIdx + 1], nablaW, xyz2hash);
+            ComputeBoundaryPressure(&a, pos[i], density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], nablaW, xyz2hash);
         }
 
         // if (length(a) > 1000.f)
@@ -82,6 +85,580 @@ namespace KIRI
         return;
     }
 
+    template <typename Pos2GridHash>
+    __global__ void MarkActiveCells_CUDA(
+        float3 *pos,
+        uint *active,
+        uint *cellActive,
+        const uint num,
+        Pos2GridHash p2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !active[i])
+            return;
+
+        // every writer stores the same value, no atomics needed
+        cellActive[p2hash(pos[i])] = 1;
+        return;
+    }
+
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void WakeParticles_CUDA(
+        float3 *pos,
+        uint *active,
+        uint *cellActive,
+        const uint num,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || active[i])
+            return;
+
+        int3 gridXYZ = p2xyz(pos[i]);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            if (cellActive[hashIdx])
+            {
+                active[i] = 1;
+                return;
+            }
+        }
+
+        return;
+    }
+
+    __global__ void UpdateActivity_CUDA(
+        float3 *vel,
+        float3 *acc,
+        uint *active,
+        const uint num,
+        const float velThreshold2,
+        const float accThreshold2)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !active[i])
+            return;
+
+        active[i] = (lengthSquared(vel[i]) > velThreshold2 || lengthSquared(acc[i]) > accThreshold2) ? 1 : 0;
+        return;
+    }
+
+    // level of a particle in the local time stepping, the state holds level + 1 in w and 0 before the first step
+    static __device__ inline uint LocalTimeLevel(const float4 &state)
+    {
+        return state.w > 0.f ? static_cast<uint>(state.w) - 1 : 0;
+    }
+
+    template <typename Pos2GridHash>
+    __global__ void MarkCellLevels_CUDA(
+        float3 *pos,
+        float4 *state,
+        uint *cellLevel,
+        const uint num,
+        Pos2GridHash p2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        atomicMin(&cellLevel[p2hash(pos[i])], LocalTimeLevel(state[i]));
+        return;
+    }
+
+    // a particle is due when the step is a multiple of its period 2^level. it is also updated early
+    // when a neighbor cell holds a particle more than one level finer, so a splash cannot run into a sleeper
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void ScheduleLocalTimeStep_CUDA(
+        float3 *pos,
+        float4 *state,
+        uint *active,
+        uint *cellLevel,
+        const uint num,
+        const uint step,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const float4 s = state[i];
+        const uint level = LocalTimeLevel(s);
+        if (s.w == 0.f || (step & ((1u << level) - 1)) == 0)
+        {
+            active[i] = 1;
+            return;
+        }
+
+        active[i] = 0;
+        int3 gridXYZ = p2xyz(pos[i]);
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            if (cellLevel[hashIdx] + 1 < level)
+            {
+                active[i] = 1;
+                return;
+            }
+        }
+
+        return;
+    }
+
+    // block time stepped kick-drift-kick. vel holds the drift velocity of the current period, the state the
+    // acceleration of the last opening kick. due particles close their period (a shortened one takes back the
+    // part of the opening kick it did not use), pick a new level from their own CFL limit and open the next period,
+    // every particle drifts by one base step
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void AdvectLocalTimeStep_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float4 *state,
+        uint *active,
+        uint *cellLevel,
+        const uint num,
+        const uint step,
+        const float dt,
+        const uint numOfLevels,
+        const float cfl,
+        const float kernelSize,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        float3 v = vel[i];
+        if (active[i])
+        {
+            const float3 a = acc[i];
+            const float4 s = state[i];
+            const float halfDt = 0.5f * dt;
+
+            if (s.w != 0.f)
+            {
+                const uint period = 1u << LocalTimeLevel(s);
+                uint elapsed = step & (period - 1);
+                if (elapsed == 0)
+                    elapsed = period;
+
+                v += halfDt * (static_cast<float>(elapsed) * a - static_cast<float>(period - elapsed) * make_float3(s));
+            }
+
+            const float localDt = cfl * fminf(kernelSize / fmaxf(length(v), 1e-6f), sqrtf(kernelSize / fmaxf(length(a), 1e-6f)));
+            uint level = 0;
+            while (level + 1 < numOfLevels && dt * static_cast<float>(1u << (level + 1)) <= localDt)
+                level++;
+
+            // at most one level coarser than the finest neighbor and aligned to the current step
+            int3 gridXYZ = p2xyz(pos[i]);
+
+#pragma unroll
+            for (int m = 0; m < 27; ++m)
+            {
+                int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+                const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+                if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                    continue;
+
+                level = min(level, cellLevel[hashIdx] + 1);
+            }
+
+            while (level > 0 && (step & ((1u << level) - 1)) != 0)
+                level--;
+
+            v += halfDt * static_cast<float>(1u << level) * a;
+            state[i] = make_float4(a, static_cast<float>(level + 1));
+            vel[i] = v;
+        }
+
+        pos[i] += dt * v;
+        return;
+    }
+
+    // ----------------- adaptive resolution -----------------
+
+    // 0 for particles of the scene resolution, every merge doubles the mass. rest_mass is the finest level,
+    // the system starts and emits every particle with it, so only merged particles split again
+    static __device__ inline uint ResolutionLevel(const float mass, const float baseMass)
+    {
+        return static_cast<uint>(max(__float2int_rn(log2f(mass / baseMass)), 0));
+    }
+
+    static __device__ inline float SmoothingLength(const float *h, const uint i, const float baseRadius)
+    {
+        return h[i] > 0.f ? h[i] : baseRadius;
+    }
+
+    // the pairs use the mean kernel radius, the cell range covers it for the largest particle of the scene
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void ComputeAdaptiveDensity_CUDA(
+        float3 *pos,
+        float *mass,
+        float *h,
+        float *density,
+        const float rho0,
+        const uint num,
+        uint *cellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        const float cellSize,
+        const float maxRadius,
+        const uint *active = nullptr)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !IsActive(active, i))
+            return;
+
+        const float hi = SmoothingLength(h, i, cellSize);
+        const int range = static_cast<int>(ceilf(0.5f * (hi + maxRadius) / cellSize));
+        int3 gridXYZ = p2xyz(pos[i]);
+
+        float rho = 0.f;
+        for (int x = -range; x <= range; ++x)
+            for (int y = -range; y <= range; ++y)
+                for (int z = -range; z <= range; ++z)
+                {
+                    const uint hashIdx = xyz2hash(gridXYZ.x + x, gridXYZ.y + y, gridXYZ.z + z);
+                    if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                        continue;
+
+                    for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                        rho += mass[j] * Poly6Kernel(0.5f * (hi + SmoothingLength(h, j, cellSize)))(length(xyz2hash.MinimumImage(pos[i] - pos[j])));
+
+                    ComputeBoundaryDensity(&rho, pos[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], Poly6Kernel(hi), xyz2hash);
+                }
+
+        density[i] = rho;
+        return;
+    }
+
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void ComputeAdaptiveForces_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float *mass,
+        float *h,
+        float *density,
+        float *pressure,
+        const float rho0,
+        const float visc,
+        const float bnu,
+        const uint num,
+        uint *cellStart,
+        float3 *bPos,
+        float *bVolume,
+        uint *bCellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        const float cellSize,
+        const float maxRadius,
+        const uint *active = nullptr)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || !IsActive(active, i))
+            return;
+
+        const float hi = SmoothingLength(h, i, cellSize);
+        const int range = static_cast<int>(ceilf(0.5f * (hi + maxRadius) / cellSize));
+        int3 gridXYZ = p2xyz(pos[i]);
+
+        const float pi = pressure[i] / fmaxf(KIRI_EPSILON, density[i] * density[i]);
+        float3 ap = make_float3(0.f);
+        float3 av = make_float3(0.f);
+        for (int x = -range; x <= range; ++x)
+            for (int y = -range; y <= range; ++y)
+                for (int z = -range; z <= range; ++z)
+                {
+                    const uint hashIdx = xyz2hash(gridXYZ.x + x, gridXYZ.y + y, gridXYZ.z + z);
+                    if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                        continue;
+
+                    for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                    {
+                        if (i == j)
+                            continue;
+
+                        const float hij = 0.5f * (hi + SmoothingLength(h, j, cellSize));
+                        const float3 dpij = xyz2hash.MinimumImage(pos[i] - pos[j]);
+                        const float pj = pressure[j] / fmaxf(KIRI_EPSILON, density[j] * density[j]);
+                        ap += -mass[j] * (pi + pj) * SpikyKernelGrad(hij)(dpij);
+                        av += mass[j] * ((vel[j] - vel[i]) / density[j]) * SpikyKernelLaplacian(hij)(length(dpij));
+                    }
+
+                    ComputeBoundaryPressure(&ap, pos[i], density[i], pressure[i], bPos, bVolume, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], SpikyKernelGrad(hi), xyz2hash);
+                    ComputeBoundaryViscosity(&av, pos[i], bPos, vel[i], density[i], bVolume, bnu, rho0, bCellStart[hashIdx], bCellStart[hashIdx + 1], SpikyKernelGrad(hi), xyz2hash);
+                }
+
+        acc[i] += ap + visc * av;
+        return;
+    }
+
+    // cells inside the region of interest start at distance 0, the others far away
+    __global__ void InitCellDistance_CUDA(
+        uint *cellDist,
+        const int3 gridSize,
+        const float3 lowestPoint,
+        const float cellSize,
+        const float3 roiLower,
+        const float3 roiUpper,
+        const uint farDist)
+    {
+        const uint c = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (c >= gridSize.x * gridSize.y * gridSize.z)
+            return;
+
+        const int3 xyz = make_int3(c / (gridSize.y * gridSize.z), (c / gridSize.z) % gridSize.y, c % gridSize.z);
+        const float3 center = lowestPoint + (make_float3(xyz) + 0.5f) * cellSize;
+        const bool inside = center.x >= roiLower.x && center.y >= roiLower.y && center.z >= roiLower.z &&
+                            center.x <= roiUpper.x && center.y <= roiUpper.y && center.z <= roiUpper.z;
+
+        cellDist[c] = inside ? 0 : farDist;
+        return;
+    }
+
+    template <typename Pos2GridHash>
+    __global__ void MarkSurfaceCells_CUDA(
+        float3 *pos,
+        float *density,
+        uint *cellDist,
+        const uint num,
+        const float surfaceDensity,
+        Pos2GridHash p2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || density[i] >= surfaceDensity)
+            return;
+
+        // every writer stores the same value, no atomics needed
+        cellDist[p2hash(pos[i])] = 0;
+        return;
+    }
+
+    // one pass of the chessboard distance, updating in place only converges faster.
+    // the distance runs around the periodic axes of the hash
+    template <typename GridXYZ2GridHash>
+    __global__ void DilateCellDistance_CUDA(
+        uint *cellDist,
+        const int3 gridSize,
+        GridXYZ2GridHash xyz2hash)
+    {
+        const uint c = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (c >= gridSize.x * gridSize.y * gridSize.z)
+            return;
+
+        const int3 xyz = make_int3(c / (gridSize.y * gridSize.z), (c / gridSize.z) % gridSize.y, c % gridSize.z);
+        uint dist = cellDist[c];
+
+#pragma unroll
+        for (int m = 0; m < 27; ++m)
+        {
+            const int3 n = xyz + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+            const uint hashIdx = xyz2hash(n.x, n.y, n.z);
+            if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                continue;
+
+            dist = min(dist, cellDist[hashIdx] + 1);
+        }
+
+        cellDist[c] = dist;
+        return;
+    }
+
+    // 1 splits the particle, 2 merges it with a neighbor of the same level, 0 keeps it
+    template <typename Pos2GridHash>
+    __global__ void ClassifyResolution_CUDA(
+        float3 *pos,
+        float *mass,
+        uint *cellDist,
+        uint *action,
+        const uint num,
+        const float baseMass,
+        const uint maxLevel,
+        const uint band,
+        Pos2GridHash p2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const uint level = ResolutionLevel(mass[i], baseMass);
+        const uint target = min(cellDist[p2hash(pos[i])] / band, maxLevel);
+        action[i] = level > target ? 1 : (level < target ? 2 : 0);
+        return;
+    }
+
+    // every merging particle proposes its nearest merging neighbor of the same level, mutual proposals merge
+    template <typename Pos2GridXYZ, typename GridXYZ2GridHash>
+    __global__ void ProposeMerge_CUDA(
+        float3 *pos,
+        float *mass,
+        float *h,
+        uint *action,
+        uint *partner,
+        const uint num,
+        const float baseMass,
+        uint *cellStart,
+        const int3 gridSize,
+        Pos2GridXYZ p2xyz,
+        GridXYZ2GridHash xyz2hash,
+        const float cellSize)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        partner[i] = num;
+        if (action[i] != 2)
+            return;
+
+        const uint level = ResolutionLevel(mass[i], baseMass);
+        const float hi = SmoothingLength(h, i, cellSize);
+        const int range = static_cast<int>(ceilf(hi / cellSize));
+        int3 gridXYZ = p2xyz(pos[i]);
+
+        float best = hi * hi;
+        for (int x = -range; x <= range; ++x)
+            for (int y = -range; y <= range; ++y)
+                for (int z = -range; z <= range; ++z)
+                {
+                    const uint hashIdx = xyz2hash(gridXYZ.x + x, gridXYZ.y + y, gridXYZ.z + z);
+                    if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                        continue;
+
+                    for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                    {
+                        if (i == j || action[j] != 2 || ResolutionLevel(mass[j], baseMass) != level)
+                            continue;
+
+                        const float dist2 = lengthSquared(xyz2hash.MinimumImage(pos[i] - pos[j]));
+                        if (dist2 < best)
+                        {
+                            best = dist2;
+                            partner[i] = j;
+                        }
+                    }
+                }
+
+        return;
+    }
+
+    // the lower index of a pair keeps the merged particle, mass, momentum and the center of mass are conserved.
+    // a pair across a periodic axis merges at the center of its nearest images
+    template <typename GridXYZ2GridHash>
+    __global__ void MergeParticles_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float *mass,
+        float *h,
+        uint *active,
+        float4 *state,
+        uint *partner,
+        uint *removed,
+        const uint num,
+        const float baseMass,
+        const float baseRadius,
+        GridXYZ2GridHash xyz2hash)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num)
+            return;
+
+        const uint j = partner[i];
+        if (j >= num || partner[j] != i || j < i)
+            return;
+
+        const float mi = mass[i], mj = mass[j];
+        const float m = mi + mj;
+        pos[i] += mj / m * xyz2hash.MinimumImage(pos[j] - pos[i]);
+        vel[i] = (mi * vel[i] + mj * vel[j]) / m;
+        acc[i] = (mi * acc[i] + mj * acc[j]) / m;
+        mass[i] = m;
+        h[i] = baseRadius * cbrtf(m / baseMass);
+        active[i] = 1;
+        state[i] = make_float4(0.f);
+        removed[j] = 1;
+        return;
+    }
+
+    // the parent moves to one side and a child is written behind the particles on the other side,
+    // splits of consecutive levels alternate the axis, so three of them refine a cube into eight
+    __global__ void SplitParticles_CUDA(
+        float3 *pos,
+        float3 *vel,
+        float3 *acc,
+        float3 *col,
+        float *mass,
+        float *h,
+        float *density,
+        float *pressure,
+        uint *label,
+        uint *active,
+        float4 *state,
+        uint *action,
+        uint *slot,
+        const uint num,
+        const uint numOfChildren,
+        const float baseMass,
+        const float baseRadius,
+        const float particleRadius)
+    {
+        const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
+        if (i >= num || action[i] != 1 || slot[i] >= numOfChildren)
+            return;
+
+        const float m = 0.5f * mass[i];
+        const uint axis = (ResolutionLevel(mass[i], baseMass) + 2) % 3;
+        const float d = 0.5f * particleRadius * cbrtf(mass[i] / baseMass);
+        const float3 offset = make_float3(axis == 0 ? d : 0.f, axis == 1 ? d : 0.f, axis == 2 ? d : 0.f);
+
+        const uint c = num + slot[i];
+        pos[c] = pos[i] + offset;
+        vel[c] = vel[i];
+        acc[c] = acc[i];
+        col[c] = col[i];
+        mass[c] = m;
+        h[c] = baseRadius * cbrtf(m / baseMass);
+        density[c] = density[i];
+        pressure[c] = pressure[i];
+        label[c] = label[i];
+        active[c] = 1;
+        state[c] = make_float4(0.f);
+
+        pos[i] -= offset;
+        mass[i] = m;
+        h[i] = h[c];
+        active[i] = 1;
+        state[i] = make_float4(0.f);
+        return;
+    }
+
 } // namespace KIRI
 
 #endif /* _CUDA_WCSPH_SOLVER_GPU_CUH_ */
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 15:02:33
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description: one rank of a slab decomposed sph simulation
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\system\cuda_sph_distributed_system.cuh
+ */
+
+#ifndef _CUDA_SPH_DISTRIBUTED_SYSTEM_CUH_
+#define _CUDA_SPH_DISTRIBUTED_SYSTEM_CUH_
+
+#pragma once
+
+#include <kiri_pbs_cuda/system/cuda_sph_system.cuh>
+#include <kiri_pbs_cuda/system/cuda_sph_transport.h>
+#include <kiri_pbs_cuda/system/cuda_sph_domain_decomposition.cuh>
+
+namespace KIRI
+{
+    // Every rank simulates the particles of its own slab plus halo copies of its neighbors' particles.
+    // The halo is two cells wide by default: owned particles then see neighbors whose density is complete,
+    // so one exchange per step is enough and the halo results are simply thrown away.
+    class CudaSphDistributedSystem
+    {
+    public:
+        explicit CudaSphDistributedSystem(
+            const CudaSphTransportPtr &transport,
+            const Vec_Float3 &fluidPos,
+            const Vec_Float3 &fluidCol,
+            const Vec_Float3 &boundaryPos,
+            const CudaSphParams &params,
+            const CudaBoundaryParams &boundaryParams,
+            CudaSolverFactory solverFactory = nullptr,
+            const uint maxNumOfParticles = 0,
+            const int haloCells = 2,
+            const uint rebalanceInterval = 50,
+            const float rebalanceThreshold = 1.2f);
+
+        CudaSphDistributedSystem(const CudaSphDistributedSystem &) = delete;
+        CudaSphDistributedSystem &operator=(const CudaSphDistributedSystem &) = delete;
+
+        float UpdateSystem();
+
+        int Rank() const { return mTransport->Rank(); }
+        uint NumOfOwnedParticles() const { return mNumOfOwned; }
+        const CudaSphDomainDecompositionPtr &GetDecomposition() const { return mDecomposition; }
+
+        void GetOwnedParticles(Vec_Float3 &pos, Vec_Float3 &vel, Vec_Float3 &col) const;
+
+        ~CudaSphDistributedSystem() noexcept {}
+
+    private:
+        // host copy of everything a particle carries between steps, a migrated particle keeps its mass,
+        // kernel radius, sleep flag and integrator state
+        struct HostParticles
+        {
+            Vec_Float3 pos, vel, col;
+            Vector<float> mass, smoothingLength;
+            Vector<uint> active;
+            Vector<float4> integratorState;
+
+            size_t Size() const { return pos.size(); }
+            void Add(const HostParticles &src, const size_t i);
+        };
+
+        CudaSphTransportPtr mTransport;
+        CudaSphDomainDecompositionPtr mDecomposition;
+        CudaSphParticlesPtr mFluids;
+        CudaSphSystemPtr mSystem;
+
+        const CudaSphParams mParams;
+        const uint mRebalanceInterval;
+        const float mRebalanceThreshold;
+
+        uint mStep;
+        uint mNumOfOwned;
+
+        // host staging buffers for the device download, reused every step
+        HostParticles mLocal;
+        Vector<uint> mLabel;
+
+        static Vec_Byte PackParticles(const HostParticles &particles);
+        static void UnpackParticles(const Vec_Byte &data, HostParticles &particles);
+
+        void UploadParticles(const HostParticles &particles, const Vector<uint> &label);
+        void ExchangeParticles();
+        void Rebalance(const Vec_Float3 &ownedPos);
+    };
+
+    typedef SharedPtr<CudaSphDistributedSystem> CudaSphDistributedSystemPtr;
+} // namespace KIRI
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 13:25:51
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description: slab decomposition of the simulation grid
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\system\cuda_sph_domain_decomposition.cuh
+ */
+
+#ifndef _CUDA_SPH_DOMAIN_DECOMPOSITION_CUH_
+#define _CUDA_SPH_DOMAIN_DECOMPOSITION_CUH_
+
+#pragma once
+
+#include <kiri_pbs_cuda/data/cuda_boundary_params.h>
+
+namespace KIRI
+{
+    // splits the neighbor search grid into slabs of whole cell columns along its longest axis,
+    // rank r owns the columns [Cuts()[r], Cuts()[r+1])
+    class CudaSphDomainDecomposition
+    {
+    public:
+        explicit CudaSphDomainDecomposition(
+            const CudaBoundaryParams &bparams,
+            const int numOfRanks,
+            const int haloCells = 2);
+
+        CudaSphDomainDecomposition(const CudaSphDomainDecomposition &) = delete;
+        CudaSphDomainDecomposition &operator=(const CudaSphDomainDecomposition &) = delete;
+
+        int Axis() const { return mAxis; }
+        int NumOfRanks() const { return mNumOfRanks; }
+        int HaloCells() const { return mHaloCells; }
+        int NumOfColumns() const { return mNumOfColumns; }
+        const Vector<int> &Cuts() const { return mCuts; }
+
+        int Column(const float3 &pos) const;
+        int OwnerOfColumn(const int column) const;
+        int Owner(const float3 &pos) const { return OwnerOfColumn(Column(pos)); }
+
+        // halo columns of rank r which its lower/upper neighbor needs
+        bool InLowerHalo(const int rank, const int column) const;
+        bool InUpperHalo(const int rank, const int column) const;
+
+        // number of particles per column
+        Vector<uint> Histogram(const Vec_Float3 &pos) const;
+
+        // max rank load / mean rank load
+        float Imbalance(const Vector<uint> &histogram) const;
+
+        // move the cuts so every rank gets about the same number of particles
+        void Rebalance(const Vector<uint> &histogram);
+
+        ~CudaSphDomainDecomposition() noexcept {}
+
+    private:
+        const CudaBoundaryParams mBoundaryParams;
+        const int mNumOfRanks;
+        const int mHaloCells;
+
+        int mAxis;
+        int mNumOfColumns;
+        Vector<int> mCuts;
+    };
+
+    typedef SharedPtr<CudaSphDomainDecomposition> CudaSphDomainDecompositionPtr;
+} // namespace KIRI
+
+#endif
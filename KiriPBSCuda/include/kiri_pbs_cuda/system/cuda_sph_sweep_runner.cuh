@@ -0,0 +1,92 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-21 14:02:17
+ * @LastEditTime: 2021-02-21 18:45:30
+ * @LastEditors: Xu.WANG
+ * @Description: run many variants of one scene in a single process
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\system\cuda_sph_sweep_runner.cuh
+ */
+
+#ifndef _CUDA_SPH_SWEEP_RUNNER_CUH_
+#define _CUDA_SPH_SWEEP_RUNNER_CUH_
+
+#pragma once
+
+#include <string>
+#include <kiri_pbs_cuda/system/cuda_sph_system.cuh>
+
+namespace KIRI
+{
+    struct CudaSphSweepCase
+    {
+        CudaSphParams params;
+        uint steps;
+    };
+
+    struct CudaSphSweepResult
+    {
+        uint id;
+        CudaSphParams params;
+        uint steps;
+
+        // accumulated solver time(ms) and wall time(ms) of the whole run
+        float solver_time;
+        float wall_time;
+
+        float max_speed;
+        float kinetic_energy;
+        bool finite;
+
+        // empty when the case ran, otherwise why it could not be set up or run
+        std::string error;
+    };
+
+    typedef Vector<CudaSphSweepResult> Vec_SweepResult;
+
+    // every case runs on the runner's CudaBoundaryParams and boundary particles, only the CudaSphParams vary.
+    // boundaries are prepared once in the constructor, so sweeping the domain or the periodic and symmetric axes
+    // needs one runner per boundary setup
+    class CudaSphSweepRunner
+    {
+    public:
+        explicit CudaSphSweepRunner(
+            const Vec_Float3 &fluidPos,
+            const Vec_Float3 &fluidCol,
+            const Vec_Float3 &boundaryPos,
+            const CudaBoundaryParams &boundaryParams,
+            CudaSolverFactory solverFactory = nullptr,
+            const uint numOfThreads = 0);
+
+        CudaSphSweepRunner(const CudaSphSweepRunner &) = delete;
+        CudaSphSweepRunner &operator=(const CudaSphSweepRunner &) = delete;
+
+        void AddCase(const CudaSphParams &params, const uint steps);
+        size_t NumOfCases() const { return mCases.size(); }
+
+        Vec_SweepResult Run();
+
+        static void WriteResultsHeader(std::ostream &os);
+        static void WriteResult(std::ostream &os, const CudaSphSweepResult &result);
+
+        virtual ~CudaSphSweepRunner() noexcept {}
+
+    private:
+        const Vec_Float3 mFluidPos;
+        const Vec_Float3 mFluidCol;
+        const CudaBoundaryParams mBoundaryParams;
+        const uint mNumOfThreads;
+
+        CudaSolverFactory mSolverFactory;
+        Vector<CudaSphSweepCase> mCases;
+
+        // read-only data shared by every run
+        CudaBoundaryParticlesPtr mBoundaries;
+        CudaGNBoundarySearcherPtr mBoundarySearcher;
+
+        CudaSphSweepResult RunCase(const uint id);
+    };
+
+    typedef SharedPtr<CudaSphSweepRunner> CudaSphSweepRunnerPtr;
+} // namespace KIRI
+
+#endif
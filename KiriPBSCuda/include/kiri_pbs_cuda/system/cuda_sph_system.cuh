@@ -15,6 +15,7 @@
 #include <kiri_pbs_cuda/cuda_base_solver.cuh>
 #include <kiri_pbs_cuda/particle/cuda_sph_particles.cuh>
 #include <kiri_pbs_cuda/particle/cuda_boundary_particles.cuh>
+#include <kiri_pbs_cuda/particle/cuda_sph_emitter.cuh>
 #include <kiri_pbs_cuda/searcher/cuda_neighbor_searcher.cuh>
 
 namespace KIRI
@@ -28,6 +29,8 @@ namespace KIRI
             CudaBaseSolverPtr &solver,
             CudaGNSearcherPtr &searcher,
             CudaGNBoundarySearcherPtr &boundarySearcher,
+            const CudaSphParams &params,
+            const CudaBoundaryParams &boundaryParams,
             bool openGL = true);
 
         CudaSphSystem(const CudaSphSystem &) = delete;
@@ -43,6 +46,37 @@ namespace KIRI
 
         auto GetFluids() const { return static_cast<const SharedPtr<CudaSphParticles>>(mFluids); }
 
+        const CudaSphParams &GetParams() const { return mParams; }
+        const CudaBoundaryParams &GetBoundaryParams() const { return mBoundaryParams; }
+        void SetParams(const CudaSphParams &params)
+        {
+            // the resolution levels are counted from rest_mass, the particles would end up between two levels
+            if (params.adaptive && params.rest_mass != mParams.rest_mass)
+                throw "CudaSphSystem: rest_mass cannot change while adaptive resolution is on";
+
+            // the stored state of one scheme means something else to another one, the local time stepping
+            // keeps its levels there and ignores the integrator
+            if (params.integrator != mParams.integrator && !params.local_dt)
+                mFluids->ResetIntegratorState();
+
+            mParams = params;
+            mSearcher->SetDeterministic(mParams.deterministic);
+        }
+
+        // the emitter adds particles at the beginning of every step, up to the capacity of the fluid particles
+        void SetEmitter(const CudaSphEmitterPtr &emitter) { mEmitter = emitter; }
+        const CudaSphEmitterPtr &GetEmitter() const { return mEmitter; }
+
+        // order independent hash of positions and velocities, logged every state_hash_interval steps
+        unsigned long long StateHash() const;
+        uint NumOfSteps() const { return mNumOfSteps; }
+
+        // sort boundary particles and compute their volume once, boundaries can be shared by many systems afterwards
+        static void PrepareBoundaries(
+            const CudaBoundaryParticlesPtr &boundaries,
+            const CudaGNBoundarySearcherPtr &boundarySearcher,
+            const CudaBoundaryParams &bparams);
+
         inline uint PositionsVBO() const { return mPositionsVBO; }
         inline uint ColorsVBO() const { return mColorsVBO; }
 
@@ -54,10 +88,15 @@ namespace KIRI
         CudaBaseSolverPtr mSolver;
         CudaGNSearcherPtr mSearcher;
         CudaGNBoundarySearcherPtr mBoundarySearcher;
+        CudaSphEmitterPtr mEmitter;
+
+        CudaSphParams mParams;
+        CudaBoundaryParams mBoundaryParams;
 
         bool bOpenGL;
 
-        const int mCudaGridSize;
+        int mCudaGridSize;
+        uint mNumOfSteps;
 
         float4 *pptr, *cptr;
 
@@ -74,8 +113,6 @@ namespace KIRI
             float4 *pos,
             float4 *col,
             const CudaSphParticlesPtr &fluids);
-
-        void ComputeBoundaryVolume();
     };
 
     typedef SharedPtr<CudaSphSystem> CudaSphSystemPtr;
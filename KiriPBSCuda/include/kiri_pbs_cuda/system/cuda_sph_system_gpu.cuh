@@ -13,6 +13,7 @@
 #pragma once
 
 #include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
+#include <kiri_pbs_cuda/sph/cuda_sph_solver_common_gpu.cuh>
 
 namespace KIRI
 {
@@ -28,18 +29,19 @@ namespace KIRI
         return;
     }
 
-    template <typename Func>
+    template <typename Func, typename GridXYZ2GridHash>
     __device__ void ComputeBoundaryVolume(
         float *delta,
         const uint i,
         float3 *pos,
         uint j,
         const uint cellEnd,
-        Func W)
+        Func W,
+        GridXYZ2GridHash xyz2hash)
     {
         while (j < cellEnd)
         {
-            *delta += W(length(pos[i] - pos[j]));
+            *delta += W(length(xyz2hash.MinimumImage(pos[i] - pos[j])));
             ++j;
         }
         return;
@@ -54,7 +56,10 @@ namespace KIRI
         const int3 gridSize,
         Pos2GridXYZ p2xyz,
         GridXYZ2GridHash xyz2hash,
-        Func W)
+        Func W,
+        const float3 plane,
+        const uint symmetry,
+        const float kernelSize)
     {
         const uint i = __umul24(blockIdx.x, blockDim.x) + threadIdx.x;
         if (i >= num)
@@ -70,7 +75,29 @@ namespace KIRI
             if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
                 continue;
 
-            ComputeBoundaryVolume(&volume[i], i, pos, cellStart[hashIdx], cellStart[hashIdx + 1], W);
+            ComputeBoundaryVolume(&volume[i], i, pos, cellStart[hashIdx], cellStart[hashIdx + 1], W, xyz2hash);
+        }
+
+        // walls running into a symmetry plane continue on the mirrored side
+        for (uint image = 1; image < 8; ++image)
+        {
+            if (!HasMirrorNeighbors(pos[i], plane, image, symmetry, kernelSize))
+                continue;
+
+            const float3 posm = Mirror(pos[i], plane, image);
+            gridXYZ = p2xyz(posm);
+
+#pragma unroll
+            for (int m = 0; m < 27; ++m)
+            {
+                int3 curGridXYZ = gridXYZ + make_int3(m / 9 - 1, (m % 9) / 3 - 1, m % 3 - 1);
+                const uint hashIdx = xyz2hash(curGridXYZ.x, curGridXYZ.y, curGridXYZ.z);
+                if (hashIdx == (gridSize.x * gridSize.y * gridSize.z))
+                    continue;
+
+                for (uint j = cellStart[hashIdx]; j < cellStart[hashIdx + 1]; ++j)
+                    volume[i] += W(length(xyz2hash.MinimumImage(posm - pos[j])));
+            }
         }
 
         volume[i] = 1.f / fmaxf(volume[i], KIRI_EPSILON);
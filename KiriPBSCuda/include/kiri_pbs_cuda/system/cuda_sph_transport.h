@@ -0,0 +1,143 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 10:12:40
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description: message transport between the ranks of a decomposed domain
+ * @FilePath: \Kiri\KiriPBSCuda\include\kiri_pbs_cuda\system\cuda_sph_transport.h
+ */
+
+#ifndef _CUDA_SPH_TRANSPORT_H_
+#define _CUDA_SPH_TRANSPORT_H_
+
+#pragma once
+
+#include <string>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+#include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
+
+namespace KIRI
+{
+    typedef Vector<char> Vec_Byte;
+
+    // blocking, ordered point-to-point messages between ranks
+    class CudaSphTransport
+    {
+    public:
+        CudaSphTransport() {}
+
+        CudaSphTransport(const CudaSphTransport &) = delete;
+        CudaSphTransport &operator=(const CudaSphTransport &) = delete;
+
+        virtual int Rank() const = 0;
+        virtual int NumOfRanks() const = 0;
+
+        virtual void Send(const int dst, const Vec_Byte &data) = 0;
+        virtual Vec_Byte Recv(const int src) = 0;
+
+        // the lower rank sends first, so two blocking transports never wait on each other
+        Vec_Byte Exchange(const int peer, const Vec_Byte &data);
+
+        // every rank receives the element-wise sum of all ranks' data
+        void AllReduceSum(Vector<uint> &data);
+
+        virtual ~CudaSphTransport() noexcept {}
+    };
+
+    typedef SharedPtr<CudaSphTransport> CudaSphTransportPtr;
+
+    // mailboxes shared by the ranks living in one process(one thread per rank)
+    class CudaSphLocalTransportHub
+    {
+    public:
+        explicit CudaSphLocalTransportHub(const int numOfRanks);
+
+        CudaSphLocalTransportHub(const CudaSphLocalTransportHub &) = delete;
+        CudaSphLocalTransportHub &operator=(const CudaSphLocalTransportHub &) = delete;
+
+        int NumOfRanks() const { return mNumOfRanks; }
+
+        void Push(const int src, const int dst, const Vec_Byte &data);
+        Vec_Byte Pop(const int src, const int dst);
+
+        ~CudaSphLocalTransportHub() noexcept {}
+
+    private:
+        struct MailBox
+        {
+            std::mutex mutex;
+            std::condition_variable cond;
+            std::queue<Vec_Byte> messages;
+        };
+
+        const int mNumOfRanks;
+        Vector<UniquePtr<MailBox>> mMailBoxes;
+    };
+
+    typedef SharedPtr<CudaSphLocalTransportHub> CudaSphLocalTransportHubPtr;
+
+    class CudaSphLocalTransport final : public CudaSphTransport
+    {
+    public:
+        explicit CudaSphLocalTransport(
+            const CudaSphLocalTransportHubPtr &hub,
+            const int rank)
+            : mHub(hub),
+              mRank(rank) {}
+
+        CudaSphLocalTransport(const CudaSphLocalTransport &) = delete;
+        CudaSphLocalTransport &operator=(const CudaSphLocalTransport &) = delete;
+
+        virtual int Rank() const override { return mRank; }
+        virtual int NumOfRanks() const override { return mHub->NumOfRanks(); }
+
+        virtual void Send(const int dst, const Vec_Byte &data) override;
+        virtual Vec_Byte Recv(const int src) override;
+
+        virtual ~CudaSphLocalTransport() noexcept {}
+
+    private:
+        CudaSphLocalTransportHubPtr mHub;
+        const int mRank;
+    };
+
+    // fully connected TCP mesh, address[i] is "host:port" of rank i
+    class CudaSphSocketTransport final : public CudaSphTransport
+    {
+    public:
+        explicit CudaSphSocketTransport(
+            const int rank,
+            const Vector<std::string> &address);
+
+        CudaSphSocketTransport(const CudaSphSocketTransport &) = delete;
+        CudaSphSocketTransport &operator=(const CudaSphSocketTransport &) = delete;
+
+        virtual int Rank() const override { return mRank; }
+        virtual int NumOfRanks() const override { return static_cast<int>(mSockets.size()); }
+
+        virtual void Send(const int dst, const Vec_Byte &data) override;
+        virtual Vec_Byte Recv(const int src) override;
+
+        virtual ~CudaSphSocketTransport() noexcept;
+
+    private:
+        const int mRank;
+
+        // platform socket handles, stored as 64 bit to cover SOCKET on windows
+        Vector<long long> mSockets;
+
+        // connects the mesh, sockets opened before a failure are left in mSockets
+        void Connect(const Vector<std::string> &address);
+
+        // closes every socket of the mesh and releases winsock
+        void CloseSockets() noexcept;
+
+        void SendAll(const long long socket, const char *data, size_t size);
+        void RecvAll(const long long socket, char *data, size_t size);
+    };
+} // namespace KIRI
+
+#endif
@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <thrust/tuple.h>
 #include <kiri_pbs_cuda/kiri_pbs_pch.cuh>
 
 namespace ThrustHelper
@@ -40,6 +41,69 @@ namespace ThrustHelper
         }
     };
 
+    struct Length
+    {
+        __host__ __device__ float operator()(const float3 &a) const
+        {
+            return length(a);
+        }
+    };
+
+    struct LengthSquared
+    {
+        __host__ __device__ float operator()(const float3 &a) const
+        {
+            return dot(a, a);
+        }
+    };
+
+    // per component product, with thrust::plus it gives three dot products in one reduction
+    struct ComponentProduct
+    {
+        __host__ __device__ float3 operator()(const float3 &a, const float3 &b) const
+        {
+            return a * b;
+        }
+    };
+
+    static inline __host__ __device__ unsigned long long MixHash(unsigned long long x)
+    {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static inline __host__ __device__ unsigned long long FloatBits(const float a, const float b)
+    {
+        union
+        {
+            float f;
+            uint u;
+        } ua, ub;
+        ua.f = a;
+        ub.f = b;
+        return ((unsigned long long)ua.u << 32) | ub.u;
+    }
+
+    // bit exact hash of one particle state, summing it over all particles does not depend on the reduction order
+    struct ParticleStateHash
+    {
+        __host__ __device__ unsigned long long operator()(const thrust::tuple<uint, float3, float3> &t) const
+        {
+            const float3 p = thrust::get<1>(t);
+            const float3 v = thrust::get<2>(t);
+            unsigned long long h = MixHash(thrust::get<0>(t));
+            h = MixHash(h ^ FloatBits(p.x, p.y));
+            h = MixHash(h ^ FloatBits(p.z, v.x));
+            h = MixHash(h ^ FloatBits(v.y, v.z));
+            return h;
+        }
+    };
+
     static inline __host__ __device__ int3 ComputeGridXYZByPos3(const float3 &pos, const float cellSize, const int3 &gridSize)
     {
         int x = min(max((int)(pos.x / cellSize), 0), gridSize.x - 1),
@@ -104,16 +168,38 @@ namespace ThrustHelper
     struct GridXYZ2GridHash
     {
         int3 mGridSize;
-        __host__ __device__ GridXYZ2GridHash(const int3 &gridSize)
-            : mGridSize(gridSize) {}
+
+        // domain length on the periodic axes and 0 on the closed ones, periodic cell coordinates wrap around
+        float3 mPeriod;
+        __host__ __device__ GridXYZ2GridHash(const int3 &gridSize, const float3 &period = make_float3(0.f))
+            : mGridSize(gridSize), mPeriod(period) {}
 
         template <typename T>
         __host__ __device__ uint operator()(T x, T y, T z)
         {
+            if (mPeriod.x > 0.f)
+                x = (x % mGridSize.x + mGridSize.x) % mGridSize.x;
+            if (mPeriod.y > 0.f)
+                y = (y % mGridSize.y + mGridSize.y) % mGridSize.y;
+            if (mPeriod.z > 0.f)
+                z = (z % mGridSize.z + mGridSize.z) % mGridSize.z;
+
             return (x >= 0 && x < mGridSize.x && y >= 0 && y < mGridSize.y && z >= 0 && z < mGridSize.z)
                        ? (((x * mGridSize.y) + y) * mGridSize.z + z)
                        : (mGridSize.x * mGridSize.y * mGridSize.z);
         }
+
+        // nearest image of a distance vector p_i - p_j
+        __host__ __device__ float3 MinimumImage(float3 d) const
+        {
+            if (mPeriod.x > 0.f)
+                d.x -= mPeriod.x * rintf(d.x / mPeriod.x);
+            if (mPeriod.y > 0.f)
+                d.y -= mPeriod.y * rintf(d.y / mPeriod.y);
+            if (mPeriod.z > 0.f)
+                d.z -= mPeriod.z * rintf(d.z / mPeriod.z);
+            return d;
+        }
     };
 
 } // namespace ThrustHelper
@@ -0,0 +1,167 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-26 18:10:25
+ * @LastEditTime: 2021-02-26 22:47:03
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\particle\cuda_sph_emitter.cu
+ */
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <kiri_pbs_cuda/particle/cuda_sph_emitter.cuh>
+#include <kiri_pbs_cuda/particle/particles_sampler_poisson.h>
+
+namespace KIRI
+{
+    namespace
+    {
+        // shifts of the tile for the consecutive layers, a new layer never lines up with the previous one
+        const uint kNumOfLayers = 8;
+
+        typedef std::tuple<bool, float, float, float, float, uint> PatternKey;
+
+        std::mutex &PatternMutex()
+        {
+            static std::mutex m;
+            return m;
+        }
+
+        std::map<PatternKey, CudaEmitterPatternPtr> &PatternCache()
+        {
+            static std::map<PatternKey, CudaEmitterPatternPtr> cache;
+            return cache;
+        }
+    } // namespace
+
+    CudaSphEmitter::CudaSphEmitter(
+        const float3 position,
+        const float3 velocity,
+        const float3 color,
+        const float particleRadius,
+        const bool squareShaped,
+        const float emitRadius,
+        const float emitWidth,
+        const float emitHeight,
+        const uint seed)
+        : mPosition(position),
+          mVelocity(velocity),
+          mColor(color),
+          mSpacing(particleRadius * 2.f),
+          mDistance(particleRadius * 2.f), // the first step emits the first layer
+          mLayer(0),
+          mNumOfEmitted(0),
+          bEnable(true)
+    {
+        const float speed = length(velocity);
+        if (speed < KIRI_EPSILON)
+        {
+            printf("CudaSphEmitter: zero velocity, the emitter is disabled\n");
+            bEnable = false;
+            mDirection = make_float3(0.f, 1.f, 0.f);
+        }
+        else
+            mDirection = velocity / speed;
+
+        // the layers lie in the plane orthogonal to the velocity
+        const float3 helper = fabsf(mDirection.y) < 0.9f ? make_float3(0.f, 1.f, 0.f) : make_float3(1.f, 0.f, 0.f);
+        mAxisU = normalize(cross(helper, mDirection));
+        mAxisV = cross(mDirection, mAxisU);
+
+        mPattern = GetPattern(squareShaped, emitRadius, emitWidth, emitHeight, mSpacing, seed);
+    }
+
+    uint CudaSphEmitter::Emit(CudaSphParticlesPtr &fluids, const float dt, const float mass)
+    {
+        if (!bEnable || mPattern->NumOfLayers() == 0)
+            return 0;
+
+        uint emitted = 0;
+        mDistance += length(mVelocity) * dt;
+        while (mDistance >= mSpacing)
+        {
+            mDistance -= mSpacing;
+
+            // the layer has already travelled the rest of the distance during this step
+            const uint layer = mLayer++ % mPattern->NumOfLayers();
+            const uint num = mPattern->LayerSize(layer);
+            const uint count = fluids->AppendParticles(
+                mPattern->offsets.Data(mPattern->layerStart[layer]),
+                num,
+                mPosition + mDistance * mDirection,
+                mAxisU,
+                mAxisV,
+                mVelocity,
+                mColor,
+                mass);
+
+            emitted += count;
+            if (count < num)
+            {
+                mDistance = 0.f;
+                break;
+            }
+        }
+
+        mNumOfEmitted += emitted;
+        return emitted;
+    }
+
+    CudaEmitterPatternPtr CudaSphEmitter::GetPattern(
+        const bool squareShaped,
+        const float emitRadius,
+        const float emitWidth,
+        const float emitHeight,
+        const float spacing,
+        const uint seed)
+    {
+        const PatternKey key(squareShaped, squareShaped ? 0.f : emitRadius, squareShaped ? emitWidth : 0.f, squareShaped ? emitHeight : 0.f, spacing, seed);
+
+        std::lock_guard<std::mutex> lock(PatternMutex());
+        auto &cache = PatternCache();
+        auto iter = cache.find(key);
+        if (iter != cache.end())
+            return iter->second;
+
+        const float2 extent = squareShaped ? make_float2(emitWidth, emitHeight) : make_float2(2.f * emitRadius);
+
+        float2 tileSize;
+        ParticlesSamplerPoisson sampler(seed);
+        const auto tile = sampler.GetTileSampling(extent, spacing, tileSize);
+
+        // every shift of the periodic tile is still a poisson disk set, the window is centered on the emitter
+        Vec_Float2 offsets;
+        Vector<uint> layerStart(1, 0);
+        for (uint layer = 0; layer < kNumOfLayers; ++layer)
+        {
+            const float2 shift = make_float2(fmodf(layer * 0.7548776662f, 1.f), fmodf(layer * 0.5698402910f, 1.f)) * tileSize;
+            for (const auto &p : tile)
+            {
+                const float2 q = make_float2(fmodf(p.x + shift.x, tileSize.x), fmodf(p.y + shift.y, tileSize.y)) - 0.5f * tileSize;
+                const bool inside = squareShaped ? (fabsf(q.x) <= 0.5f * emitWidth && fabsf(q.y) <= 0.5f * emitHeight)
+                                                 : (q.x * q.x + q.y * q.y <= emitRadius * emitRadius);
+                if (inside)
+                    offsets.emplace_back(q);
+            }
+            layerStart.emplace_back(static_cast<uint>(offsets.size()));
+        }
+
+        auto pattern = std::make_shared<CudaEmitterPattern>(static_cast<uint>(offsets.size()));
+        pattern->layerStart = std::move(layerStart);
+        if (!offsets.empty())
+            KIRI_CUCALL(cudaMemcpy(pattern->offsets.Data(), &offsets[0], sizeof(float2) * offsets.size(), cudaMemcpyHostToDevice));
+
+        printf("CudaSphEmitter: sampled %u layers with %u particles on average\n", kNumOfLayers, static_cast<uint>(offsets.size() / kNumOfLayers));
+
+        cache[key] = pattern;
+        return pattern;
+    }
+
+    void CudaSphEmitter::ClearPatternCache()
+    {
+        std::lock_guard<std::mutex> lock(PatternMutex());
+        PatternCache().clear();
+    }
+
+} // namespace KIRI
@@ -7,27 +7,230 @@
  * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\particle\cuda_sph_particles.cu
  */
 
+#include <thrust/functional.h>
+#include <thrust/remove.h>
+#include <thrust/iterator/counting_iterator.h>
 #include <kiri_pbs_cuda/particle/cuda_sph_particles.cuh>
 namespace KIRI
 {
 
-    void CudaSphParticles::Advect(const float dt)
+    void CudaSphParticles::Advect(const float dt, const bool onlyActive, const IntegratorType integrator)
     {
-        thrust::transform(thrust::device,
-                          mVel.Data(), mVel.Data() + Size(),
-                          mAcc.Data(),
-                          mVel.Data(),
-                          [dt] __host__ __device__(const float3 &lv, const float3 &a) {
-                              return lv + dt * a;
-                          });
+        float3 *pos = mPos.Data();
+        float3 *vel = mVel.Data();
+        const float3 *acc = mAcc.Data();
+        float4 *state = mIntegratorState.Data();
+        const uint *active = onlyActive ? mActive.Data() : nullptr;
+
+        const float halfDt = 0.5f * dt;
+        thrust::for_each(thrust::device,
+                         thrust::counting_iterator<uint>(0),
+                         thrust::counting_iterator<uint>(Size()),
+                         [pos, vel, acc, state, active, dt, halfDt, integrator] __host__ __device__(const uint i) {
+                             if (active != nullptr && active[i] == 0)
+                                 return;
+
+                             const float3 a = acc[i];
+                             float3 v = vel[i];
+
+                             if (integrator == IntegratorType::Leapfrog)
+                             {
+                                 // closing kick of the last step, then opening kick and drift of this one
+                                 const float4 s = state[i];
+                                 const float3 lastHalfVel = s.w != 0.f ? make_float3(s) : v - halfDt * a;
+                                 const float3 halfVel = lastHalfVel + dt * a;
+                                 pos[i] += dt * halfVel;
+                                 vel[i] = halfVel + halfDt * a;
+                                 state[i] = make_float4(halfVel, 1.f);
+                             }
+                             else if (integrator == IntegratorType::VelocityVerlet)
+                             {
+                                 // the stored velocity was predicted with the last acceleration only
+                                 const float4 s = state[i];
+                                 const float3 lastAcc = s.w != 0.f ? make_float3(s) : a;
+                                 v += halfDt * (a - lastAcc);
+                                 pos[i] += dt * v + halfDt * dt * a;
+                                 vel[i] = v + dt * a;
+                                 state[i] = make_float4(a, 1.f);
+                             }
+                             else
+                             {
+                                 v += dt * a;
+                                 pos[i] += dt * v;
+                                 vel[i] = v;
+                             }
+                         });
+    }
+
+    void CudaSphParticles::ResetIntegratorState()
+    {
+        thrust::fill(thrust::device, mIntegratorState.Data(), mIntegratorState.Data() + Size(), make_float4(0.f));
+    }
+
+    void CudaSphParticles::SetParticles(
+        const Vec_Float3 &pos,
+        const Vec_Float3 &vel,
+        const Vec_Float3 &col,
+        const Vector<uint> &label,
+        const float mass)
+    {
+        uint num = pos.size();
+        if (num > MaxSize())
+        {
+            printf("CudaSphParticles: %u particles exceed the capacity %u, the rest will be dropped\n", num, MaxSize());
+            num = MaxSize();
+        }
+
+        mNumOfParticles = num;
+        if (num == 0)
+            return;
+
+        KIRI_CUCALL(cudaMemcpy(mPos.Data(), &pos[0], sizeof(float3) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mVel.Data(), &vel[0], sizeof(float3) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mCol.Data(), &col[0], sizeof(float3) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mLabel.Data(), &label[0], sizeof(uint) * num, cudaMemcpyHostToDevice));
+
+        thrust::fill(thrust::device, mMass.Data(), mMass.Data() + num, mass);
+        thrust::fill(thrust::device, mSmoothingLength.Data(), mSmoothingLength.Data() + num, 0.f);
+        thrust::fill(thrust::device, mAcc.Data(), mAcc.Data() + num, make_float3(0.f));
+        thrust::fill(thrust::device, mDensity.Data(), mDensity.Data() + num, 0.f);
+        thrust::fill(thrust::device, mPressure.Data(), mPressure.Data() + num, 0.f);
+        thrust::fill(thrust::device, mActive.Data(), mActive.Data() + num, 1u);
+        thrust::fill(thrust::device, mIntegratorState.Data(), mIntegratorState.Data() + num, make_float4(0.f));
+    }
+
+    void CudaSphParticles::SetParticles(
+        const Vec_Float3 &pos,
+        const Vec_Float3 &vel,
+        const Vec_Float3 &col,
+        const Vector<uint> &label,
+        const Vector<float> &mass,
+        const Vector<float> &smoothingLength,
+        const Vector<uint> &active,
+        const Vector<float4> &integratorState)
+    {
+        SetParticles(pos, vel, col, label, 0.f);
+
+        const uint num = Size();
+        if (num == 0)
+            return;
+
+        KIRI_CUCALL(cudaMemcpy(mMass.Data(), &mass[0], sizeof(float) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mSmoothingLength.Data(), &smoothingLength[0], sizeof(float) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mActive.Data(), &active[0], sizeof(uint) * num, cudaMemcpyHostToDevice));
+        KIRI_CUCALL(cudaMemcpy(mIntegratorState.Data(), &integratorState[0], sizeof(float4) * num, cudaMemcpyHostToDevice));
+    }
+
+    uint CudaSphParticles::AppendParticles(
+        const float2 *offsets,
+        const uint num,
+        const float3 origin,
+        const float3 axisU,
+        const float3 axisV,
+        const float3 vel,
+        const float3 col,
+        const float mass)
+    {
+        const uint start = Size();
+        const uint count = min(num, MaxSize() - start);
+        if (count == 0)
+            return 0;
 
         thrust::transform(thrust::device,
-                          mPos.Data(), mPos.Data() + Size(),
-                          mVel.Data(),
-                          mPos.Data(),
-                          [dt] __host__ __device__(const float3 &lp, const float3 &v) {
-                              return lp + dt * v;
+                          offsets, offsets + count,
+                          mPos.Data(start),
+                          [origin, axisU, axisV] __host__ __device__(const float2 &o) {
+                              return origin + o.x * axisU + o.y * axisV;
                           });
+
+        thrust::fill(thrust::device, mVel.Data(start), mVel.Data(start + count), vel);
+        thrust::fill(thrust::device, mAcc.Data(start), mAcc.Data(start + count), make_float3(0.f));
+        thrust::fill(thrust::device, mCol.Data(start), mCol.Data(start + count), col);
+        thrust::fill(thrust::device, mMass.Data(start), mMass.Data(start + count), mass);
+        thrust::fill(thrust::device, mSmoothingLength.Data(start), mSmoothingLength.Data(start + count), 0.f);
+        thrust::fill(thrust::device, mDensity.Data(start), mDensity.Data(start + count), 0.f);
+        thrust::fill(thrust::device, mPressure.Data(start), mPressure.Data(start + count), 0.f);
+        thrust::fill(thrust::device, mLabel.Data(start), mLabel.Data(start + count), 0u);
+        thrust::fill(thrust::device, mActive.Data(start), mActive.Data(start + count), 1u);
+        thrust::fill(thrust::device, mIntegratorState.Data(start), mIntegratorState.Data(start + count), make_float4(0.f));
+
+        mNumOfParticles += count;
+        return count;
+    }
+
+    uint CudaSphParticles::Extend(const uint num)
+    {
+        const uint count = min(num, MaxSize() - Size());
+        mNumOfParticles += count;
+        return count;
+    }
+
+    uint CudaSphParticles::RemoveParticles(const uint *removed)
+    {
+        const uint num = Size();
+
+        // a thrust tuple holds at most ten iterators, both passes use the same stencil
+        auto first = thrust::make_zip_iterator(
+            thrust::make_tuple(
+                mPos.Data(),
+                mVel.Data(),
+                mAcc.Data(),
+                mCol.Data(),
+                mMass.Data(),
+                mSmoothingLength.Data()));
+        auto last = thrust::remove_if(thrust::device, first, first + num, removed, thrust::identity<uint>());
+
+        auto second = thrust::make_zip_iterator(
+            thrust::make_tuple(
+                mPressure.Data(),
+                mDensity.Data(),
+                mLabel.Data(),
+                mActive.Data(),
+                mIntegratorState.Data()));
+        thrust::remove_if(thrust::device, second, second + num, removed, thrust::identity<uint>());
+
+        mNumOfParticles = static_cast<uint>(last - first);
+        return mNumOfParticles;
+    }
+
+    void CudaSphParticles::GetParticles(
+        Vec_Float3 &pos,
+        Vec_Float3 &vel,
+        Vec_Float3 &col,
+        Vector<uint> &label) const
+    {
+        uint num = Size();
+        pos.resize(num);
+        vel.resize(num);
+        col.resize(num);
+        label.resize(num);
+        if (num == 0)
+            return;
+
+        KIRI_CUCALL(cudaMemcpy(&pos[0], mPos.Data(), sizeof(float3) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&vel[0], mVel.Data(), sizeof(float3) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&col[0], mCol.Data(), sizeof(float3) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&label[0], mLabel.Data(), sizeof(uint) * num, cudaMemcpyDeviceToHost));
+    }
+
+    void CudaSphParticles::GetParticleState(
+        Vector<float> &mass,
+        Vector<float> &smoothingLength,
+        Vector<uint> &active,
+        Vector<float4> &integratorState) const
+    {
+        uint num = Size();
+        mass.resize(num);
+        smoothingLength.resize(num);
+        active.resize(num);
+        integratorState.resize(num);
+        if (num == 0)
+            return;
+
+        KIRI_CUCALL(cudaMemcpy(&mass[0], mMass.Data(), sizeof(float) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&smoothingLength[0], mSmoothingLength.Data(), sizeof(float) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&active[0], mActive.Data(), sizeof(uint) * num, cudaMemcpyDeviceToHost));
+        KIRI_CUCALL(cudaMemcpy(&integratorState[0], mIntegratorState.Data(), sizeof(float4) * num, cudaMemcpyDeviceToHost));
     }
 
 } // namespace KIRI
@@ -0,0 +1,232 @@
+/*** 
+ * @Author: Xu.WANG
+ * @Date: 2021-02-26 13:20:41
+ * @LastEditTime: 2021-02-26 18:02:15
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\particle\particles_sampler_poisson.cpp
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <kiri_pbs_cuda/particle/particles_sampler_poisson.h>
+
+namespace
+{
+    // the trials of a cell are split into rounds, every round visits all phase groups,
+    // so late groups don't only fill the gaps left by the early ones
+    const uint kNumOfRounds = 4;
+
+    inline unsigned long long MixHash(unsigned long long x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // one hash per candidate, 21 bits for each coordinate inside the cell
+    inline void Candidate(const uint seed, const uint cell, const uint trial, float u[3])
+    {
+        const unsigned long long h = MixHash(MixHash(MixHash(seed) ^ cell) ^ trial);
+        for (int d = 0; d < 3; ++d)
+            u[d] = static_cast<float>((h >> (21 * d)) & 0x1FFFFF) * (1.f / 2097152.f);
+    }
+
+    template <class Function>
+    void ParallelFor(const uint num, const uint numOfThreads, const Function &func)
+    {
+        const uint threads = std::min(numOfThreads, (num + 255) / 256);
+        if (threads <= 1)
+        {
+            for (uint i = 0; i < num; ++i)
+                func(i);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        const uint chunk = (num + threads - 1) / threads;
+        for (uint t = 0; t < threads; ++t)
+        {
+            const uint begin = t * chunk, end = std::min(num, begin + chunk);
+            workers.emplace_back([&func, begin, end]() {
+                for (uint i = begin; i < end; ++i)
+                    func(i);
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+    }
+} // namespace
+
+ParticlesSamplerPoisson::ParticlesSamplerPoisson(const uint seed, const uint numOfTrials)
+    : mSeed(seed != 0 ? seed : std::random_device()()),
+      mNumOfTrials(std::max(numOfTrials, 1u)),
+      mNumOfThreads(std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+std::vector<float3> ParticlesSamplerPoisson::GetBoxSampling(float3 lower, float3 upper, float minDistance)
+{
+    std::vector<float3> points;
+    const float extent[3] = {upper.x - lower.x, upper.y - lower.y, upper.z - lower.z};
+    if (minDistance <= 0.f || extent[0] < 0.f || extent[1] < 0.f || extent[2] < 0.f)
+        return points;
+
+    // the cell diagonal equals the minimum distance, the last cell of each axis may stick out of the box
+    const float cellSize = minDistance / std::sqrt(3.f);
+    int n[3];
+    for (int d = 0; d < 3; ++d)
+        n[d] = std::max(1, static_cast<int>(std::floor(extent[d] / cellSize)) + 1);
+
+    std::vector<float> samples;
+    Sampling(3, n, cellSize, extent, false, minDistance, samples);
+
+    points.reserve(samples.size() / 3);
+    for (size_t i = 0; i < samples.size(); i += 3)
+        points.emplace_back(make_float3(lower.x + samples[i], lower.y + samples[i + 1], lower.z + samples[i + 2]));
+
+    return points;
+}
+
+std::vector<float2> ParticlesSamplerPoisson::GetTileSampling(float2 minSize, float minDistance, float2 &size)
+{
+    std::vector<float2> points;
+    size = make_float2(0.f);
+    if (minDistance <= 0.f)
+        return points;
+
+    // the number of cells is a multiple of three, so the phase groups stay three cells apart across the seams
+    const float cellSize = minDistance / std::sqrt(2.f);
+    const float minExtent[2] = {minSize.x, minSize.y};
+    int n[3] = {0, 0, 1};
+    float extent[3] = {0.f, 0.f, 0.f};
+    for (int d = 0; d < 2; ++d)
+    {
+        n[d] = 3 * std::max(1, static_cast<int>(std::ceil(minExtent[d] / (3.f * cellSize))));
+        extent[d] = n[d] * cellSize;
+    }
+    size = make_float2(extent[0], extent[1]);
+
+    std::vector<float> samples;
+    Sampling(2, n, cellSize, extent, true, minDistance, samples);
+
+    points.reserve(samples.size() / 2);
+    for (size_t i = 0; i < samples.size(); i += 2)
+        points.emplace_back(make_float2(samples[i], samples[i + 1]));
+
+    return points;
+}
+
+void ParticlesSamplerPoisson::Sampling(
+    const int dim,
+    const int n[3],
+    const float cellSize,
+    const float extent[3],
+    const bool periodic,
+    const float minDistance,
+    std::vector<float> &samples)
+{
+    const uint numOfCells = static_cast<uint>(n[0] * n[1] * n[2]);
+    std::vector<float> cellPos(static_cast<size_t>(numOfCells) * dim, 0.f);
+    std::vector<unsigned char> occupied(numOfCells, 0);
+
+    const float minDistance2 = minDistance * minDistance;
+    const int numOfPhases = dim == 3 ? 27 : 9;
+
+    // neighbor cells which can hold a conflicting sample, the closest first so that a rejection is found early
+    std::vector<std::array<int, 4>> offsets;
+    for (int z = (dim == 3 ? -2 : 0); z <= (dim == 3 ? 2 : 0); ++z)
+        for (int y = -2; y <= 2; ++y)
+            for (int x = -2; x <= 2; ++x)
+            {
+                const int gap = std::max(std::abs(x) - 1, 0) * std::max(std::abs(x) - 1, 0) +
+                                std::max(std::abs(y) - 1, 0) * std::max(std::abs(y) - 1, 0) +
+                                std::max(std::abs(z) - 1, 0) * std::max(std::abs(z) - 1, 0);
+                if (gap * cellSize * cellSize < minDistance2)
+                    offsets.push_back({x, y, z, x * x + y * y + z * z});
+            }
+    std::stable_sort(offsets.begin(), offsets.end(), [](const std::array<int, 4> &a, const std::array<int, 4> &b) { return a[3] < b[3]; });
+
+    for (uint round = 0; round < kNumOfRounds; ++round)
+    {
+        const uint trialBegin = round * mNumOfTrials / kNumOfRounds;
+        const uint trialEnd = (round + 1) * mNumOfTrials / kNumOfRounds;
+        if (trialBegin == trialEnd)
+            continue;
+
+        for (int phase = 0; phase < numOfPhases; ++phase)
+        {
+            const int px = phase % 3, py = (phase / 3) % 3, pz = phase / 9;
+            const int gx = (n[0] - px + 2) / 3, gy = (n[1] - py + 2) / 3, gz = (n[2] - pz + 2) / 3;
+            if (gx <= 0 || gy <= 0 || gz <= 0)
+                continue;
+
+            ParallelFor(static_cast<uint>(gx * gy * gz), mNumOfThreads, [&](uint g) {
+                const int c[3] = {px + 3 * static_cast<int>(g % gx), py + 3 * static_cast<int>((g / gx) % gy), pz + 3 * static_cast<int>(g / (gx * gy))};
+                const uint cell = static_cast<uint>((c[2] * n[1] + c[1]) * n[0] + c[0]);
+                if (occupied[cell])
+                    return;
+
+                for (uint trial = trialBegin; trial < trialEnd; ++trial)
+                {
+                    float u[3], p[3];
+                    Candidate(mSeed, cell, trial, u);
+                    bool inside = true;
+                    for (int d = 0; d < dim; ++d)
+                    {
+                        p[d] = (c[d] + u[d]) * cellSize;
+                        inside = inside && (periodic || p[d] <= extent[d]);
+                    }
+                    if (!inside)
+                        continue;
+
+                    bool conflict = false;
+                    for (size_t m = 0; m < offsets.size() && !conflict; ++m)
+                    {
+                        int nc[3] = {c[0] + offsets[m][0], c[1] + offsets[m][1], c[2] + offsets[m][2]};
+                        bool valid = true;
+                        for (int d = 0; d < dim; ++d)
+                        {
+                            if (periodic)
+                                nc[d] = (nc[d] + n[d]) % n[d];
+                            else if (nc[d] < 0 || nc[d] >= n[d])
+                                valid = false;
+                        }
+
+                        const uint neighbor = static_cast<uint>((nc[2] * n[1] + nc[1]) * n[0] + nc[0]);
+                        if (!valid || !occupied[neighbor])
+                            continue;
+
+                        float dist2 = 0.f;
+                        for (int d = 0; d < dim; ++d)
+                        {
+                            float delta = p[d] - cellPos[neighbor * dim + d];
+                            if (periodic)
+                                delta -= extent[d] * std::round(delta / extent[d]);
+                            dist2 += delta * delta;
+                        }
+                        conflict = dist2 < minDistance2;
+                    }
+
+                    if (!conflict)
+                    {
+                        for (int d = 0; d < dim; ++d)
+                            cellPos[cell * dim + d] = p[d];
+                        occupied[cell] = 1;
+                        return;
+                    }
+                }
+            });
+        }
+    }
+
+    // cell order, independent of the thread schedule
+    samples.clear();
+    for (uint cell = 0; cell < numOfCells; ++cell)
+        if (occupied[cell])
+            samples.insert(samples.end(), cellPos.begin() + cell * dim, cellPos.begin() + (cell + 1) * dim);
+}
@@ -7,9 +7,19 @@
  * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\searcher\cuda_neighbor_searcher.cu
  */
 
+#include <thrust/sort.h>
+#include <thrust/merge.h>
+#include <thrust/gather.h>
+#include <thrust/sequence.h>
+#include <thrust/partition.h>
+#include <thrust/inner_product.h>
+#include <thrust/binary_search.h>
+#include <thrust/iterator/counting_iterator.h>
+
 #include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
 #include <kiri_pbs_cuda/searcher/cuda_neighbor_searcher.cuh>
 #include <kiri_pbs_cuda/searcher/cuda_neighbor_searcher_gpu.cuh>
+#include <kiri_pbs_cuda/sph/cuda_sph_solver_common_gpu.cuh>
 
 namespace KIRI
 {
@@ -25,25 +35,44 @@ namespace KIRI
           mGridSize(make_int3((highestPoint - lowestPoint) / cellSize)),
           mNumOfGridCells(mGridSize.x * mGridSize.y * mGridSize.z + 1),
           mCellStart(mNumOfGridCells),
-          mNumOfParticles(numOfParticles),
-          mGridIdxArray(max(mNumOfGridCells, mNumOfParticles)),
-          mCudaGridSize(CuCeilDiv(numOfParticles, KIRI_CUBLOCKSIZE))
+          mMaxNumOfParticles(numOfParticles),
+          mGridIdxArray(max(mNumOfGridCells, mMaxNumOfParticles))
     {
     }
 
     void CudaGNBaseSearcher::BuildGNSearcher(const CudaParticlesPtr &particles)
     {
+        // the number of particles may change between two builds, but never exceeds the capacity
+        const uint num = min(particles->Size(), mMaxNumOfParticles);
 
         thrust::transform(thrust::device,
-                          particles->GetPosPtr(), particles->GetPosPtr() + mNumOfParticles,
+                          particles->GetPosPtr(), particles->GetPosPtr() + num,
                           mGridIdxArray.Data(),
                           ThrustHelper::Pos2GridHash<float3>(mLowestPoint, mCellSize, mGridSize));
 
         this->SortData(particles);
+        BuildCellStart(num);
+    }
 
-        thrust::fill(thrust::device, mCellStart.Data(), mCellStart.Data() + mNumOfGridCells, 0);
-        CountingInCell_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(mCellStart.Data(), mGridIdxArray.Data(), mNumOfParticles);
-        thrust::exclusive_scan(thrust::device, mCellStart.Data(), mCellStart.Data() + mNumOfGridCells, mCellStart.Data());
+    void CudaGNBaseSearcher::BuildCellStart(const uint num)
+    {
+        const uint cudaGridSize = CuCeilDiv(num, KIRI_CUBLOCKSIZE);
+        if (bDeterministic)
+        {
+            // order independent: every cell looks up its first particle in the sorted keys
+            thrust::lower_bound(thrust::device,
+                                mGridIdxArray.Data(), mGridIdxArray.Data() + num,
+                                thrust::counting_iterator<uint>(0),
+                                thrust::counting_iterator<uint>(mNumOfGridCells),
+                                mCellStart.Data());
+        }
+        else
+        {
+            thrust::fill(thrust::device, mCellStart.Data(), mCellStart.Data() + mNumOfGridCells, 0);
+            if (num > 0)
+                CountingInCell_CUDA<<<cudaGridSize, KIRI_CUBLOCKSIZE>>>(mCellStart.Data(), mGridIdxArray.Data(), num);
+            thrust::exclusive_scan(thrust::device, mCellStart.Data(), mCellStart.Data() + mNumOfGridCells, mCellStart.Data());
+        }
 
         KIRI_CUKERNAL();
     }
@@ -53,19 +82,182 @@ namespace KIRI
         const float3 hp,
         const uint num,
         const float cellSize)
-        : CudaGNBaseSearcher(lp, hp, num, cellSize) {}
+        : CudaGNBaseSearcher(lp, hp, num, cellSize),
+          mIncrementalSortThreshold(0.f),
+          bHasSortedKeys(false),
+          mNumOfSorted(0),
+          mNumOfChanged(0),
+          mSortedGridIdx(num),
+          mSortIdx(num),
+          mMergedIdx(num),
+          mScratchUInt(num),
+          mScratchFloat(num),
+          mScratchFloat3(num),
+          mScratchFloat4(num) {}
 
     void CudaGNSearcher::SortData(const CudaParticlesPtr &particles)
     {
         auto fluids = std::dynamic_pointer_cast<CudaSphParticles>(particles);
-        thrust::sort_by_key(thrust::device,
-                            mGridIdxArray.Data(),
-                            mGridIdxArray.Data() + mNumOfParticles,
-                            thrust::make_zip_iterator(
-                                thrust::make_tuple(
-                                    fluids->GetPosPtr(),
-                                    fluids->GetVelPtr(),
-                                    fluids->GetColPtr())));
+        const uint num = min(fluids->Size(), mMaxNumOfParticles);
+
+        if (mIncrementalSortThreshold <= 0.f || !bHasSortedKeys || num != mNumOfSorted)
+        {
+            FullSort(fluids);
+            return;
+        }
+
+        // the particles are still in the order of the last build, compare every slot with its old key
+        mNumOfChanged = thrust::inner_product(thrust::device,
+                                              mGridIdxArray.Data(), mGridIdxArray.Data() + num,
+                                              mSortedGridIdx.Data(),
+                                              0u,
+                                              thrust::plus<uint>(),
+                                              thrust::not_equal_to<uint>());
+
+        if (mNumOfChanged == 0)
+            return;
+
+        if (mNumOfChanged > mIncrementalSortThreshold * num)
+            FullSort(fluids);
+        else
+            IncrementalSort(fluids, num - mNumOfChanged);
+    }
+
+    void CudaGNSearcher::FullSort(const CudaSphParticlesPtr &fluids)
+    {
+        const uint num = min(fluids->Size(), mMaxNumOfParticles);
+
+        // density and pressure move along as well, particles skipped by the local time stepping
+        // keep the values of their last update and their neighbors read them
+        auto values = thrust::make_zip_iterator(
+            thrust::make_tuple(
+                fluids->GetPosPtr(),
+                fluids->GetVelPtr(),
+                fluids->GetColPtr(),
+                fluids->GetLabelPtr(),
+                fluids->GetActivePtr(),
+                fluids->GetIntegratorStatePtr(),
+                fluids->GetMassPtr(),
+                fluids->GetSmoothingLengthPtr(),
+                fluids->GetDensityPtr(),
+                fluids->GetPressurePtr()));
+
+        if (bDeterministic)
+            thrust::stable_sort_by_key(thrust::device,
+                                       mGridIdxArray.Data(),
+                                       mGridIdxArray.Data() + num,
+                                       values);
+        else
+            thrust::sort_by_key(thrust::device,
+                                mGridIdxArray.Data(),
+                                mGridIdxArray.Data() + num,
+                                values);
+
+        thrust::copy(thrust::device, mGridIdxArray.Data(), mGridIdxArray.Data() + num, mSortedGridIdx.Data());
+        bHasSortedKeys = true;
+        mNumOfSorted = num;
+        mNumOfChanged = num;
+    }
+
+    template <typename T>
+    static void GatherInPlace(T *data, T *scratch, const uint *order, const uint num)
+    {
+        thrust::gather(thrust::device, order, order + num, data, scratch);
+        thrust::copy(thrust::device, scratch, scratch + num, data);
+    }
+
+    void CudaGNSearcher::IncrementalSort(const CudaSphParticlesPtr &fluids, const uint numOfUnchanged)
+    {
+        const uint num = min(fluids->Size(), mMaxNumOfParticles);
+        uint *keys = mGridIdxArray.Data();
+        uint *idx = mSortIdx.Data();
+        uint *changed = mScratchUInt.Data();
+
+        thrust::sequence(thrust::device, idx, idx + num);
+        thrust::transform(thrust::device,
+                          keys, keys + num,
+                          mSortedGridIdx.Data(),
+                          changed,
+                          thrust::not_equal_to<uint>());
+
+        // unchanged slots keep their relative order, so their keys are still sorted
+        auto pairs = thrust::make_zip_iterator(thrust::make_tuple(keys, idx));
+        thrust::stable_partition(thrust::device, pairs, pairs + num, changed, thrust::logical_not<uint>());
+
+        // only the particles which moved to another cell need sorting
+        if (bDeterministic)
+            thrust::stable_sort_by_key(thrust::device, keys + numOfUnchanged, keys + num, idx + numOfUnchanged);
+        else
+            thrust::sort_by_key(thrust::device, keys + numOfUnchanged, keys + num, idx + numOfUnchanged);
+
+        uint *mergedKeys = mScratchUInt.Data();
+        thrust::merge_by_key(thrust::device,
+                             keys, keys + numOfUnchanged,
+                             keys + numOfUnchanged, keys + num,
+                             idx, idx + numOfUnchanged,
+                             mergedKeys,
+                             mMergedIdx.Data());
+
+        thrust::copy(thrust::device, mergedKeys, mergedKeys + num, keys);
+        thrust::copy(thrust::device, mergedKeys, mergedKeys + num, mSortedGridIdx.Data());
+
+        // apply the permutation to the per-particle data
+        const uint *order = mMergedIdx.Data();
+        GatherInPlace(fluids->GetPosPtr(), mScratchFloat3.Data(), order, num);
+        GatherInPlace(fluids->GetVelPtr(), mScratchFloat3.Data(), order, num);
+        GatherInPlace(fluids->GetColPtr(), mScratchFloat3.Data(), order, num);
+        GatherInPlace(fluids->GetLabelPtr(), mScratchUInt.Data(), order, num);
+        GatherInPlace(fluids->GetActivePtr(), mScratchUInt.Data(), order, num);
+        GatherInPlace(fluids->GetIntegratorStatePtr(), mScratchFloat4.Data(), order, num);
+        GatherInPlace(fluids->GetMassPtr(), mScratchFloat.Data(), order, num);
+        GatherInPlace(fluids->GetSmoothingLengthPtr(), mScratchFloat.Data(), order, num);
+        GatherInPlace(fluids->GetDensityPtr(), mScratchFloat.Data(), order, num);
+        GatherInPlace(fluids->GetPressurePtr(), mScratchFloat.Data(), order, num);
+    }
+
+    CudaGNIndexSearcher::CudaGNIndexSearcher(
+        const float3 lp,
+        const float3 hp,
+        const uint num,
+        const float cellSize)
+        : CudaGNBaseSearcher(lp, hp, num, cellSize),
+          mCellIdx(num),
+          mSortedIdx(num) {}
+
+    void CudaGNIndexSearcher::BuildGNSearcher(const float3 *pos, const uint size, const float3 period)
+    {
+        const uint num = min(size, mMaxNumOfParticles);
+        const float3 lowestPoint = mLowestPoint;
+        const ThrustHelper::Pos2GridHash<float3> p2hash(mLowestPoint, mCellSize, mGridSize);
+
+        // positions may have left the box on a periodic axis, they are hashed into the cell they wrap to
+        thrust::transform(thrust::device,
+                          pos, pos + num,
+                          mGridIdxArray.Data(),
+                          [p2hash, lowestPoint, period] __host__ __device__(const float3 &p) {
+                              auto hash = p2hash;
+                              return hash(WrapPeriodic(p, lowestPoint, period));
+                          });
+
+        SortIndices(num);
+        BuildCellStart(num);
+    }
+
+    void CudaGNIndexSearcher::SortData(const CudaParticlesPtr &particles)
+    {
+        SortIndices(min(particles->Size(), mMaxNumOfParticles));
+    }
+
+    void CudaGNIndexSearcher::SortIndices(const uint num)
+    {
+        thrust::copy(thrust::device, mGridIdxArray.Data(), mGridIdxArray.Data() + num, mCellIdx.Data());
+        thrust::sequence(thrust::device, mSortedIdx.Data(), mSortedIdx.Data() + num);
+
+        // stable, so the neighbor order and the summation order do not depend on the sort
+        thrust::stable_sort_by_key(thrust::device,
+                                   mGridIdxArray.Data(),
+                                   mGridIdxArray.Data() + num,
+                                   mSortedIdx.Data());
     }
 
     CudaGNBoundarySearcher::CudaGNBoundarySearcher(
@@ -77,11 +269,12 @@ namespace KIRI
 
     void CudaGNBoundarySearcher::SortData(const CudaParticlesPtr &particles)
     {
+        // boundaries are sorted only once, always keep their order reproducible
         auto boundaries = std::dynamic_pointer_cast<CudaBoundaryParticles>(particles);
-        thrust::sort_by_key(thrust::device,
-                            mGridIdxArray.Data(),
-                            mGridIdxArray.Data() + mNumOfParticles,
-                            boundaries->GetPosPtr());
+        thrust::stable_sort_by_key(thrust::device,
+                                   mGridIdxArray.Data(),
+                                   mGridIdxArray.Data() + boundaries->Size(),
+                                   boundaries->GetPosPtr());
     }
 
 } // namespace KIRI
@@ -0,0 +1,83 @@
+/*** 
+ * @Author: Xu.WANG
+ * @Date: 2021-02-27 13:05:41
+ * @LastEditTime: 2021-02-27 18:22:10
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\sph\cuda_pbf_solver.cpp
+ */
+
+#include <kiri_pbs_cuda/sph/cuda_pbf_solver.cuh>
+
+namespace KIRI
+{
+    void CudaPBFSolver::UpdateSolver(
+        CudaSphParticlesPtr &fluids,
+        CudaBoundaryParticlesPtr &boundaries,
+        const CudaArray<uint> &cellStart,
+        const CudaArray<uint> &boundaryCellStart,
+        CudaSphParams params,
+        CudaBoundaryParams bparams)
+    {
+        // the number of fluid particles is allowed to change between steps
+        mCudaGridSize = CuCeilDiv(fluids->Size(), KIRI_CUBLOCKSIZE);
+        AllocateBuffers(fluids->MaxSize(), bparams.lowest_point, bparams.highest_point, bparams.kernel_radius);
+        mPeriod = bparams.PeriodicLength();
+
+        ExtraForces(
+            fluids,
+            params.gravity);
+
+        PredictPosition(
+            fluids,
+            params.dt,
+            bparams.lowest_point,
+            bparams.highest_point,
+            params.particle_radius);
+
+        // at least one pass, the viscosity reads the densities of the last one
+        const uint iterations = max(params.pbf_iterations, 1u);
+        for (uint iter = 0; iter < iterations; ++iter)
+        {
+            mPredSearcher->BuildGNSearcher(mPredPos->Data(), fluids->Size(), mPeriod);
+
+            ComputeLambda(
+                fluids,
+                boundaries,
+                boundaryCellStart,
+                params.rest_density,
+                params.pbf_relaxation,
+                bparams.kernel_radius,
+                bparams.grid_size);
+
+            SolveDensityConstraint(
+                fluids,
+                boundaries,
+                boundaryCellStart,
+                params.rest_density,
+                bparams.lowest_point,
+                bparams.highest_point,
+                params.particle_radius,
+                bparams.kernel_radius,
+                bparams.grid_size);
+        }
+
+        UpdateVelocity(
+            fluids,
+            params.dt);
+
+        // the last constraint pass moved the particles again
+        mPredSearcher->BuildGNSearcher(mPredPos->Data(), fluids->Size(), mPeriod);
+
+        ComputeXSPHViscosity(
+            fluids,
+            params.pbf_xsph,
+            bparams.kernel_radius,
+            bparams.grid_size);
+
+        CommitPositions(
+            fluids,
+            bparams.lowest_point);
+    }
+
+} // namespace KIRI
@@ -0,0 +1,180 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-27 13:05:41
+ * @LastEditTime: 2021-02-27 18:22:10
+ * @LastEditors: Xu.WANG
+ * @Description: 
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\sph\cuda_pbf_solver.cu
+ */
+
+#include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
+#include <kiri_pbs_cuda/sph/cuda_pbf_solver.cuh>
+#include <kiri_pbs_cuda/sph/cuda_pbf_solver_gpu.cuh>
+namespace KIRI
+{
+  void CudaPBFSolver::AllocateBuffers(
+      const uint maxNum,
+      const float3 lowestPoint,
+      const float3 highestPoint,
+      const float kernelSize)
+  {
+    if (mPredPos && mPredPos->Length() >= maxNum)
+      return;
+
+    mPredPos = std::make_shared<CudaArray<float3>>(max(maxNum, 1u));
+    mDeltaPos = std::make_shared<CudaArray<float3>>(max(maxNum, 1u));
+    mLambda = std::make_shared<CudaArray<float>>(max(maxNum, 1u));
+    mPredSearcher = std::make_shared<CudaGNIndexSearcher>(lowestPoint, highestPoint, max(maxNum, 1u), kernelSize);
+  }
+
+  void CudaPBFSolver::PredictPosition(
+      CudaSphParticlesPtr &fluids,
+      const float dt,
+      const float3 lowestPoint,
+      const float3 highestPoint,
+      const float radius)
+  {
+    PredictPosition_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        mPredPos->Data(),
+        dt,
+        fluids->Size(),
+        lowestPoint,
+        highestPoint,
+        radius,
+        mPeriod);
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaPBFSolver::ComputeLambda(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float relaxation,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    ComputeLambda_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        mPredPos->Data(),
+        fluids->GetMassPtr(),
+        fluids->GetDensityPtr(),
+        mLambda->Data(),
+        rho0,
+        relaxation,
+        fluids->Size(),
+        mPredSearcher->GetCellIdxPtr(),
+        mPredSearcher->GetSortedIdxPtr(),
+        mPredSearcher->GetCellStartPtr(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        Poly6Kernel(kernelSize),
+        SpikyKernelGrad(kernelSize));
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaPBFSolver::SolveDensityConstraint(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float3 lowestPoint,
+      const float3 highestPoint,
+      const float radius,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    ComputeDeltaPos_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        mPredPos->Data(),
+        mDeltaPos->Data(),
+        fluids->GetMassPtr(),
+        mLambda->Data(),
+        rho0,
+        fluids->Size(),
+        mPredSearcher->GetCellIdxPtr(),
+        mPredSearcher->GetSortedIdxPtr(),
+        mPredSearcher->GetCellStartPtr(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        SpikyKernelGrad(kernelSize));
+
+    ApplyDeltaPos_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        mPredPos->Data(),
+        mDeltaPos->Data(),
+        fluids->Size(),
+        lowestPoint,
+        highestPoint,
+        radius,
+        mPeriod);
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaPBFSolver::UpdateVelocity(
+      CudaSphParticlesPtr &fluids,
+      const float dt)
+  {
+    UpdateVelocity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        mPredPos->Data(),
+        1.f / dt,
+        fluids->Size());
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaPBFSolver::ComputeXSPHViscosity(
+      CudaSphParticlesPtr &fluids,
+      const float xsph,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    ComputeXSPHViscosity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        mPredPos->Data(),
+        fluids->GetVelPtr(),
+        mDeltaPos->Data(),
+        fluids->GetMassPtr(),
+        fluids->GetDensityPtr(),
+        xsph,
+        fluids->Size(),
+        mPredSearcher->GetCellIdxPtr(),
+        mPredSearcher->GetSortedIdxPtr(),
+        mPredSearcher->GetCellStartPtr(),
+        gridSize,
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        Poly6Kernel(kernelSize));
+
+    thrust::copy(thrust::device, mDeltaPos->Data(), mDeltaPos->Data() + fluids->Size(), fluids->GetVelPtr());
+    KIRI_CUKERNAL();
+  }
+
+  void CudaPBFSolver::CommitPositions(
+      CudaSphParticlesPtr &fluids,
+      const float3 lowestPoint)
+  {
+    const uint num = fluids->Size();
+    const float3 period = mPeriod;
+    thrust::transform(thrust::device,
+                      mPredPos->Data(), mPredPos->Data() + num,
+                      fluids->GetPosPtr(),
+                      [lowestPoint, period] __host__ __device__(const float3 &p) {
+                        return WrapPeriodic(p, lowestPoint, period);
+                      });
+
+    // the forces of the next step are accumulated from zero
+    thrust::fill(thrust::device, fluids->GetAccPtr(), fluids->GetAccPtr() + num, make_float3(0.f));
+    KIRI_CUKERNAL();
+  }
+
+} // namespace KIRI
@@ -19,6 +19,13 @@ namespace KIRI
         CudaSphParams params,
         CudaBoundaryParams bparams)
     {
+        // the number of fluid particles is allowed to change between steps
+        mCudaGridSize = CuCeilDiv(fluids->Size(), KIRI_CUBLOCKSIZE);
+        mIntegrator = params.integrator;
+        bDeterministic = params.deterministic;
+        mPeriod = bparams.PeriodicLength();
+        mSymmetry = bparams.SymmetryMask();
+
         ExtraForces(
             fluids,
             params.gravity);
@@ -33,6 +40,17 @@ namespace KIRI
             bparams.kernel_radius,
             bparams.grid_size);
 
+        if (mSymmetry)
+            ComputeMirrorDensity(
+                fluids,
+                boundaries,
+                params.rest_density,
+                cellStart,
+                boundaryCellStart,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
+
         ComputeNablaTerm(
             fluids,
             boundaries,
@@ -44,7 +62,38 @@ namespace KIRI
             params.rest_density,
             params.stiff);
 
-        if (params.atf_visc)
+        // the implicit solve only couples real particles, their images only feel the walls
+        const bool implicitVisc = params.implicit_visc;
+        if (mSymmetry)
+            ComputeMirrorForces(
+                fluids,
+                boundaries,
+                cellStart,
+                boundaryCellStart,
+                params.rest_density,
+                implicitVisc || params.atf_visc ? 0.f : params.visc,
+                implicitVisc || !params.atf_visc ? 0.f : params.nu,
+                implicitVisc || params.atf_visc ? params.bnu : params.visc * params.bnu,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
+
+        if (implicitVisc)
+            ComputeImplicitViscosity(
+                fluids,
+                boundaries,
+                cellStart,
+                boundaryCellStart,
+                params.rest_density,
+                params.visc,
+                params.bnu,
+                params.dt,
+                params.visc_max_iterations,
+                params.visc_tolerance,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
+        else if (params.atf_visc)
             ComputeArtificialViscosityTerm(
                 fluids,
                 boundaries,
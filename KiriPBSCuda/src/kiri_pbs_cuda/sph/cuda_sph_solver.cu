@@ -7,6 +7,8 @@
  * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\sph\cuda_sph_solver.cu
  */
 
+#include <thrust/functional.h>
+#include <thrust/inner_product.h>
 #include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
 #include <kiri_pbs_cuda/sph/cuda_sph_solver.cuh>
 #include <kiri_pbs_cuda/sph/cuda_sph_solver_gpu.cuh>
@@ -35,7 +37,7 @@ namespace KIRI
         boundaryCellStart.Data(),
         gridSize,
         ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-        ThrustHelper::GridXYZ2GridHash(gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
         Poly6Kernel(kernelSize));
 
     KIRI_CUKERNAL();
@@ -74,11 +76,83 @@ namespace KIRI
         boundaryCellStart.Data(),
         gridSize,
         ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-        ThrustHelper::GridXYZ2GridHash(gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
         SpikyKernelGrad(kernelSize));
     KIRI_CUKERNAL();
   }
 
+  void CudaSphSolver::ComputeMirrorDensity(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const float rho0,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    ComputeMirrorDensity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetDensityPtr(),
+        rho0,
+        fluids->Size(),
+        cellStart.Data(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        Poly6Kernel(kernelSize),
+        lowestPoint,
+        mSymmetry,
+        kernelSize);
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaSphSolver::ComputeMirrorForces(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float visc,
+      const float nu,
+      const float bnu,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    ComputeMirrorForces_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetDensityPtr(),
+        fluids->GetPressurePtr(),
+        rho0,
+        visc,
+        nu,
+        bnu,
+        fluids->Size(),
+        cellStart.Data(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        SpikyKernelGrad(kernelSize),
+        ViscosityKernelLaplacian(kernelSize),
+        lowestPoint,
+        mSymmetry,
+        kernelSize);
+
+    KIRI_CUKERNAL();
+  }
+
   void CudaSphSolver::ComputeViscosityTerm(
       CudaSphParticlesPtr &fluids,
       CudaBoundaryParticlesPtr &boundaries,
@@ -107,7 +181,7 @@ namespace KIRI
         boundaryCellStart.Data(),
         gridSize,
         ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-        ThrustHelper::GridXYZ2GridHash(gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
         SpikyKernelGrad(kernelSize),
         ViscosityKernelLaplacian(kernelSize));
     KIRI_CUKERNAL();
@@ -141,12 +215,155 @@ namespace KIRI
         boundaryCellStart.Data(),
         gridSize,
         ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-        ThrustHelper::GridXYZ2GridHash(gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
         SpikyKernelGrad(kernelSize));
 
     KIRI_CUKERNAL();
   }
 
+  void CudaSphSolver::ComputeImplicitViscosity(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float visc,
+      const float bnu,
+      const float dt,
+      const uint maxIterations,
+      const float tolerance,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    const uint num = fluids->Size();
+    if (!mViscX || mViscX->Length() < fluids->MaxSize())
+    {
+      const uint maxNum = max(fluids->MaxSize(), 1u);
+      mViscX = std::make_shared<CudaArray<float3>>(maxNum);
+      mViscR = std::make_shared<CudaArray<float3>>(maxNum);
+      mViscP = std::make_shared<CudaArray<float3>>(maxNum);
+      mViscAp = std::make_shared<CudaArray<float3>>(maxNum);
+    }
+
+    // the friction with the walls is cheap and stays explicit
+    ComputeBoundaryViscosityTerm_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetDensityPtr(),
+        rho0,
+        bnu,
+        num,
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        SpikyKernelGrad(kernelSize));
+
+    float3 *x = mViscX->Data(), *r = mViscR->Data(), *p = mViscP->Data(), *ap = mViscAp->Data();
+    float3 *vel = fluids->GetVelPtr(), *acc = fluids->GetAccPtr();
+
+    // b = v + dt * a is also the initial guess
+    thrust::transform(thrust::device,
+                      vel, vel + num,
+                      acc,
+                      x,
+                      [dt] __host__ __device__(const float3 &v, const float3 &a) {
+                        return v + dt * a;
+                      });
+
+    auto matVec = [&](float3 *in, float3 *out) {
+      ImplicitViscosityMatVec_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          in,
+          out,
+          fluids->GetMassPtr(),
+          fluids->GetDensityPtr(),
+          dt * visc,
+          num,
+          cellStart.Data(),
+          gridSize,
+          ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          ViscosityKernelLaplacian(kernelSize));
+    };
+
+    // the three velocity components are independent systems with the same matrix
+    auto dot3 = [this, num](const float3 *a, const float3 *b) {
+      return ComponentDot(a, b, num);
+    };
+    auto maxComponent = [](const float3 a) { return fmaxf(a.x, fmaxf(a.y, a.z)); };
+    auto safeDiv = [](const float3 a, const float3 b) {
+      return make_float3(b.x > 0.f ? a.x / b.x : 0.f, b.y > 0.f ? a.y / b.y : 0.f, b.z > 0.f ? a.z / b.z : 0.f);
+    };
+
+    const float tol2 = tolerance * tolerance * fmaxf(maxComponent(dot3(x, x)), KIRI_EPSILON);
+
+    // r = b - A b
+    matVec(x, ap);
+    thrust::transform(thrust::device, x, x + num, ap, r, thrust::minus<float3>());
+    thrust::copy(thrust::device, r, r + num, p);
+    float3 rr = dot3(r, r);
+
+    uint iter = 0;
+    while (iter < maxIterations && maxComponent(rr) > tol2)
+    {
+      matVec(p, ap);
+      const float3 alpha = safeDiv(rr, dot3(p, ap));
+
+      thrust::transform(thrust::device, x, x + num, p, x,
+                        [alpha] __host__ __device__(const float3 &xi, const float3 &pi) { return xi + alpha * pi; });
+      thrust::transform(thrust::device, r, r + num, ap, r,
+                        [alpha] __host__ __device__(const float3 &ri, const float3 &api) { return ri - alpha * api; });
+
+      const float3 rrNew = dot3(r, r);
+      const float3 beta = safeDiv(rrNew, rr);
+      thrust::transform(thrust::device, r, r + num, p, p,
+                        [beta] __host__ __device__(const float3 &ri, const float3 &pi) { return ri + beta * pi; });
+
+      rr = rrNew;
+      ++iter;
+    }
+
+    // the advection applies v += dt * a
+    const float invDt = 1.f / dt;
+    thrust::transform(thrust::device,
+                      x, x + num,
+                      vel,
+                      acc,
+                      [invDt] __host__ __device__(const float3 &xi, const float3 &v) {
+                        return (xi - v) * invDt;
+                      });
+
+    mViscIterations = iter;
+    KIRI_CUKERNAL();
+  }
+
+  float3 CudaSphSolver::ComponentDot(const float3 *a, const float3 *b, const uint num)
+  {
+    if (!bDeterministic)
+      return thrust::inner_product(thrust::device, a, a + num, b, make_float3(0.f), thrust::plus<float3>(), ThrustHelper::ComponentProduct());
+
+    // the block count does not depend on num, so neither does the summation order of the partial sums
+    const uint numOfBlocks = KIRI_CUBLOCKSIZE;
+    if (!mDotPartial)
+      mDotPartial = std::make_shared<CudaArray<float3>>(numOfBlocks);
+
+    ComponentDotPartial_CUDA<<<numOfBlocks, KIRI_CUBLOCKSIZE>>>(a, b, mDotPartial->Data(), num);
+    KIRI_CUKERNAL();
+
+    float3 partial[numOfBlocks];
+    KIRI_CUCALL(cudaMemcpy(partial, mDotPartial->Data(), sizeof(float3) * numOfBlocks, cudaMemcpyDeviceToHost));
+
+    float3 sum = make_float3(0.f);
+    for (uint i = 0; i < numOfBlocks; ++i)
+      sum += partial[i];
+    return sum;
+  }
+
   void CudaSphSolver::Advect(
       CudaSphParticlesPtr &fluids,
       const float dt,
@@ -155,16 +372,19 @@ namespace KIRI
       const float radius)
   {
     uint num = fluids->Size();
-    fluids->Advect(dt);
+    fluids->Advect(dt, bSleeping, mIntegrator);
     BoundaryConstrain_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
         fluids->GetPosPtr(),
         fluids->GetVelPtr(),
         num,
         lowestPoint,
         highestPoint,
-        radius);
+        radius,
+        mPeriod,
+        mSymmetry,
+        mIntegrator == IntegratorType::Leapfrog ? fluids->GetIntegratorStatePtr() : nullptr);
 
-    thrust::fill(thrust::device, fluids->GetDensityPtr(), fluids->GetDensityPtr() + num, 0.f);
+    // the density kernel overwrites the density, only the acceleration is accumulated
     thrust::fill(thrust::device, fluids->GetAccPtr(), fluids->GetAccPtr() + num, make_float3(0.f));
     KIRI_CUKERNAL();
   }
@@ -19,62 +19,176 @@ namespace KIRI
         CudaSphParams params,
         CudaBoundaryParams bparams)
     {
-        ExtraForces(
-            fluids,
-            params.gravity);
+        // the number of fluid particles is allowed to change between steps
+        mCudaGridSize = CuCeilDiv(fluids->Size(), KIRI_CUBLOCKSIZE);
+        mIntegrator = params.integrator;
+        bDeterministic = params.deterministic;
+        mPeriod = bparams.PeriodicLength();
+        mSymmetry = bparams.SymmetryMask();
 
-        ComputeDensity(
-            fluids,
-            boundaries,
-            params.rest_density,
-            cellStart,
-            boundaryCellStart,
-            bparams.lowest_point,
-            bparams.kernel_radius,
-            bparams.grid_size);
+        const uint numOfLevels = max(params.local_dt_levels, 1u);
+        bLocalTimeStep = params.local_dt;
+        bAdaptive = params.adaptive;
+        bSleeping = params.sleeping && !bLocalTimeStep;
+        if (bLocalTimeStep)
+            ScheduleLocalTimeStep(
+                fluids,
+                numOfLevels,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
+        else if (bSleeping)
+            WakeParticles(
+                fluids,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
 
-        ComputeNablaTerm(
+        ExtraForces(
             fluids,
-            boundaries,
-            cellStart,
-            boundaryCellStart,
-            bparams.lowest_point,
-            bparams.kernel_radius,
-            bparams.grid_size,
-            params.rest_density,
-            params.stiff);
+            params.gravity);
 
-        if (params.atf_visc)
-            ComputeArtificialViscosityTerm(
+        if (bAdaptive)
+            ComputeAdaptiveForces(
                 fluids,
                 boundaries,
                 cellStart,
                 boundaryCellStart,
                 params.rest_density,
-                params.nu,
+                params.stiff,
+                params.visc,
                 params.bnu,
                 bparams.lowest_point,
                 bparams.kernel_radius,
                 bparams.grid_size);
         else
-            ComputeViscosityTerm(
+        {
+            ComputeDensity(
                 fluids,
                 boundaries,
+                params.rest_density,
                 cellStart,
                 boundaryCellStart,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size);
+
+            if (mSymmetry)
+                ComputeMirrorDensity(
+                    fluids,
+                    boundaries,
+                    params.rest_density,
+                    cellStart,
+                    boundaryCellStart,
+                    bparams.lowest_point,
+                    bparams.kernel_radius,
+                    bparams.grid_size);
+
+            ComputeNablaTerm(
+                fluids,
+                boundaries,
+                cellStart,
+                boundaryCellStart,
+                bparams.lowest_point,
+                bparams.kernel_radius,
+                bparams.grid_size,
                 params.rest_density,
-                params.visc,
-                params.bnu,
+                params.stiff);
+
+            // the implicit solve only couples real particles, their images only feel the walls
+            const bool implicitVisc = params.implicit_visc && !bLocalTimeStep;
+            if (mSymmetry)
+                ComputeMirrorForces(
+                    fluids,
+                    boundaries,
+                    cellStart,
+                    boundaryCellStart,
+                    params.rest_density,
+                    implicitVisc || params.atf_visc ? 0.f : params.visc,
+                    implicitVisc || !params.atf_visc ? 0.f : params.nu,
+                    implicitVisc || params.atf_visc ? params.bnu : params.visc * params.bnu,
+                    bparams.lowest_point,
+                    bparams.kernel_radius,
+                    bparams.grid_size);
+
+            if (implicitVisc)
+                ComputeImplicitViscosity(
+                    fluids,
+                    boundaries,
+                    cellStart,
+                    boundaryCellStart,
+                    params.rest_density,
+                    params.visc,
+                    params.bnu,
+                    params.dt,
+                    params.visc_max_iterations,
+                    params.visc_tolerance,
+                    bparams.lowest_point,
+                    bparams.kernel_radius,
+                    bparams.grid_size);
+            else if (params.atf_visc)
+                ComputeArtificialViscosityTerm(
+                    fluids,
+                    boundaries,
+                    cellStart,
+                    boundaryCellStart,
+                    params.rest_density,
+                    params.nu,
+                    params.bnu,
+                    bparams.lowest_point,
+                    bparams.kernel_radius,
+                    bparams.grid_size);
+            else
+                ComputeViscosityTerm(
+                    fluids,
+                    boundaries,
+                    cellStart,
+                    boundaryCellStart,
+                    params.rest_density,
+                    params.visc,
+                    params.bnu,
+                    bparams.lowest_point,
+                    bparams.kernel_radius,
+                    bparams.grid_size);
+        }
+
+        if (bAdaptive && ++mAdaptiveStep >= max(params.adaptive_interval, 1u))
+        {
+            mAdaptiveStep = 0;
+            AdaptResolution(
+                fluids,
+                cellStart,
+                params,
                 bparams.lowest_point,
                 bparams.kernel_radius,
                 bparams.grid_size);
+        }
 
-        Advect(
-            fluids,
-            params.dt,
-            bparams.lowest_point,
-            bparams.highest_point,
-            params.particle_radius);
+        // the flags decided here are used for the advection below and the next step
+        if (bSleeping)
+            UpdateActivity(
+                fluids,
+                params.sleep_velocity,
+                params.sleep_acceleration);
+
+        if (bLocalTimeStep)
+            AdvectLocalTimeStep(
+                fluids,
+                params.dt,
+                numOfLevels,
+                params.local_dt_cfl,
+                bparams.lowest_point,
+                bparams.highest_point,
+                bparams.kernel_radius,
+                bparams.grid_size,
+                params.particle_radius);
+        else
+            Advect(
+                fluids,
+                params.dt,
+                bparams.lowest_point,
+                bparams.highest_point,
+                params.particle_radius);
     }
 
 } // namespace KIRI
\ No newline at end of file
@@ -7,6 +7,10 @@
  * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\sph\cuda_wcsph_solver.cu
  */
 
+#include <thrust/count.h>
+#include <thrust/functional.h>
+#include <thrust/scan.h>
+#include <thrust/transform_reduce.h>
 #include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
 #include <kiri_pbs_cuda/sph/cuda_wcsph_solver.cuh>
 #include <kiri_pbs_cuda/sph/cuda_wcsph_solver_gpu.cuh>
@@ -14,6 +18,343 @@
 namespace KIRI
 {
 
+  const uint *CudaWCSphSolver::ActivePtr(const CudaSphParticlesPtr &fluids) const
+  {
+    return (bSleeping || bLocalTimeStep) ? fluids->GetActivePtr() : nullptr;
+  }
+
+  void CudaWCSphSolver::WakeParticles(
+      CudaSphParticlesPtr &fluids,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    const uint numOfCells = gridSize.x * gridSize.y * gridSize.z;
+    if (!mCellActive || mCellActive->Length() < numOfCells)
+      mCellActive = std::make_shared<CudaArray<uint>>(numOfCells);
+    else
+      mCellActive->Clear();
+
+    MarkActiveCells_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetActivePtr(),
+        mCellActive->Data(),
+        fluids->Size(),
+        ThrustHelper::Pos2GridHash<float3>(lowestPoint, kernelSize, gridSize));
+
+    WakeParticles_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetActivePtr(),
+        mCellActive->Data(),
+        fluids->Size(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod));
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::ScheduleLocalTimeStep(
+      CudaSphParticlesPtr &fluids,
+      const uint numOfLevels,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    const uint numOfCells = gridSize.x * gridSize.y * gridSize.z;
+    if (!mCellLevel || mCellLevel->Length() < numOfCells)
+      mCellLevel = std::make_shared<CudaArray<uint>>(numOfCells);
+
+    // empty cells do not limit their neighbors
+    thrust::fill(thrust::device, mCellLevel->Data(), mCellLevel->Data() + numOfCells, numOfLevels);
+
+    MarkCellLevels_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetIntegratorStatePtr(),
+        mCellLevel->Data(),
+        fluids->Size(),
+        ThrustHelper::Pos2GridHash<float3>(lowestPoint, kernelSize, gridSize));
+
+    ScheduleLocalTimeStep_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetIntegratorStatePtr(),
+        fluids->GetActivePtr(),
+        mCellLevel->Data(),
+        fluids->Size(),
+        mLocalStep,
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod));
+
+    mNumOfUpdated = thrust::count(thrust::device, fluids->GetActivePtr(), fluids->GetActivePtr() + fluids->Size(), 1u);
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::AdvectLocalTimeStep(
+      CudaSphParticlesPtr &fluids,
+      const float dt,
+      const uint numOfLevels,
+      const float cfl,
+      const float3 lowestPoint,
+      const float3 highestPoint,
+      const float kernelSize,
+      const int3 gridSize,
+      const float radius)
+  {
+    const uint num = fluids->Size();
+    AdvectLocalTimeStep_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetIntegratorStatePtr(),
+        fluids->GetActivePtr(),
+        mCellLevel->Data(),
+        num,
+        mLocalStep,
+        dt,
+        numOfLevels,
+        cfl,
+        kernelSize,
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod));
+
+    BoundaryConstrain_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        num,
+        lowestPoint,
+        highestPoint,
+        radius,
+        mPeriod,
+        mSymmetry,
+        nullptr);
+
+    thrust::fill(thrust::device, fluids->GetAccPtr(), fluids->GetAccPtr() + num, make_float3(0.f));
+    mLocalStep = (mLocalStep + 1) & ((1u << (numOfLevels - 1)) - 1);
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::ComputeAdaptiveForces(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float stiff,
+      const float visc,
+      const float bnu,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    const uint num = fluids->Size();
+    const float maxRadius = thrust::transform_reduce(
+        thrust::device,
+        fluids->GetSmoothingLengthPtr(), fluids->GetSmoothingLengthPtr() + num,
+        [kernelSize] __host__ __device__(const float h) {
+          return h > 0.f ? h : kernelSize;
+        },
+        kernelSize,
+        thrust::maximum<float>());
+
+    ComputeAdaptiveDensity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetSmoothingLengthPtr(),
+        fluids->GetDensityPtr(),
+        rho0,
+        num,
+        cellStart.Data(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        kernelSize,
+        maxRadius,
+        ActivePtr(fluids));
+
+    ComputePressureByTait_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetDensityPtr(),
+        fluids->GetPressurePtr(),
+        num,
+        rho0,
+        stiff,
+        mNegativeScale,
+        ActivePtr(fluids));
+
+    ComputeAdaptiveForces_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetSmoothingLengthPtr(),
+        fluids->GetDensityPtr(),
+        fluids->GetPressurePtr(),
+        rho0,
+        visc,
+        bnu,
+        num,
+        cellStart.Data(),
+        boundaries->GetPosPtr(),
+        boundaries->GetVolumePtr(),
+        boundaryCellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        kernelSize,
+        maxRadius,
+        ActivePtr(fluids));
+
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::AdaptResolution(
+      CudaSphParticlesPtr &fluids,
+      const CudaArray<uint> &cellStart,
+      const CudaSphParams &params,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    const uint num = fluids->Size();
+    const uint capacity = fluids->MaxSize();
+    const uint numOfCells = gridSize.x * gridSize.y * gridSize.z;
+    if (!mCellDist || mCellDist->Length() < numOfCells)
+      mCellDist = std::make_shared<CudaArray<uint>>(numOfCells);
+
+    if (!mResolutionAction)
+    {
+      mResolutionAction = std::make_shared<CudaArray<uint>>(capacity);
+      mMergePartner = std::make_shared<CudaArray<uint>>(capacity);
+      mSplitSlot = std::make_shared<CudaArray<uint>>(capacity);
+      mRemoved = std::make_shared<CudaArray<uint>>(capacity);
+    }
+
+    // distance to the free surface or the region of interest in cells, only needed up to the coarsest band
+    const uint band = max(params.adaptive_band, 1u);
+    const uint farDist = (params.adaptive_max_level + 1) * band;
+    const uint cellGridSize = CuCeilDiv(numOfCells, KIRI_CUBLOCKSIZE);
+    InitCellDistance_CUDA<<<cellGridSize, KIRI_CUBLOCKSIZE>>>(
+        mCellDist->Data(),
+        gridSize,
+        lowestPoint,
+        kernelSize,
+        params.adaptive_roi_lower,
+        params.adaptive_roi_upper,
+        farDist);
+
+    MarkSurfaceCells_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetDensityPtr(),
+        mCellDist->Data(),
+        num,
+        params.adaptive_surface_density * params.rest_density,
+        ThrustHelper::Pos2GridHash<float3>(lowestPoint, kernelSize, gridSize));
+
+    for (uint pass = 0; pass < farDist; pass++)
+      DilateCellDistance_CUDA<<<cellGridSize, KIRI_CUBLOCKSIZE>>>(mCellDist->Data(), gridSize, ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod));
+
+    ClassifyResolution_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetMassPtr(),
+        mCellDist->Data(),
+        mResolutionAction->Data(),
+        num,
+        params.rest_mass,
+        params.adaptive_max_level,
+        band,
+        ThrustHelper::Pos2GridHash<float3>(lowestPoint, kernelSize, gridSize));
+
+    ProposeMerge_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetSmoothingLengthPtr(),
+        mResolutionAction->Data(),
+        mMergePartner->Data(),
+        num,
+        params.rest_mass,
+        cellStart.Data(),
+        gridSize,
+        ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+        kernelSize);
+
+    mRemoved->Clear();
+    MergeParticles_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetPosPtr(),
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetMassPtr(),
+        fluids->GetSmoothingLengthPtr(),
+        fluids->GetActivePtr(),
+        fluids->GetIntegratorStatePtr(),
+        mMergePartner->Data(),
+        mRemoved->Data(),
+        num,
+        params.rest_mass,
+        kernelSize,
+        ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod));
+
+    // children are written behind the particles in the order of their parents, as many as the capacity allows
+    thrust::transform_exclusive_scan(
+        thrust::device,
+        mResolutionAction->Data(), mResolutionAction->Data() + num,
+        mSplitSlot->Data(),
+        [] __host__ __device__(const uint action) {
+          return action == 1 ? 1u : 0u;
+        },
+        0u,
+        thrust::plus<uint>());
+
+    const uint numOfSplits = thrust::count(thrust::device, mResolutionAction->Data(), mResolutionAction->Data() + num, 1u);
+    const uint numOfChildren = fluids->Extend(numOfSplits);
+    if (numOfChildren > 0)
+      SplitParticles_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          fluids->GetVelPtr(),
+          fluids->GetAccPtr(),
+          fluids->GetColPtr(),
+          fluids->GetMassPtr(),
+          fluids->GetSmoothingLengthPtr(),
+          fluids->GetDensityPtr(),
+          fluids->GetPressurePtr(),
+          fluids->GetLabelPtr(),
+          fluids->GetActivePtr(),
+          fluids->GetIntegratorStatePtr(),
+          mResolutionAction->Data(),
+          mSplitSlot->Data(),
+          num,
+          numOfChildren,
+          params.rest_mass,
+          kernelSize,
+          params.particle_radius);
+
+    fluids->RemoveParticles(mRemoved->Data());
+
+    // the advection of this step runs over the new particles
+    mCudaGridSize = CuCeilDiv(fluids->Size(), KIRI_CUBLOCKSIZE);
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::UpdateActivity(
+      CudaSphParticlesPtr &fluids,
+      const float velThreshold,
+      const float accThreshold)
+  {
+    UpdateActivity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+        fluids->GetVelPtr(),
+        fluids->GetAccPtr(),
+        fluids->GetActivePtr(),
+        fluids->Size(),
+        velThreshold * velThreshold,
+        accThreshold * accThreshold);
+
+    KIRI_CUKERNAL();
+  }
+
   void CudaWCSphSolver::ComputeDensity(
       CudaSphParticlesPtr &fluids,
       CudaBoundaryParticlesPtr &boundaries,
@@ -37,8 +378,9 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          CubicKernel(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          CubicKernel(kernelSize),
+          ActivePtr(fluids));
     else
       ComputeDensity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
           fluids->GetPosPtr(),
@@ -52,8 +394,9 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          Poly6Kernel(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          Poly6Kernel(kernelSize),
+          ActivePtr(fluids));
 
     KIRI_CUKERNAL();
   }
@@ -76,7 +419,8 @@ namespace KIRI
         fluids->Size(),
         rho0,
         stiff,
-        mNegativeScale);
+        mNegativeScale,
+        ActivePtr(fluids));
     if (bCubicKernel)
       ComputeNablaTermConstrain_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
           fluids->GetPosPtr(),
@@ -92,8 +436,9 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          CubicKernelGrad(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          CubicKernelGrad(kernelSize),
+          ActivePtr(fluids));
     else
       ComputeNablaTermConstrain_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
           fluids->GetPosPtr(),
@@ -109,8 +454,131 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          SpikyKernelGrad(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          SpikyKernelGrad(kernelSize),
+          ActivePtr(fluids));
+    KIRI_CUKERNAL();
+  }
+
+  void CudaWCSphSolver::ComputeMirrorDensity(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const float rho0,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    if (bCubicKernel)
+      ComputeMirrorDensity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          fluids->GetMassPtr(),
+          fluids->GetDensityPtr(),
+          rho0,
+          fluids->Size(),
+          cellStart.Data(),
+          boundaries->GetPosPtr(),
+          boundaries->GetVolumePtr(),
+          boundaryCellStart.Data(),
+          gridSize,
+          ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          CubicKernel(kernelSize),
+          lowestPoint,
+          mSymmetry,
+          kernelSize,
+          ActivePtr(fluids));
+    else
+      ComputeMirrorDensity_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          fluids->GetMassPtr(),
+          fluids->GetDensityPtr(),
+          rho0,
+          fluids->Size(),
+          cellStart.Data(),
+          boundaries->GetPosPtr(),
+          boundaries->GetVolumePtr(),
+          boundaryCellStart.Data(),
+          gridSize,
+          ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          Poly6Kernel(kernelSize),
+          lowestPoint,
+          mSymmetry,
+          kernelSize,
+          ActivePtr(fluids));
+
+    KIRI_CUKERNAL();
+  }
+
+  // the same kernels as the pressure and viscosity terms of the real neighbors
+  void CudaWCSphSolver::ComputeMirrorForces(
+      CudaSphParticlesPtr &fluids,
+      CudaBoundaryParticlesPtr &boundaries,
+      const CudaArray<uint> &cellStart,
+      const CudaArray<uint> &boundaryCellStart,
+      const float rho0,
+      const float visc,
+      const float nu,
+      const float bnu,
+      const float3 lowestPoint,
+      const float kernelSize,
+      const int3 gridSize)
+  {
+    if (bCubicKernel)
+      ComputeMirrorForces_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          fluids->GetVelPtr(),
+          fluids->GetAccPtr(),
+          fluids->GetMassPtr(),
+          fluids->GetDensityPtr(),
+          fluids->GetPressurePtr(),
+          rho0,
+          visc,
+          nu,
+          bnu,
+          fluids->Size(),
+          cellStart.Data(),
+          boundaries->GetPosPtr(),
+          boundaries->GetVolumePtr(),
+          boundaryCellStart.Data(),
+          gridSize,
+          ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          CubicKernelGrad(kernelSize),
+          ViscosityKernelLaplacian(kernelSize),
+          lowestPoint,
+          mSymmetry,
+          kernelSize,
+          ActivePtr(fluids));
+    else
+      ComputeMirrorForces_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
+          fluids->GetPosPtr(),
+          fluids->GetVelPtr(),
+          fluids->GetAccPtr(),
+          fluids->GetMassPtr(),
+          fluids->GetDensityPtr(),
+          fluids->GetPressurePtr(),
+          rho0,
+          visc,
+          nu,
+          bnu,
+          fluids->Size(),
+          cellStart.Data(),
+          boundaries->GetPosPtr(),
+          boundaries->GetVolumePtr(),
+          boundaryCellStart.Data(),
+          gridSize,
+          ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          SpikyKernelGrad(kernelSize),
+          SpikyKernelLaplacian(kernelSize),
+          lowestPoint,
+          mSymmetry,
+          kernelSize,
+          ActivePtr(fluids));
+
     KIRI_CUKERNAL();
   }
 
@@ -143,9 +611,10 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
           CubicKernelGrad(kernelSize),
-          ViscosityKernelLaplacian(kernelSize));
+          ViscosityKernelLaplacian(kernelSize),
+          ActivePtr(fluids));
     else
       ComputeViscosityTerm_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
           fluids->GetPosPtr(),
@@ -163,9 +632,10 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
           SpikyKernelGrad(kernelSize),
-          SpikyKernelLaplacian(kernelSize));
+          SpikyKernelLaplacian(kernelSize),
+          ActivePtr(fluids));
     KIRI_CUKERNAL();
   }
 
@@ -198,8 +668,9 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          CubicKernelGrad(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          CubicKernelGrad(kernelSize),
+          ActivePtr(fluids));
     else
       ComputeArtificialViscosityTerm_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(
           fluids->GetPosPtr(),
@@ -217,8 +688,9 @@ namespace KIRI
           boundaryCellStart.Data(),
           gridSize,
           ThrustHelper::Pos2GridXYZ<float3>(lowestPoint, kernelSize, gridSize),
-          ThrustHelper::GridXYZ2GridHash(gridSize),
-          SpikyKernelGrad(kernelSize));
+          ThrustHelper::GridXYZ2GridHash(gridSize, mPeriod),
+          SpikyKernelGrad(kernelSize),
+          ActivePtr(fluids));
     KIRI_CUKERNAL();
   }
 
@@ -0,0 +1,277 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 15:20:47
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description:
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\system\cuda_sph_distributed_system.cu
+ */
+
+#include <cstring>
+
+#include <kiri_pbs_cuda/sph/cuda_sph_solver.cuh>
+#include <kiri_pbs_cuda/system/cuda_sph_distributed_system.cuh>
+
+namespace KIRI
+{
+    static const uint OWNED_LABEL = 0;
+    static const uint HALO_LABEL = 1;
+
+    template <typename T>
+    static void PackArray(char *&ptr, const Vector<T> &data)
+    {
+        if (!data.empty())
+            memcpy(ptr, data.data(), sizeof(T) * data.size());
+        ptr += sizeof(T) * data.size();
+    }
+
+    template <typename T>
+    static void UnpackArray(const char *&ptr, const uint num, Vector<T> &data)
+    {
+        const T *p = reinterpret_cast<const T *>(ptr);
+        data.insert(data.end(), p, p + num);
+        ptr += sizeof(T) * num;
+    }
+
+    void CudaSphDistributedSystem::HostParticles::Add(const HostParticles &src, const size_t i)
+    {
+        pos.emplace_back(src.pos[i]);
+        vel.emplace_back(src.vel[i]);
+        col.emplace_back(src.col[i]);
+        mass.emplace_back(src.mass[i]);
+        smoothingLength.emplace_back(src.smoothingLength[i]);
+        active.emplace_back(src.active[i]);
+        integratorState.emplace_back(src.integratorState[i]);
+    }
+
+    Vec_Byte CudaSphDistributedSystem::PackParticles(const HostParticles &particles)
+    {
+        const uint num = particles.Size();
+        const size_t bytes = (3 * sizeof(float3) + 2 * sizeof(float) + sizeof(uint) + sizeof(float4)) * num;
+
+        Vec_Byte data(sizeof(uint) + bytes);
+        char *ptr = data.data();
+        memcpy(ptr, &num, sizeof(uint));
+        ptr += sizeof(uint);
+
+        PackArray(ptr, particles.pos);
+        PackArray(ptr, particles.vel);
+        PackArray(ptr, particles.col);
+        PackArray(ptr, particles.mass);
+        PackArray(ptr, particles.smoothingLength);
+        PackArray(ptr, particles.active);
+        PackArray(ptr, particles.integratorState);
+        return data;
+    }
+
+    void CudaSphDistributedSystem::UnpackParticles(const Vec_Byte &data, HostParticles &particles)
+    {
+        if (data.size() < sizeof(uint))
+            return;
+
+        uint num = 0;
+        const char *ptr = data.data();
+        memcpy(&num, ptr, sizeof(uint));
+        ptr += sizeof(uint);
+
+        UnpackArray(ptr, num, particles.pos);
+        UnpackArray(ptr, num, particles.vel);
+        UnpackArray(ptr, num, particles.col);
+        UnpackArray(ptr, num, particles.mass);
+        UnpackArray(ptr, num, particles.smoothingLength);
+        UnpackArray(ptr, num, particles.active);
+        UnpackArray(ptr, num, particles.integratorState);
+    }
+
+    CudaSphDistributedSystem::CudaSphDistributedSystem(
+        const CudaSphTransportPtr &transport,
+        const Vec_Float3 &fluidPos,
+        const Vec_Float3 &fluidCol,
+        const Vec_Float3 &boundaryPos,
+        const CudaSphParams &params,
+        const CudaBoundaryParams &boundaryParams,
+        CudaSolverFactory solverFactory,
+        const uint maxNumOfParticles,
+        const int haloCells,
+        const uint rebalanceInterval,
+        const float rebalanceThreshold)
+        : mTransport(transport),
+          mParams(params),
+          mRebalanceInterval(rebalanceInterval),
+          mRebalanceThreshold(rebalanceThreshold),
+          mStep(0),
+          mNumOfOwned(0)
+    {
+        mDecomposition = std::make_shared<CudaSphDomainDecomposition>(boundaryParams, mTransport->NumOfRanks(), haloCells);
+
+        if (!solverFactory)
+            solverFactory = [](const uint num) { return std::make_shared<CudaSphSolver>(num); };
+
+        // every rank starts from the same particle list, keeps its own slab and copies the neighbors' halos
+        HostParticles input;
+        input.pos = fluidPos;
+        input.col = fluidCol;
+        input.vel.assign(fluidPos.size(), make_float3(0.f));
+        input.mass.assign(fluidPos.size(), mParams.rest_mass);
+        input.smoothingLength.assign(fluidPos.size(), 0.f);
+        input.active.assign(fluidPos.size(), 1u);
+        input.integratorState.assign(fluidPos.size(), make_float4(0.f));
+
+        const int rank = Rank();
+        HostParticles halo;
+        for (size_t i = 0; i < input.Size(); i++)
+        {
+            const int column = mDecomposition->Column(input.pos[i]);
+            const int owner = mDecomposition->OwnerOfColumn(column);
+            if (owner == rank)
+                mLocal.Add(input, i);
+            else if ((owner == rank - 1 && mDecomposition->InUpperHalo(owner, column)) ||
+                     (owner == rank + 1 && mDecomposition->InLowerHalo(owner, column)))
+                halo.Add(input, i);
+        }
+
+        mNumOfOwned = mLocal.Size();
+        for (size_t i = 0; i < halo.Size(); i++)
+            mLocal.Add(halo, i);
+
+        mLabel.assign(mLocal.Size(), HALO_LABEL);
+        std::fill(mLabel.begin(), mLabel.begin() + mNumOfOwned, OWNED_LABEL);
+
+        // owned + halo particles of one rank can never exceed the global count
+        const uint capacity = maxNumOfParticles > 0 ? maxNumOfParticles : static_cast<uint>(fluidPos.size());
+
+        mFluids = std::make_shared<CudaSphParticles>(Vec_Float3(), Vec_Float3(), capacity);
+        UploadParticles(mLocal, mLabel);
+
+        // boundaries are small and read-only, every rank keeps the whole set
+        auto fluids = mFluids;
+        CudaBoundaryParticlesPtr boundaries = std::make_shared<CudaBoundaryParticles>(boundaryPos);
+        auto solver = solverFactory(capacity);
+        CudaGNSearcherPtr searcher = std::make_shared<CudaGNSearcher>(
+            boundaryParams.lowest_point,
+            boundaryParams.highest_point,
+            capacity,
+            boundaryParams.kernel_radius);
+        CudaGNBoundarySearcherPtr boundarySearcher = std::make_shared<CudaGNBoundarySearcher>(
+            boundaryParams.lowest_point,
+            boundaryParams.highest_point,
+            boundaries->Size(),
+            boundaryParams.kernel_radius);
+
+        mSystem = std::make_shared<CudaSphSystem>(
+            fluids,
+            boundaries,
+            solver,
+            searcher,
+            boundarySearcher,
+            mParams,
+            boundaryParams,
+            false);
+    }
+
+    float CudaSphDistributedSystem::UpdateSystem()
+    {
+        ExchangeParticles();
+        mStep++;
+        return mSystem->UpdateSystem();
+    }
+
+    void CudaSphDistributedSystem::UploadParticles(const HostParticles &particles, const Vector<uint> &label)
+    {
+        mFluids->SetParticles(
+            particles.pos,
+            particles.vel,
+            particles.col,
+            label,
+            particles.mass,
+            particles.smoothingLength,
+            particles.active,
+            particles.integratorState);
+    }
+
+    void CudaSphDistributedSystem::ExchangeParticles()
+    {
+        const int rank = Rank();
+        const int numOfRanks = mTransport->NumOfRanks();
+
+        mFluids->GetParticles(mLocal.pos, mLocal.vel, mLocal.col, mLabel);
+        mFluids->GetParticleState(mLocal.mass, mLocal.smoothingLength, mLocal.active, mLocal.integratorState);
+
+        // drop the halos of the last step
+        HostParticles owned;
+        for (size_t i = 0; i < mLocal.Size(); i++)
+            if (mLabel[i] == OWNED_LABEL)
+                owned.Add(mLocal, i);
+
+        if (mRebalanceInterval > 0 && mStep % mRebalanceInterval == 0)
+            Rebalance(owned.pos);
+
+        // migrate particles which left the slab, the cuts may have moved by more than one neighbor after a rebalance
+        Vector<HostParticles> send(numOfRanks);
+        for (size_t i = 0; i < owned.Size(); i++)
+            send[mDecomposition->Owner(owned.pos[i])].Add(owned, i);
+
+        HostParticles particles = std::move(send[rank]);
+        for (int peer = 0; peer < numOfRanks; peer++)
+        {
+            if (peer == rank)
+                continue;
+
+            UnpackParticles(mTransport->Exchange(peer, PackParticles(send[peer])), particles);
+        }
+
+        mNumOfOwned = particles.Size();
+
+        // halo copies for the direct neighbors
+        HostParticles lower, upper;
+        for (uint i = 0; i < mNumOfOwned; i++)
+        {
+            const int column = mDecomposition->Column(particles.pos[i]);
+            if (mDecomposition->InLowerHalo(rank, column))
+                lower.Add(particles, i);
+
+            if (mDecomposition->InUpperHalo(rank, column))
+                upper.Add(particles, i);
+        }
+
+        if (rank > 0)
+            UnpackParticles(mTransport->Exchange(rank - 1, PackParticles(lower)), particles);
+
+        if (rank < numOfRanks - 1)
+            UnpackParticles(mTransport->Exchange(rank + 1, PackParticles(upper)), particles);
+
+        mLabel.assign(particles.Size(), HALO_LABEL);
+        std::fill(mLabel.begin(), mLabel.begin() + mNumOfOwned, OWNED_LABEL);
+
+        UploadParticles(particles, mLabel);
+    }
+
+    void CudaSphDistributedSystem::Rebalance(const Vec_Float3 &ownedPos)
+    {
+        // every rank computes the same cuts from the global histogram
+        auto histogram = mDecomposition->Histogram(ownedPos);
+        mTransport->AllReduceSum(histogram);
+
+        if (mDecomposition->Imbalance(histogram) > mRebalanceThreshold)
+            mDecomposition->Rebalance(histogram);
+    }
+
+    void CudaSphDistributedSystem::GetOwnedParticles(Vec_Float3 &pos, Vec_Float3 &vel, Vec_Float3 &col) const
+    {
+        Vec_Float3 localPos, localVel, localCol;
+        Vector<uint> label;
+        mFluids->GetParticles(localPos, localVel, localCol, label);
+
+        pos.clear();
+        vel.clear();
+        col.clear();
+        for (size_t i = 0; i < localPos.size(); i++)
+        {
+            if (label[i] != OWNED_LABEL)
+                continue;
+            pos.emplace_back(localPos[i]);
+            vel.emplace_back(localVel[i]);
+            col.emplace_back(localCol[i]);
+        }
+    }
+} // namespace KIRI
@@ -0,0 +1,124 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 13:40:06
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description:
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\system\cuda_sph_domain_decomposition.cu
+ */
+
+#include <algorithm>
+
+#include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
+#include <kiri_pbs_cuda/system/cuda_sph_domain_decomposition.cuh>
+
+namespace KIRI
+{
+    static inline int AxisOf(const int3 &v, const int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    CudaSphDomainDecomposition::CudaSphDomainDecomposition(
+        const CudaBoundaryParams &bparams,
+        const int numOfRanks,
+        const int haloCells)
+        : mBoundaryParams(bparams),
+          mNumOfRanks(max(numOfRanks, 1)),
+          mHaloCells(max(haloCells, 1))
+    {
+        // the slabs have no halo across the domain ends, so periodic axes are never cut
+        const int3 gridSize = make_int3(
+            mBoundaryParams.periodic.x ? 0 : mBoundaryParams.grid_size.x,
+            mBoundaryParams.periodic.y ? 0 : mBoundaryParams.grid_size.y,
+            mBoundaryParams.periodic.z ? 0 : mBoundaryParams.grid_size.z);
+        mAxis = 0;
+        if (gridSize.y > AxisOf(gridSize, mAxis))
+            mAxis = 1;
+        if (gridSize.z > AxisOf(gridSize, mAxis))
+            mAxis = 2;
+
+        mNumOfColumns = AxisOf(gridSize, mAxis);
+        if (mNumOfColumns < mNumOfRanks * mHaloCells)
+            printf("CudaSphDomainDecomposition: %d columns are too few for %d ranks with %d halo cells\n", mNumOfColumns, mNumOfRanks, mHaloCells);
+
+        // even split until the first rebalance
+        mCuts.resize(mNumOfRanks + 1);
+        for (int r = 0; r <= mNumOfRanks; r++)
+            mCuts[r] = r * mNumOfColumns / mNumOfRanks;
+    }
+
+    int CudaSphDomainDecomposition::Column(const float3 &pos) const
+    {
+        auto p2xyz = ThrustHelper::Pos2GridXYZ<float3>(mBoundaryParams.lowest_point, mBoundaryParams.kernel_radius, mBoundaryParams.grid_size);
+        return AxisOf(p2xyz(pos), mAxis);
+    }
+
+    int CudaSphDomainDecomposition::OwnerOfColumn(const int column) const
+    {
+        auto it = std::upper_bound(mCuts.begin() + 1, mCuts.end() - 1, column);
+        return static_cast<int>(it - (mCuts.begin() + 1));
+    }
+
+    bool CudaSphDomainDecomposition::InLowerHalo(const int rank, const int column) const
+    {
+        return rank > 0 && column >= mCuts[rank] && column < mCuts[rank] + mHaloCells;
+    }
+
+    bool CudaSphDomainDecomposition::InUpperHalo(const int rank, const int column) const
+    {
+        return rank < mNumOfRanks - 1 && column < mCuts[rank + 1] && column >= mCuts[rank + 1] - mHaloCells;
+    }
+
+    Vector<uint> CudaSphDomainDecomposition::Histogram(const Vec_Float3 &pos) const
+    {
+        Vector<uint> histogram(mNumOfColumns, 0);
+        for (const auto &p : pos)
+            histogram[Column(p)]++;
+        return histogram;
+    }
+
+    float CudaSphDomainDecomposition::Imbalance(const Vector<uint> &histogram) const
+    {
+        uint total = 0, maxLoad = 0;
+        for (int r = 0; r < mNumOfRanks; r++)
+        {
+            uint load = 0;
+            for (int c = mCuts[r]; c < mCuts[r + 1]; c++)
+                load += histogram[c];
+            total += load;
+            maxLoad = max(maxLoad, load);
+        }
+
+        if (total == 0)
+            return 1.f;
+        return maxLoad / (static_cast<float>(total) / mNumOfRanks);
+    }
+
+    void CudaSphDomainDecomposition::Rebalance(const Vector<uint> &histogram)
+    {
+        // a slab must stay at least as wide as the halo, so halos only come from direct neighbors
+        const int minWidth = mHaloCells;
+
+        double total = 0.0;
+        for (auto h : histogram)
+            total += h;
+        const double target = total / mNumOfRanks;
+
+        double accumulated = 0.0;
+        int column = 0;
+        for (int r = 1; r < mNumOfRanks; r++)
+        {
+            const int lower = mCuts[r - 1] + minWidth;
+            const int upper = mNumOfColumns - (mNumOfRanks - r) * minWidth;
+
+            while (column < mNumOfColumns && (column < lower || accumulated + histogram[column] <= r * target) && column < upper)
+                accumulated += histogram[column++];
+
+            mCuts[r] = min(max(column, lower), upper);
+            while (column < mCuts[r])
+                accumulated += histogram[column++];
+        }
+        mCuts[mNumOfRanks] = mNumOfColumns;
+    }
+} // namespace KIRI
@@ -0,0 +1,187 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-21 14:10:43
+ * @LastEditTime: 2021-02-21 18:45:30
+ * @LastEditors: Xu.WANG
+ * @Description:
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\system\cuda_sph_sweep_runner.cu
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <thrust/transform_reduce.h>
+#include <thrust/functional.h>
+
+#include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
+#include <kiri_pbs_cuda/sph/cuda_sph_solver.cuh>
+#include <kiri_pbs_cuda/system/cuda_sph_sweep_runner.cuh>
+
+namespace KIRI
+{
+    CudaSphSweepRunner::CudaSphSweepRunner(
+        const Vec_Float3 &fluidPos,
+        const Vec_Float3 &fluidCol,
+        const Vec_Float3 &boundaryPos,
+        const CudaBoundaryParams &boundaryParams,
+        CudaSolverFactory solverFactory,
+        const uint numOfThreads)
+        : mFluidPos(fluidPos),
+          mFluidCol(fluidCol),
+          mBoundaryParams(boundaryParams),
+          mNumOfThreads(numOfThreads > 0 ? numOfThreads : max(1u, std::thread::hardware_concurrency())),
+          mSolverFactory(solverFactory)
+    {
+        if (!mSolverFactory)
+            mSolverFactory = [](const uint num) { return std::make_shared<CudaSphSolver>(num); };
+
+        // boundary sampling, sorting and volume are identical for every variant, do it once
+        mBoundaries = std::make_shared<CudaBoundaryParticles>(boundaryPos);
+        mBoundarySearcher = std::make_shared<CudaGNBoundarySearcher>(
+            mBoundaryParams.lowest_point,
+            mBoundaryParams.highest_point,
+            mBoundaries->Size(),
+            mBoundaryParams.kernel_radius);
+
+        CudaSphSystem::PrepareBoundaries(mBoundaries, mBoundarySearcher, mBoundaryParams);
+        KIRI_CUCALL(cudaDeviceSynchronize());
+    }
+
+    void CudaSphSweepRunner::AddCase(const CudaSphParams &params, const uint steps)
+    {
+        mCases.emplace_back(CudaSphSweepCase{params, steps});
+    }
+
+    CudaSphSweepResult CudaSphSweepRunner::RunCase(const uint id)
+    {
+        const auto &sweepCase = mCases[id];
+
+        CudaSphSweepResult result{};
+        result.id = id;
+        result.params = sweepCase.params;
+        result.steps = sweepCase.steps;
+        result.solver_time = 0.f;
+
+        auto wallStart = std::chrono::steady_clock::now();
+
+        auto fluids = std::make_shared<CudaSphParticles>(mFluidPos, mFluidCol);
+        auto boundaries = mBoundaries;
+        auto boundarySearcher = mBoundarySearcher;
+        auto solver = mSolverFactory(fluids->Size());
+        CudaGNSearcherPtr searcher = std::make_shared<CudaGNSearcher>(
+            mBoundaryParams.lowest_point,
+            mBoundaryParams.highest_point,
+            fluids->Size(),
+            mBoundaryParams.kernel_radius);
+
+        auto system = std::make_shared<CudaSphSystem>(
+            fluids,
+            boundaries,
+            solver,
+            searcher,
+            boundarySearcher,
+            sweepCase.params,
+            mBoundaryParams,
+            false);
+
+        for (uint i = 0; i < sweepCase.steps; i++)
+            result.solver_time += system->UpdateSystem();
+
+        auto sysFluids = system->GetFluids();
+        auto vel = sysFluids->GetVelPtr();
+        auto num = sysFluids->Size();
+
+        result.max_speed = thrust::transform_reduce(
+            thrust::device,
+            vel, vel + num,
+            ThrustHelper::Length(),
+            0.f,
+            thrust::maximum<float>());
+
+        result.kinetic_energy = 0.5f * sweepCase.params.rest_mass *
+                                thrust::transform_reduce(
+                                    thrust::device,
+                                    vel, vel + num,
+                                    ThrustHelper::LengthSquared(),
+                                    0.f,
+                                    thrust::plus<float>());
+
+        result.finite = isfinite(result.max_speed) && isfinite(result.kinetic_energy);
+        result.wall_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+
+        return result;
+    }
+
+    Vec_SweepResult CudaSphSweepRunner::Run()
+    {
+        Vec_SweepResult results(mCases.size());
+        std::atomic<uint> next(0);
+
+        auto worker = [&]() {
+            for (uint id = next++; id < mCases.size(); id = next++)
+            {
+                // failures are reported in the result row, the workers never print
+                std::string error;
+                try
+                {
+                    results[id] = RunCase(id);
+                    continue;
+                }
+                catch (const char *s)
+                {
+                    error = s;
+                }
+                catch (const std::exception &e)
+                {
+                    error = e.what();
+                }
+                catch (...)
+                {
+                    error = "unknown exception";
+                }
+
+                results[id].id = id;
+                results[id].params = mCases[id].params;
+                results[id].steps = mCases[id].steps;
+                results[id].finite = false;
+                results[id].error = error;
+            }
+        };
+
+        const uint numOfWorkers = min(mNumOfThreads, static_cast<uint>(mCases.size()));
+        Vector<std::thread> workers;
+        for (uint t = 0; t < numOfWorkers; t++)
+            workers.emplace_back(worker);
+
+        for (auto &w : workers)
+            w.join();
+
+        return results;
+    }
+
+    void CudaSphSweepRunner::WriteResultsHeader(std::ostream &os)
+    {
+        os << "id,visc,stiff,nu,bnu,atf_visc,dt,integrator,steps,solver_time_ms,wall_time_ms,max_speed,kinetic_energy,finite,error\n";
+    }
+
+    void CudaSphSweepRunner::WriteResult(std::ostream &os, const CudaSphSweepResult &result)
+    {
+        os << result.id << ","
+           << result.params.visc << ","
+           << result.params.stiff << ","
+           << result.params.nu << ","
+           << result.params.bnu << ","
+           << result.params.atf_visc << ","
+           << result.params.dt << ","
+           << static_cast<int>(result.params.integrator) << ","
+           << result.steps << ","
+           << result.solver_time << ","
+           << result.wall_time << ","
+           << result.max_speed << ","
+           << result.kinetic_energy << ","
+           << result.finite << ","
+           << "\"" << result.error << "\"\n";
+    }
+
+} // namespace KIRI
@@ -10,6 +10,11 @@
 #include <kiri_pbs_cuda/thrust_helper/helper_thrust.cuh>
 #include <kiri_pbs_cuda/system/cuda_sph_system.cuh>
 #include <kiri_pbs_cuda/system/cuda_sph_system_gpu.cuh>
+#include <kiri_pbs_cuda/sph/cuda_pbf_solver.cuh>
+
+#include <thrust/transform_reduce.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
 
 #include <glad/glad.h>
 #include <cuda_gl_interop.h>
@@ -22,43 +27,87 @@ namespace KIRI
         CudaBaseSolverPtr &solver,
         CudaGNSearcherPtr &searcher,
         CudaGNBoundarySearcherPtr &boundarySearcher,
+        const CudaSphParams &params,
+        const CudaBoundaryParams &boundaryParams,
         bool openGL)
         : mFluids(std::move(fluidParticles)),
           mBoundaries(std::move(boundaryParticles)),
           mSolver(std::move(solver)),
           mSearcher(std::move(searcher)),
           mBoundarySearcher(std::move(boundarySearcher)),
+          mParams(params),
+          mBoundaryParams(boundaryParams),
           bOpenGL(openGL),
-          mCudaGridSize(CuCeilDiv(mFluids->Size(), KIRI_CUBLOCKSIZE))
+          mCudaGridSize(CuCeilDiv(mFluids->Size(), KIRI_CUBLOCKSIZE)),
+          mNumOfSteps(0),
+          pptr(nullptr),
+          cptr(nullptr),
+          mPositionsVBO(0),
+          mColorsVBO(0)
     {
+        // with less than three cells the wrapped 27 cell stencil visits the same cell twice and counts
+        // its particles twice
+        const int3 gridSize = mBoundaryParams.grid_size;
+        if ((mBoundaryParams.periodic.x && gridSize.x < 3) ||
+            (mBoundaryParams.periodic.y && gridSize.y < 3) ||
+            (mBoundaryParams.periodic.z && gridSize.z < 3))
+            throw "CudaSphSystem: a periodic axis needs at least three grid cells";
+
+        if (mParams.adaptive && (mParams.implicit_visc || mParams.atf_visc))
+            throw "CudaSphSystem: adaptive resolution only supports the explicit laminar viscosity";
+
+        // the pbf solver has neither the resolution levels nor the per particle time steps, it would silently
+        // run a uniform single rate simulation
+        if (std::dynamic_pointer_cast<CudaPBFSolver>(mSolver) && (mParams.adaptive || mParams.local_dt || mParams.sleeping))
+            throw "CudaSphSystem: the pbf solver does not support adaptive resolution, local time stepping or sleeping";
+
+        // only the sph and non adaptive wcsph kernels add the mirror images, elsewhere the plane would be
+        // an empty wall and the particles next to it would see half the density
+        const int3 symmetric = mBoundaryParams.symmetric;
+        if (symmetric.x || symmetric.y || symmetric.z)
+        {
+            if ((symmetric.x && mBoundaryParams.periodic.x) ||
+                (symmetric.y && mBoundaryParams.periodic.y) ||
+                (symmetric.z && mBoundaryParams.periodic.z))
+                throw "CudaSphSystem: an axis cannot be symmetric and periodic";
 
-        uint maxNumOfParticles = mFluids->Size();
+            if (mParams.adaptive)
+                throw "CudaSphSystem: adaptive resolution does not support symmetry planes";
 
-        KIRI_CUCALL(cudaMalloc((void **)&pptr, sizeof(float4) * maxNumOfParticles));
-        KIRI_CUCALL(cudaMalloc((void **)&cptr, sizeof(float4) * maxNumOfParticles));
+            if (std::dynamic_pointer_cast<CudaPBFSolver>(mSolver))
+                throw "CudaSphSystem: the pbf solver does not support symmetry planes";
+        }
 
-        // init position vbo
-        uint bufSize = maxNumOfParticles * sizeof(float4);
-        glGenBuffers(1, &mPositionsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, mPositionsVBO);
-        glBufferData(GL_ARRAY_BUFFER, bufSize, nullptr, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        uint maxNumOfParticles = mFluids->MaxSize();
 
-        // init color vbo
-        uint colorBufSize = maxNumOfParticles * sizeof(float4);
-        glGenBuffers(1, &mColorsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, mColorsVBO);
-        glBufferData(GL_ARRAY_BUFFER, colorBufSize, nullptr, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (bOpenGL)
+        {
+            KIRI_CUCALL(cudaMalloc((void **)&pptr, sizeof(float4) * maxNumOfParticles));
+            KIRI_CUCALL(cudaMalloc((void **)&cptr, sizeof(float4) * maxNumOfParticles));
+
+            // init position vbo
+            uint bufSize = maxNumOfParticles * sizeof(float4);
+            glGenBuffers(1, &mPositionsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, mPositionsVBO);
+            glBufferData(GL_ARRAY_BUFFER, bufSize, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            // init color vbo
+            uint colorBufSize = maxNumOfParticles * sizeof(float4);
+            glGenBuffers(1, &mColorsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, mColorsVBO);
+            glBufferData(GL_ARRAY_BUFFER, colorBufSize, nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
 
-        // build boundary searcher
-        mBoundarySearcher->BuildGNSearcher(mBoundaries);
+        mSearcher->SetDeterministic(mParams.deterministic);
 
-        // compute boundary volume(Akinci2012)
-        ComputeBoundaryVolume();
+        // shared boundaries are only prepared by the first system
+        if (!mBoundaries->IsPrepared())
+            PrepareBoundaries(mBoundaries, mBoundarySearcher, mBoundaryParams);
 
-        // init fluid system
-        thrust::fill(thrust::device, mFluids->GetMassPtr(), mFluids->GetMassPtr() + mFluids->Size(), CUDA_SPH_PARAMS.rest_mass);
+        // init fluid system, with adaptive resolution rest_mass is the finest level
+        thrust::fill(thrust::device, mFluids->GetMassPtr(), mFluids->GetMassPtr() + mFluids->MaxSize(), mParams.rest_mass);
 
         if (bOpenGL)
             UpdateSystemForVBO();
@@ -96,36 +145,78 @@ namespace KIRI
 
     void CudaSphSystem::CopyGPUData2VBO(float4 *pos, float4 *col, const CudaSphParticlesPtr &fluids)
     {
+        if (fluids->Size() == 0)
+            return;
 
-        CopyGPUData2VBO_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(pos, col, fluids->GetPosPtr(), fluids->GetColPtr(), fluids->Size(), CUDA_SPH_PARAMS.particle_radius);
+        mCudaGridSize = CuCeilDiv(fluids->Size(), KIRI_CUBLOCKSIZE);
+
+        CopyGPUData2VBO_CUDA<<<mCudaGridSize, KIRI_CUBLOCKSIZE>>>(pos, col, fluids->GetPosPtr(), fluids->GetColPtr(), fluids->Size(), mParams.particle_radius);
 
         KIRI_CUKERNAL();
     }
 
-    void CudaSphSystem::ComputeBoundaryVolume()
+    void CudaSphSystem::PrepareBoundaries(
+        const CudaBoundaryParticlesPtr &boundaries,
+        const CudaGNBoundarySearcherPtr &boundarySearcher,
+        const CudaBoundaryParams &bparams)
     {
-        auto mCudaBoundaryGridSize = CuCeilDiv(mBoundaries->Size(), KIRI_CUBLOCKSIZE);
+        // build boundary searcher
+        boundarySearcher->BuildGNSearcher(boundaries);
+
+        // compute boundary volume(Akinci2012)
+        auto mCudaBoundaryGridSize = CuCeilDiv(boundaries->Size(), KIRI_CUBLOCKSIZE);
 
         ComputeBoundaryVolume_CUDA<<<mCudaBoundaryGridSize, KIRI_CUBLOCKSIZE>>>(
-            mBoundaries->GetPosPtr(),
-            mBoundaries->GetVolumePtr(),
-            mBoundaries->Size(),
-            mBoundarySearcher->GetCellStartPtr(),
-            mBoundarySearcher->GetGridSize(),
-            ThrustHelper::Pos2GridXYZ<float3>(mBoundarySearcher->GetLowestPoint(), mBoundarySearcher->GetCellSize(), mBoundarySearcher->GetGridSize()),
-            ThrustHelper::GridXYZ2GridHash(mBoundarySearcher->GetGridSize()),
-            Poly6Kernel(mBoundarySearcher->GetCellSize()));
+            boundaries->GetPosPtr(),
+            boundaries->GetVolumePtr(),
+            boundaries->Size(),
+            boundarySearcher->GetCellStartPtr(),
+            boundarySearcher->GetGridSize(),
+            ThrustHelper::Pos2GridXYZ<float3>(boundarySearcher->GetLowestPoint(), boundarySearcher->GetCellSize(), boundarySearcher->GetGridSize()),
+            ThrustHelper::GridXYZ2GridHash(boundarySearcher->GetGridSize(), bparams.PeriodicLength()),
+            Poly6Kernel(boundarySearcher->GetCellSize()),
+            bparams.lowest_point,
+            bparams.SymmetryMask(),
+            boundarySearcher->GetCellSize());
         KIRI_CUKERNAL();
+
+        boundaries->SetPrepared();
+    }
+
+    unsigned long long CudaSphSystem::StateHash() const
+    {
+        auto first = thrust::make_zip_iterator(
+            thrust::make_tuple(
+                thrust::counting_iterator<uint>(0),
+                mFluids->GetPosPtr(),
+                mFluids->GetVelPtr()));
+
+        // integer sum wraps around and is associative, so any reduction order gives the same hash
+        return thrust::transform_reduce(
+            thrust::device,
+            first, first + mFluids->Size(),
+            ThrustHelper::ParticleStateHash(),
+            0ull,
+            thrust::plus<unsigned long long>());
     }
 
     float CudaSphSystem::UpdateSystem()
     {
+        if (mEmitter)
+            mEmitter->Emit(mFluids, mParams.dt, mParams.rest_mass);
+
+        // a rank of a decomposed domain can be empty for a while
+        if (mFluids->Size() == 0)
+            return 0.f;
+
         cudaEvent_t start, stop;
         KIRI_CUCALL(cudaEventCreate(&start));
         KIRI_CUCALL(cudaEventCreate(&stop));
         KIRI_CUCALL(cudaEventRecord(start, 0));
 
-        mSearcher->BuildGNSearcher(mFluids);
+        if (mSolver->NeedsSortedFluids())
+            mSearcher->BuildGNSearcher(mFluids);
+
         try
         {
             mSolver->UpdateSolver(
@@ -133,9 +224,10 @@ namespace KIRI
                 mBoundaries,
                 mSearcher->GetCellStart(),
                 mBoundarySearcher->GetCellStart(),
-                CUDA_SPH_PARAMS,
-                CUDA_BOUNDARY_PARAMS);
-            cudaDeviceSynchronize();
+                mParams,
+                mBoundaryParams);
+            // only wait for this thread's stream, other systems may run concurrently
+            cudaStreamSynchronize(0);
             KIRI_CUKERNAL();
         }
         catch (const char *s)
@@ -147,6 +239,10 @@ namespace KIRI
             std::cout << "Unknown Exception at " << __FILE__ << ": line " << __LINE__ << "\n";
         }
 
+        mNumOfSteps++;
+        if (mParams.state_hash_interval > 0 && mNumOfSteps % mParams.state_hash_interval == 0)
+            printf("CudaSphSystem: step %u state hash %016llx\n", mNumOfSteps, StateHash());
+
         float milliseconds;
         KIRI_CUCALL(cudaEventRecord(stop, 0));
         KIRI_CUCALL(cudaEventSynchronize(stop));
@@ -0,0 +1,337 @@
+/*
+ * @Author: Xu.WANG
+ * @Date: 2021-02-22 10:40:18
+ * @LastEditTime: 2021-02-22 21:03:12
+ * @LastEditors: Xu.WANG
+ * @Description:
+ * @FilePath: \Kiri\KiriPBSCuda\src\kiri_pbs_cuda\system\cuda_sph_transport.cpp
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <memory>
+
+#include <kiri_pbs_cuda/system/cuda_sph_transport.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+typedef SOCKET KiriSocketHandle;
+#define KIRI_CLOSE_SOCKET closesocket
+#define KIRI_INVALID_SOCKET ((long long)INVALID_SOCKET)
+#else
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+typedef int KiriSocketHandle;
+#define KIRI_CLOSE_SOCKET close
+#define KIRI_INVALID_SOCKET (-1ll)
+#endif
+
+namespace KIRI
+{
+    Vec_Byte CudaSphTransport::Exchange(const int peer, const Vec_Byte &data)
+    {
+        Vec_Byte received;
+        if (Rank() < peer)
+        {
+            Send(peer, data);
+            received = Recv(peer);
+        }
+        else
+        {
+            received = Recv(peer);
+            Send(peer, data);
+        }
+        return received;
+    }
+
+    void CudaSphTransport::AllReduceSum(Vector<uint> &data)
+    {
+        // gather to rank 0, then broadcast the sum
+        const size_t bytes = sizeof(uint) * data.size();
+        if (Rank() == 0)
+        {
+            for (int r = 1; r < NumOfRanks(); r++)
+            {
+                auto msg = Recv(r);
+                const uint *other = reinterpret_cast<const uint *>(msg.data());
+                for (size_t i = 0; i < data.size() && (i + 1) * sizeof(uint) <= msg.size(); i++)
+                    data[i] += other[i];
+            }
+
+            Vec_Byte sum(bytes);
+            if (bytes > 0)
+                memcpy(sum.data(), data.data(), bytes);
+            for (int r = 1; r < NumOfRanks(); r++)
+                Send(r, sum);
+        }
+        else
+        {
+            Vec_Byte local(bytes);
+            if (bytes > 0)
+                memcpy(local.data(), data.data(), bytes);
+            Send(0, local);
+
+            auto sum = Recv(0);
+            if (bytes > 0 && sum.size() == bytes)
+                memcpy(data.data(), sum.data(), bytes);
+        }
+    }
+
+    CudaSphLocalTransportHub::CudaSphLocalTransportHub(const int numOfRanks)
+        : mNumOfRanks(numOfRanks)
+    {
+        for (int i = 0; i < numOfRanks * numOfRanks; i++)
+            mMailBoxes.emplace_back(std::make_unique<MailBox>());
+    }
+
+    void CudaSphLocalTransportHub::Push(const int src, const int dst, const Vec_Byte &data)
+    {
+        auto &box = *mMailBoxes[src * mNumOfRanks + dst];
+        {
+            std::lock_guard<std::mutex> lock(box.mutex);
+            box.messages.push(data);
+        }
+        box.cond.notify_one();
+    }
+
+    Vec_Byte CudaSphLocalTransportHub::Pop(const int src, const int dst)
+    {
+        auto &box = *mMailBoxes[src * mNumOfRanks + dst];
+        std::unique_lock<std::mutex> lock(box.mutex);
+        box.cond.wait(lock, [&box]() { return !box.messages.empty(); });
+
+        Vec_Byte data = std::move(box.messages.front());
+        box.messages.pop();
+        return data;
+    }
+
+    void CudaSphLocalTransport::Send(const int dst, const Vec_Byte &data)
+    {
+        mHub->Push(mRank, dst, data);
+    }
+
+    Vec_Byte CudaSphLocalTransport::Recv(const int src)
+    {
+        return mHub->Pop(src, mRank);
+    }
+
+    static void SplitAddress(const std::string &address, std::string &host, std::string &port)
+    {
+        auto pos = address.rfind(':');
+        host = address.substr(0, pos);
+        port = (pos == std::string::npos) ? std::string() : address.substr(pos + 1);
+    }
+
+    // closes the socket when it goes out of scope, unless it was handed over to the transport
+    struct KiriSocketGuard
+    {
+        long long handle;
+
+        explicit KiriSocketGuard(const long long socket = KIRI_INVALID_SOCKET) : handle(socket) {}
+        KiriSocketGuard(const KiriSocketGuard &) = delete;
+        KiriSocketGuard &operator=(const KiriSocketGuard &) = delete;
+
+        ~KiriSocketGuard()
+        {
+            if (handle != KIRI_INVALID_SOCKET)
+                KIRI_CLOSE_SOCKET((KiriSocketHandle)handle);
+        }
+
+        long long Release()
+        {
+            const long long r = handle;
+            handle = KIRI_INVALID_SOCKET;
+            return r;
+        }
+    };
+
+    typedef std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> AddrInfoPtr;
+
+    static AddrInfoPtr ResolveAddress(const char *host, const std::string &port, const addrinfo &hints, const char *error)
+    {
+        addrinfo *info = nullptr;
+        if (getaddrinfo(host, port.c_str(), &hints, &info) != 0)
+            throw error;
+        return AddrInfoPtr(info, &freeaddrinfo);
+    }
+
+    static long long ToSocket(const KiriSocketHandle s)
+    {
+#ifdef _WIN32
+        return s == INVALID_SOCKET ? KIRI_INVALID_SOCKET : (long long)s;
+#else
+        return s < 0 ? KIRI_INVALID_SOCKET : (long long)s;
+#endif
+    }
+
+    CudaSphSocketTransport::CudaSphSocketTransport(
+        const int rank,
+        const Vector<std::string> &address)
+        : mRank(rank),
+          mSockets(address.size(), KIRI_INVALID_SOCKET)
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+            throw "CudaSphSocketTransport: WSAStartup failed";
+#endif
+
+        // the destructor does not run for a constructor which throws, undo the setup here
+        try
+        {
+            Connect(address);
+        }
+        catch (...)
+        {
+            CloseSockets();
+            throw;
+        }
+    }
+
+    void CudaSphSocketTransport::Connect(const Vector<std::string> &address)
+    {
+        std::string host, port;
+        SplitAddress(address[mRank], host, port);
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        // listen for the ranks above, connect to the ranks below
+        KiriSocketGuard listener;
+        if (mRank + 1 < NumOfRanks())
+        {
+            auto info = ResolveAddress(nullptr, port, hints, "CudaSphSocketTransport: invalid listen address");
+
+            listener.handle = ToSocket(socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+            if (listener.handle == KIRI_INVALID_SOCKET)
+                throw "CudaSphSocketTransport: cannot create socket";
+
+            int reuse = 1;
+            setsockopt((KiriSocketHandle)listener.handle, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+            if (bind((KiriSocketHandle)listener.handle, info->ai_addr, (socklen_t)info->ai_addrlen) != 0 ||
+                listen((KiriSocketHandle)listener.handle, NumOfRanks()) != 0)
+                throw "CudaSphSocketTransport: cannot listen";
+        }
+
+        for (int peer = 0; peer < mRank; peer++)
+        {
+            std::string peerHost, peerPort;
+            SplitAddress(address[peer], peerHost, peerPort);
+
+            hints.ai_flags = 0;
+            auto info = ResolveAddress(peerHost.c_str(), peerPort, hints, "CudaSphSocketTransport: invalid peer address");
+
+            // the peer might not listen yet, retry for a while
+            KiriSocketGuard s;
+            for (int attempt = 0; attempt < 600 && s.handle == KIRI_INVALID_SOCKET; attempt++)
+            {
+                KiriSocketGuard candidate(ToSocket(socket(info->ai_family, info->ai_socktype, info->ai_protocol)));
+                if (candidate.handle != KIRI_INVALID_SOCKET &&
+                    connect((KiriSocketHandle)candidate.handle, info->ai_addr, (socklen_t)info->ai_addrlen) == 0)
+                    s.handle = candidate.Release();
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            if (s.handle == KIRI_INVALID_SOCKET)
+                throw "CudaSphSocketTransport: cannot connect to peer";
+
+            int rankId = mRank;
+            SendAll(s.handle, reinterpret_cast<const char *>(&rankId), sizeof(rankId));
+            mSockets[peer] = s.Release();
+        }
+
+        for (int i = mRank + 1; i < NumOfRanks(); i++)
+        {
+            KiriSocketGuard s(ToSocket(accept((KiriSocketHandle)listener.handle, nullptr, nullptr)));
+            if (s.handle == KIRI_INVALID_SOCKET)
+                throw "CudaSphSocketTransport: accept failed";
+
+            int rankId = -1;
+            RecvAll(s.handle, reinterpret_cast<char *>(&rankId), sizeof(rankId));
+            if (rankId <= mRank || rankId >= NumOfRanks() || mSockets[rankId] != KIRI_INVALID_SOCKET)
+                throw "CudaSphSocketTransport: unexpected peer rank";
+            mSockets[rankId] = s.Release();
+        }
+
+        // halo messages are latency bound
+        for (auto s : mSockets)
+        {
+            if (s == KIRI_INVALID_SOCKET)
+                continue;
+            int noDelay = 1;
+            setsockopt((KiriSocketHandle)s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+        }
+    }
+
+    void CudaSphSocketTransport::CloseSockets() noexcept
+    {
+        for (auto &s : mSockets)
+        {
+            if (s != KIRI_INVALID_SOCKET)
+                KIRI_CLOSE_SOCKET((KiriSocketHandle)s);
+            s = KIRI_INVALID_SOCKET;
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    CudaSphSocketTransport::~CudaSphSocketTransport() noexcept
+    {
+        CloseSockets();
+    }
+
+    void CudaSphSocketTransport::SendAll(const long long s, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            auto sent = send((KiriSocketHandle)s, data, (int)std::min(size, (size_t)(1 << 30)), 0);
+            if (sent <= 0)
+                throw "CudaSphSocketTransport: send failed";
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    void CudaSphSocketTransport::RecvAll(const long long s, char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            auto received = recv((KiriSocketHandle)s, data, (int)std::min(size, (size_t)(1 << 30)), 0);
+            if (received <= 0)
+                throw "CudaSphSocketTransport: connection lost";
+            data += received;
+            size -= received;
+        }
+    }
+
+    void CudaSphSocketTransport::Send(const int dst, const Vec_Byte &data)
+    {
+        unsigned long long size = data.size();
+        SendAll(mSockets[dst], reinterpret_cast<const char *>(&size), sizeof(size));
+        if (size > 0)
+            SendAll(mSockets[dst], data.data(), data.size());
+    }
+
+    Vec_Byte CudaSphSocketTransport::Recv(const int src)
+    {
+        unsigned long long size = 0;
+        RecvAll(mSockets[src], reinterpret_cast<char *>(&size), sizeof(size));
+
+        Vec_Byte data(size);
+        if (size > 0)
+            RecvAll(mSockets[src], data.data(), data.size());
+        return data;
+    }
+} // namespace KIRI
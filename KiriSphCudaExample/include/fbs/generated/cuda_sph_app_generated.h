@@ -20,29 +20,32 @@ struct CudaSphAppBuilder;
 enum CudaSphType {
   CudaSphType_SPH = 0,
   CudaSphType_WCSPH = 1,
+  CudaSphType_PBF = 2,
   CudaSphType_MIN = CudaSphType_SPH,
-  CudaSphType_MAX = CudaSphType_WCSPH
+  CudaSphType_MAX = CudaSphType_PBF
 };
 
-inline const CudaSphType (&EnumValuesCudaSphType())[2] {
+inline const CudaSphType (&EnumValuesCudaSphType())[3] {
   static const CudaSphType values[] = {
     CudaSphType_SPH,
-    CudaSphType_WCSPH
+    CudaSphType_WCSPH,
+    CudaSphType_PBF
   };
   return values;
 }
 
 inline const char * const *EnumNamesCudaSphType() {
-  static const char * const names[3] = {
+  static const char * const names[4] = {
     "SPH",
     "WCSPH",
+    "PBF",
     nullptr
   };
   return names;
 }
 
 inline const char *EnumNameCudaSphType(CudaSphType e) {
-  if (flatbuffers::IsOutRange(e, CudaSphType_SPH, CudaSphType_WCSPH)) return "";
+  if (flatbuffers::IsOutRange(e, CudaSphType_SPH, CudaSphType_PBF)) return "";
   const size_t index = static_cast<size_t>(e);
   return EnumNamesCudaSphType()[index];
 }
@@ -11,6 +11,7 @@
 #include <imgui/include/imgui.h>
 
 #include <kiri_pbs_cuda/sph/cuda_wcsph_solver.cuh>
+#include <kiri_pbs_cuda/sph/cuda_pbf_solver.cuh>
 #include <kiri_pbs_cuda/particle/particles_sampler_basic.h>
 
 #include <fbs/generated/cuda_sph_app_generated.h>
@@ -114,6 +115,10 @@ namespace KIRI
             pSolver = std::make_shared<CudaWCSphSolver>(
                 fluidParticles->Size());
             break;
+        case FlatBuffers::CudaSphType::CudaSphType_PBF:
+            pSolver = std::make_shared<CudaPBFSolver>(
+                fluidParticles->Size());
+            break;
         default:
             pSolver = std::make_shared<CudaSphSolver>(
                 fluidParticles->Size());
@@ -137,7 +142,9 @@ namespace KIRI
             boundaryParticles,
             pSolver,
             searcher,
-            boundarySearcher);
+            boundarySearcher,
+            CUDA_SPH_PARAMS,
+            CUDA_BOUNDARY_PARAMS);
 
         // ssf data
         auto ssf_data = scene_config_data->renderer_data();
@@ -219,6 +226,20 @@ namespace KIRI
                 {
                     //ImGui::Checkbox("Emit Particles", &SPH_DEM_DEMO_PARAMS.EmitParticles);
 
+                    // the running system holds a copy of the parameters, so the change is passed on to it
+                    const char *integrators[] = {"semi-implicit euler", "leapfrog", "velocity verlet"};
+                    int integrator = static_cast<int>(CUDA_SPH_PARAMS.integrator);
+                    if (ImGui::Combo("Integrator", &integrator, integrators, IM_ARRAYSIZE(integrators)))
+                    {
+                        CUDA_SPH_PARAMS.integrator = static_cast<IntegratorType>(integrator);
+                        if (mSystem)
+                        {
+                            auto params = mSystem->GetParams();
+                            params.integrator = CUDA_SPH_PARAMS.integrator;
+                            mSystem->SetParams(params);
+                        }
+                    }
+
                     if (ImGui::Button("Reset Simulation"))
                     {
                         SSF_DEMO_PARAMS.resetSSF = true;